@@ -38,7 +38,8 @@
 // nearest competitor is Bob Jenkins' Spooky.  We don't have great data for
 // other 64-bit CPUs, but for long strings we know that Spooky is slightly
 // faster than CityHash on some relatively recent AMD x86-64 CPUs, for example.
-// Note that CityHashCrc128 is declared in citycrc.h.
+// CityHashCrc128 uses the SSE4.2 CRC32 instruction when the CPU has it,
+// and computes the same values in software otherwise.
 //
 // For 32-bit x86 code, we don't know of anything faster than CityHash32 that
 // is of comparable quality.  We believe our nearest competitor is Murmur3A.
@@ -96,6 +97,17 @@ WRUTIL_API uint64 CityHash64WithSeed(const char *buf, size_t len, uint64 seed);
 WRUTIL_API uint64 CityHash64WithSeeds(const char *buf, size_t len,
                                       uint64 seed0, uint64 seed1);
 
+// Sets hashes[i] to CityHash64(keys[i], lens[i]) for i < n.  Faster than
+// calling CityHash64() for each key when there are many short keys: the
+// cases for keys of up to 64 bytes are inlined into the loop, and each key's
+// data is prefetched several keys ahead.
+WRUTIL_API void CityHash64Many(const char *const *keys, const size_t *lens,
+                               size_t n, uint64 *hashes);
+
+// Sets hashes[i] to CityHash64(keys[i].data(), keys[i].size()) for i < n.
+WRUTIL_API void CityHash64Many(const string_view *keys, size_t n,
+                               uint64 *hashes);
+
 // Hash function for a byte array.
 WRUTIL_API uint128 CityHash128(const char *s, size_t len);
 
@@ -103,6 +115,19 @@ WRUTIL_API uint128 CityHash128(const char *s, size_t len);
 // hashed into the result.
 WRUTIL_API uint128 CityHash128WithSeed(const char *s, size_t len, uint128 seed);
 
+// Hash function for a byte array.  Gives the same results as CityHash128()
+// for inputs of up to 900 bytes, and is faster for longer inputs on CPUs
+// with the SSE4.2 CRC32 instruction (chosen at run time).
+WRUTIL_API uint128 CityHashCrc128(const char *s, size_t len);
+
+// Hash function for a byte array.  For convenience, a 128-bit seed is also
+// hashed into the result.
+WRUTIL_API uint128 CityHashCrc128WithSeed(const char *s, size_t len,
+                                          uint128 seed);
+
+// Hash function for a byte array.  Sets result[0] ... result[3].
+WRUTIL_API void CityHashCrc256(const char *s, size_t len, uint64 *result);
+
 // Hash function for a byte array.  Most useful in 32-bit binaries.
 WRUTIL_API uint32 CityHash32(const char *buf, size_t len);
 
@@ -119,6 +144,42 @@ inline uint64 Hash128to64(const uint128& x) {
   return b;
 }
 
+// Incremental 64-bit hash of a message presented in pieces, e.g. spread
+// over several buffers.  CityHash64() begins by hashing the end of its
+// input, so cannot be computed this way; this hash runs the same 64-byte
+// block loop over the message from the start, then mixes in the last 64
+// bytes and the total length.  For messages of up to 64 bytes finish()
+// returns exactly CityHash64() (or CityHash64WithSeed() if a seed was
+// given); for longer messages the result is a different, but equally
+// well mixed, function of the message.
+class WRUTIL_API CityHash64Stream {
+ public:
+  CityHash64Stream() { reset(); }
+  explicit CityHash64Stream(uint64 seed) { reset(seed); }
+
+  CityHash64Stream& update(const void *data, size_t len);
+  CityHash64Stream& update(const string_view& s) {
+    return update(s.data(), s.size());
+  }
+
+  uint64 finish() const;
+
+  CityHash64Stream& reset();
+  CityHash64Stream& reset(uint64 seed);
+
+ private:
+  void block(const char *s);
+
+  uint64 x_, y_, z_;
+  uint128 v_, w_;
+  uint64 seed_;
+  bool seeded_;
+  uint64 total_;
+  size_t buf_len_;
+  char buf_[64];   // Unprocessed input.
+  char prev_[64];  // Last block processed.
+};
+
 // invoke CityHash32() or CityHash64() depending on platform's word size
 WRUTIL_API size_t stdHash(const void *k, size_t len);
 
@@ -31,6 +31,7 @@
 #include <string>
 
 #include <wrutil/Config.h>
+#include <wrutil/filesystem.h>
 #include <wrutil/string_view.h>
 
 
@@ -58,17 +59,34 @@ public:
         static std::string toString(const Hash &h);
         static Hash toHash(const string_view &str);
 
-private:
-        static Hash &hash(Hash &h, uint32_t (&w)[64], size_t total_length);
-        static void computeBlock(Hash &h, uint32_t (&w)[64]);
+        // hashes[i] = hash of messages[i]; uses SIMD lanes where available
+        static void hashMany(const string_view *messages, Hash *hashes,
+                             size_t count);
 
-        static const uint32_t K_[64];
+private:
+        static Hash &hash(Hash &h, uint32_t (&w)[16], size_t total_length);
+        static void computeBlocks(Hash &h, const void *data, size_t blocks);
 
         Hash     H_;
-        uint32_t W_[64];
+        uint32_t W_[16];  // buffered partial block
         size_t   total_length_;
 };
 
+//--------------------------------------
+
+/*
+ * Hashes the contents of a file. On POSIX systems sha256_file() maps
+ * regular files into memory rather than copying them; if another process
+ * truncates the file while it is mapped, touching the lost pages raises
+ * SIGBUS, which by default kills the process. sha256_file_read() only
+ * ever read()s the file, so is the one to use for files that others may
+ * be changing.
+ */
+WRUTIL_API SHA256::Hash sha256_file(const path &p);
+WRUTIL_API SHA256::Hash sha256_file(const path &p, fs_error_code &ec);
+WRUTIL_API SHA256::Hash sha256_file_read(const path &p);
+WRUTIL_API SHA256::Hash sha256_file_read(const path &p, fs_error_code &ec);
+
 
 } // namespace wr
 
@@ -0,0 +1,78 @@
+/**
+ * \file TreeHasher.h
+ *
+ * \brief Parallel SHA-256 fingerprinting of directory trees
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_TREE_HASHER_H
+#define WRUTIL_TREE_HASHER_H
+
+#include <wrutil/Config.h>
+#include <wrutil/filesystem.h>
+#include <wrutil/SHA256.h>
+
+
+namespace wr {
+
+
+/*
+ * Computes a Merkle-tree fingerprint of a file or directory tree:
+ *
+ * - a regular file's hash is the SHA-256 hash of its contents
+ * - a symbolic link's hash is the SHA-256 hash of its target (links are
+ *   never followed)
+ * - a directory's hash is the SHA-256 hash of the sequence of records
+ *   `type name '\0' hash` for each of its entries, sorted by the bytes of
+ *   their UTF-8 names; type is one of 'f' (file), 'd' (directory),
+ *   'l' (symbolic link) or 'o' (anything else, recorded without a hash)
+ *
+ * Directories are listed and files hashed by a pool of worker threads.
+ * If a cache file is set, file hashes are saved to it keyed by (device,
+ * inode, size, modification time) and reused by later runs for files
+ * whose key is unchanged.
+ */
+class WRUTIL_API TreeHasher
+{
+public:
+        using Hash = SHA256::Hash;
+
+        // threads == 0 selects std::thread::hardware_concurrency()
+        explicit TreeHasher(unsigned threads = 0) : threads_(threads) {}
+
+        // an empty path disables the cache
+        TreeHasher &setCacheFile(const path &cache_file)
+                { cache_file_ = cache_file; return *this; }
+
+        const path &cacheFile() const { return cache_file_; }
+
+        Hash hash(const path &root);
+        Hash hash(const path &root, fs_error_code &ec);
+
+private:
+        unsigned threads_;
+        path     cache_file_;
+};
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_TREE_HASHER_H
@@ -0,0 +1,71 @@
+/**
+ * \file base64.h
+ *
+ * \brief Base64 encoding and decoding of binary data (RFC 4648)
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_BASE64_H
+#define WRUTIL_BASE64_H
+
+#include <stddef.h>
+#include <string>
+#include <wrutil/Config.h>
+#include <wrutil/string_view.h>
+
+
+namespace wr {
+
+
+// size of padded output
+constexpr size_t base64_encoded_size(size_t bytes)
+        { return ((bytes + 2) / 3) * 4; }
+
+// upper bound on decoded size
+constexpr size_t base64_decoded_size(size_t chars)
+        { return ((chars + 3) / 4) * 3; }
+
+/*
+ * Writes the base64 encoding (standard alphabet, '=' padded) of the `size`
+ * bytes at `src` to `dst`, which must have room for
+ * base64_encoded_size(size) chars (no terminating null is written);
+ * returns a pointer to the end of the output
+ */
+WRUTIL_API char *base64_encode(const void *src, size_t size, char *dst);
+
+WRUTIL_API std::string base64_encode(const void *src, size_t size);
+
+inline std::string base64_encode(const string_view &src)
+        { return base64_encode(src.data(), src.size()); }
+
+/*
+ * Decodes base64 text, with or without trailing padding, into `dst`,
+ * which must have room for base64_decoded_size(src.size()) bytes; on
+ * success sets `size` to the number of bytes written and returns true,
+ * otherwise (invalid characters or length) returns false
+ */
+WRUTIL_API bool base64_decode(const string_view &src, void *dst,
+                              size_t &size);
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_BASE64_H
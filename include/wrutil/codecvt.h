@@ -25,7 +25,10 @@
 #ifndef WRUTIL_CODECVT_H
 #define WRUTIL_CODECVT_H
 
+#include <algorithm>
 #include <locale>
+#include <memory>
+#include <stdexcept>
 #include <string>
 
 #include <wrutil/Config.h>
@@ -60,6 +63,13 @@ public:
 
         virtual ~codecvt_utf8_narrow();
 
+        /*
+         * Upper bounds on the size of the result of converting `n` bytes
+         * of narrow text to UTF-8 and `n` bytes of UTF-8 to narrow text
+         */
+        std::size_t max_utf8_size(std::size_t n) const;
+        std::size_t max_narrow_size(std::size_t n) const;
+
 protected:
         virtual result do_out(state_type &state, const intern_type *from,
                               const intern_type *from_end,
@@ -89,6 +99,27 @@ private:
         Body *body_;
 };
 
+//--------------------------------------
+/*
+ * The user's preferred locale, std::locale(""), and what is needed to
+ * convert between UTF-8 and its charset, determined on first use and
+ * shared by all threads.  Default-constructed codecvt_utf8_narrow facets
+ * use it rather than examining the locale again.
+ *
+ * Call refresh_native_charset() after changing the locale environment,
+ * e.g. with setenv("LC_ALL", ...); facets already constructed keep the
+ * charset they were constructed with.
+ */
+struct native_charset
+{
+        std::locale locale;
+        bool        utf8;              // no conversion is needed
+        bool        ascii_compatible;  // ASCII converts to itself
+};
+
+WRUTIL_API std::shared_ptr<const native_charset> get_native_charset();
+WRUTIL_API std::shared_ptr<const native_charset> refresh_native_charset();
+
 //--------------------------------------
 
 struct codecvt_wide_narrow :
@@ -100,6 +131,97 @@ struct codecvt_wide_narrow :
 
 //--------------------------------------
 
+#if WR_HAVE_ICONV
+
+/*
+ * Converts between UTF-8 and any charset known to iconv(3), whether or
+ * not a locale using it is installed.  As for codecvt_utf8_narrow, UTF-8
+ * is the internal encoding: in() converts from the charset to UTF-8 and
+ * out() from UTF-8 to the charset, replacing characters the charset
+ * cannot represent with '?'.
+ *
+ * iconv state is not carried from one call to the next, so only stateless
+ * charsets are accepted: those with shift states, such as ISO-2022-JP or
+ * UTF-7, or that begin their output with a byte order mark, such as
+ * UTF-16, must be converted whole using transcode().
+ */
+class WRUTIL_API codecvt_charset :
+        public std::codecvt<char, char, std::mbstate_t>
+{
+public:
+        using base_type = std::codecvt<char, char, std::mbstate_t>;
+
+        static std::locale::id id;
+
+        /* throws std::invalid_argument if iconv does not support `charset`
+           or it is stateful */
+        explicit codecvt_charset(const char *charset, std::size_t refs = 0);
+
+        virtual ~codecvt_charset();
+
+        const std::string &charset() const { return charset_; }
+
+protected:
+        virtual result do_out(state_type &state, const intern_type *from,
+                              const intern_type *from_end,
+                              const intern_type *&from_next, extern_type *to,
+                              extern_type *to_end, extern_type *&to_next) const;
+
+        virtual result do_in(state_type &state, const extern_type *from,
+                             const extern_type *from_end,
+                             const extern_type *&from_next, intern_type *to,
+                             intern_type *to_end, intern_type *&to_next) const;
+
+        virtual result do_unshift(state_type &state, extern_type *to,
+                                  extern_type *to_end,
+                                  extern_type *&to_next) const;
+
+        virtual int do_encoding() const noexcept;
+        virtual bool do_always_noconv() const noexcept;
+
+        virtual int do_length(state_type &state, const extern_type *from,
+                              const extern_type *from_end,
+                              std::size_t max) const;
+
+        virtual int do_max_length() const noexcept;
+
+private:
+        std::string charset_;
+        bool        noconv_;
+};
+
+/*
+ * Append the conversion of `in` from charset `from` to charset `to` to
+ * `out`, converting the whole of `in` in one pass.  iconv handles are
+ * opened once per thread for each pair of charsets and reused.
+ *
+ * Throws std::invalid_argument if the conversion is not supported, or
+ * std::range_error, leaving `out` unchanged, if `in` holds an invalid or
+ * incomplete sequence or a character that `to` cannot represent.
+ */
+WRUTIL_API std::string &transcode(const char *from, const char *to,
+                                  const string_view &in, std::string &out);
+
+inline std::string transcode(const char *from, const char *to,
+                             const string_view &in)
+        { std::string out; transcode(from, to, in, out); return out; }
+
+#endif // WR_HAVE_ICONV
+
+//--------------------------------------
+/*
+ * Converts between UTF-8 and the narrow encoding of a locale, as
+ * wstring_convert<codecvt_utf8_narrow, char> would, plus:
+ *
+ * - overloads that append to an existing string, so that a caller may
+ *   reuse one string's storage for many conversions;
+ *
+ * - overloads that write into a caller-provided buffer, sized using
+ *   max_utf8_size() or max_narrow_size(), and never allocate.
+ *
+ * Output is converted in place as it grows, rather than being converted
+ * again into a larger buffer.
+ */
 template <typename Alloc = std::allocator<char>>
 class u8string_convert
 {
@@ -109,11 +231,12 @@ public:
                 = std::basic_string<char, std::char_traits<char>, Alloc>;
 
         u8string_convert(codecvt_utf8_narrow *cvt = new codecvt_utf8_narrow) :
-                cnv_(cvt) {}
+                cvt_(cvt), count_(0) {}
 
         u8string_convert(const string_type &local_err,
                          const string_type &utf8_err = string_type()) :
-                cnv_(local_err, utf8_err) {}
+                cvt_(new codecvt_utf8_narrow), local_err_(local_err),
+                utf8_err_(utf8_err), count_(0) {}
 
         u8string_convert(const this_type &other) = delete;
 
@@ -121,22 +244,163 @@ public:
 
         this_type &operator=(const this_type &other) = delete;
 
-        string_type to_utf8(char c) { return cnv_.from_bytes(c); }
+        string_type to_utf8(char c) { return to_utf8(string_view(&c, 1)); }
         string_type to_utf8(const string_view &s)
-                { return cnv_.from_bytes(s.begin(), s.end()); }
+                { string_type out; to_utf8(s, out); return out; }
         string_type to_utf8(const char *first, const char *last)
-                { return cnv_.from_bytes(first, last); }
+                { return to_utf8(string_view(first, size_t(last - first))); }
 
         string_type from_utf8(const u8string_view &s)
-                { return cnv_.to_bytes(s.char_data(),
-                                       s.char_data() + s.bytes()); }
+                { string_type out; from_utf8(s, out); return out; }
         string_type from_utf8(const char *first, const char *last)
-                { return cnv_.to_bytes(first, last); }
-
-        size_t converted() const { return cnv_.converted(); }
+                { string_type out; append(false, first, last, out);
+                  return out; }
+
+        /*
+         * Append the conversion of `s` to `out`.  On invalid input `out`
+         * is left as it was, with the error string given on construction
+         * appended or, if that is empty, std::range_error is thrown.
+         */
+        string_type &to_utf8(const string_view &s, string_type &out)
+                { return append(true, s.data(), s.data() + s.size(), out); }
+
+        string_type &from_utf8(const u8string_view &s, string_type &out)
+                { return append(false, s.char_data(),
+                                s.char_data() + s.bytes(), out); }
+
+        /*
+         * Convert `s` into [to, to_end), returning the end of the output,
+         * or nullptr if `s` is invalid or the output does not fit
+         */
+        char *to_utf8(const string_view &s, char *to, char *to_end)
+                { return convertInto(true, s.data(), s.data() + s.size(),
+                                     to, to_end); }
+
+        char *from_utf8(const u8string_view &s, char *to, char *to_end)
+                { return convertInto(false, s.char_data(),
+                                     s.char_data() + s.bytes(), to, to_end); }
+
+        // buffer sizes sufficient for converting `n` bytes
+        size_t max_utf8_size(size_t n) const
+                { return cvt_->max_utf8_size(n); }
+        size_t max_narrow_size(size_t n) const
+                { return cvt_->max_narrow_size(n); }
+
+        size_t converted() const { return count_; }
 
 private:
-        wstring_convert<codecvt_utf8_narrow, char, Alloc, Alloc> cnv_;
+        using result = std::codecvt_base::result;
+
+        size_t maxSize(bool to_utf8, size_t n) const
+                { return to_utf8 ? max_utf8_size(n) : max_narrow_size(n); }
+
+        /*
+         * Converts as much of [from, from_end) as fits in [to, to_end),
+         * advancing `from` and `to`; returns partial only if the output
+         * is too small to hold the next character
+         */
+        result convert(bool to_utf8, std::mbstate_t &state,
+                       const char *&from, const char *from_end,
+                       char *&to, char *to_end) const
+        {
+                while (from != from_end) {
+                        const char *from_next;
+                        char       *to_next;
+                        result      res;
+
+                        res = to_utf8 ? cvt_->in(state, from, from_end,
+                                                 from_next, to, to_end,
+                                                 to_next)
+                                      : cvt_->out(state, from, from_end,
+                                                  from_next, to, to_end,
+                                                  to_next);
+                        if (res == std::codecvt_base::noconv) {
+                                size_t n = std::min(size_t(from_end - from),
+                                                    size_t(to_end - to));
+                                std::char_traits<char>::copy(to, from, n);
+                                from += n;
+                                to += n;
+                                return (from == from_end) ?
+                                        std::codecvt_base::ok :
+                                        std::codecvt_base::partial;
+                        }
+
+                        bool progress = (from_next != from) || (to_next != to);
+                        from = from_next;
+                        to = to_next;
+
+                        if (res == std::codecvt_base::error) {
+                                return res;
+                        } else if ((res == std::codecvt_base::partial)
+                                                        && !progress) {
+                                // incomplete input, unless short of space
+                                size_t need = maxSize(to_utf8,
+                                                      size_t(from_end - from));
+                                return (size_t(to_end - to) >= need) ?
+                                        std::codecvt_base::error :
+                                        std::codecvt_base::partial;
+                        }
+                }
+                return std::codecvt_base::ok;
+        }
+
+        string_type &append(bool to_utf8, const char *from,
+                            const char *from_end, string_type &out)
+        {
+                std::mbstate_t  state = std::mbstate_t();
+                const char     *first = from;
+                size_t          start = out.size();
+
+                // most text converts to about its own size
+                out.resize(start + size_t(from_end - from));
+
+                char   *to = &out[0] + start, *to_end = &out[0] + out.size();
+                result  res;
+
+                while ((res = convert(to_utf8, state, from, from_end, to,
+                                      to_end)) == std::codecvt_base::partial) {
+                        // continue from where conversion stopped, with
+                        // room enough for the rest of the input
+                        size_t used = size_t(to - &out[0]);
+                        out.resize(used + maxSize(to_utf8,
+                                                  size_t(from_end - from)));
+                        to = &out[0] + used;
+                        to_end = &out[0] + out.size();
+                }
+                count_ = size_t(from - first);
+
+                if (res == std::codecvt_base::ok) {
+                        out.resize(size_t(to - &out[0]));
+                        return out;
+                }
+
+                out.resize(start);
+
+                const string_type &err = to_utf8 ? utf8_err_ : local_err_;
+                if (err.empty()) {
+                        throw std::range_error(to_utf8 ?
+                                "wr::u8string_convert: to_utf8 error" :
+                                "wr::u8string_convert: from_utf8 error");
+                }
+                return out.append(err);
+        }
+
+        char *convertInto(bool to_utf8, const char *from,
+                          const char *from_end, char *to, char *to_end)
+        {
+                std::mbstate_t  state = std::mbstate_t();
+                const char     *first = from;
+
+                result res = convert(to_utf8, state, from, from_end, to,
+                                     to_end);
+                count_ = size_t(from - first);
+                return (res == std::codecvt_base::ok) ? to : nullptr;
+        }
+
+        std::unique_ptr<codecvt_utf8_narrow> cvt_;
+        string_type                          local_err_;
+        string_type                          utf8_err_;
+        size_t                               count_;
 };
 
 
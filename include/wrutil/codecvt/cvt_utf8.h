@@ -25,6 +25,9 @@ namespace wr {
 
 
 using codecvt_mode = std::codecvt_mode;
+using std::consume_header;
+using std::generate_header;
+using std::little_endian;
 
 template <typename Elem, unsigned long Maxcode = 0x10ffff,
           codecvt_mode Mode = static_cast<codecvt_mode>(0)>
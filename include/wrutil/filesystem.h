@@ -26,6 +26,7 @@
 #define WRUTIL_FILESYSTEM_H
 
 #include <wrutil/Config.h>
+#include <memory>
 #include <wrutil/string_view.h>
 #include <wrutil/u8string_view.h>
 
@@ -304,7 +305,23 @@ using fs_impl::system_complete;
 using fs_impl::temp_directory_path;
 
 
+/*
+ * These work on the native path strings without constructing paths for
+ * their elements. Paths are treated as a root name, a root directory and
+ * a sequence of filenames; repeated and trailing separators and "."
+ * filenames are ignored, so "a/./b/" has the prefix "a/b" and vice versa.
+ * An empty prefix matches any path.
+ *
+ * path_sort_key() returns a string that orders paths filename by
+ * filename when compared as a string, the order path_compare() also
+ * follows, and which begins with the key of each of the path's prefixes.
+ * This keeps a path together with everything beneath it in a sorted
+ * index: they are the keys from lower_bound(path_sort_key(dir)) onward
+ * that start with that key.
+ */
 WRUTIL_API bool path_has_prefix(const path &p, const path &prefix);
+WRUTIL_API int path_compare(const path &a, const path &b);
+WRUTIL_API path::string_type path_sort_key(const path &p);
 WRUTIL_API bool is_separator(path::value_type c);
 
 WRUTIL_API bool is_executable(const fs_impl::path &p);
@@ -335,6 +352,32 @@ WRUTIL_API path relative(const path &p, const path &base,
                          fs_error_code &ec);
 #endif
 
+/*
+ * Records what weakly_canonical() learns about each directory entry it
+ * looks up (a directory, a symbolic link and its target, some other file
+ * or nothing), so that canonicalizing many paths with common prefixes
+ * repeats none of those lookups. Entries are never invalidated, so
+ * clear() the cache after changing the directories it has seen. One
+ * cache may be shared by any number of threads.
+ */
+class WRUTIL_API canonical_cache
+{
+public:
+        canonical_cache();
+        canonical_cache(const canonical_cache &) = delete;
+        ~canonical_cache();
+
+        canonical_cache &operator=(const canonical_cache &) = delete;
+
+        void clear();
+
+private:
+        friend class CanonicalWalk;
+
+        struct Impl;
+        std::unique_ptr<Impl> impl_;
+};
+
 #if WR_HAVE_FSIMPL_WEAKLY_CANONICAL
 using fs_impl::weakly_canonical;
 #else
@@ -342,6 +385,16 @@ WRUTIL_API path weakly_canonical(const path &p);
 WRUTIL_API path weakly_canonical(const path &p, fs_error_code &ec);
 #endif
 
+/*
+ * On POSIX systems the path is resolved by walking it one filename at a
+ * time with openat() and readlinkat(), each filename being looked up only
+ * once (or not at all if `cache` already knows it); this is also how the
+ * overloads above work where the filesystem library lacks weakly_canonical()
+ */
+WRUTIL_API path weakly_canonical(const path &p, canonical_cache &cache);
+WRUTIL_API path weakly_canonical(const path &p, canonical_cache &cache,
+                                 fs_error_code &ec);
+
 #if WR_HAVE_FSIMPL_UNIQUE_PATH
 using fs_impl::unique_path;
 #else
@@ -349,28 +402,31 @@ WRUTIL_API path unique_path(const path &pattern = "%%%%-%%%%-%%%%-%%%%");
 WRUTIL_API path unique_path(const path &pattern, fs_error_code &ec);
 #endif
 
-#if WR_HAVE_FS_PATH_LEXICALLY_NORMAL
-inline path lexically_normal(const path &p)
-        { return p.lexically_normal(); }
-#else
+/*
+ * Creates and opens for reading and writing a new file named by filling in
+ * `pattern` as unique_path() does, trying fresh names while the name
+ * chosen already exists. The file is created exclusively (O_EXCL) with
+ * permissions 0600 and close-on-exec set, so the name cannot be raced by
+ * another process. Returns the file descriptor and sets `result` to the
+ * file's name, or returns -1 on error.
+ */
+WRUTIL_API int create_unique_file(const path &pattern, path &result);
+WRUTIL_API int create_unique_file(const path &pattern, path &result,
+                                  fs_error_code &ec);
+
+/*
+ * Lexical operations follow the C++17 rules whichever filesystem library
+ * is in use, working on the bytes of the native path string. The in-place
+ * lexically_normalize() and the u8string_view form of lexically_normal()
+ * allocate no memory; the latter writes its result to `buf`, which must
+ * have room for p.bytes() chars.
+ */
 WRUTIL_API path lexically_normal(const path &p);
-#endif
+WRUTIL_API path::string_type &lexically_normalize(path::string_type &s);
+WRUTIL_API u8string_view lexically_normal(const u8string_view &p, char *buf);
 
-#if WR_HAVE_FS_PATH_LEXICALLY_RELATIVE
-inline path lexically_relative(const path &p,
-                                        const path &base)
-        { return p.lexically_relative(base); }
-#else
 WRUTIL_API path lexically_relative(const path &p, const path &base);
-#endif
-
-#if WR_HAVE_FS_PATH_LEXICALLY_PROXIMATE
-inline path lexically_proximate(const path &p,
-                                         const path &base)
-        { return p.lexically_proximate(base); }
-#else
 WRUTIL_API path lexically_proximate(const path &p, const path &base);
-#endif
 
 #if WR_HAVE_FS_PATH_TO_U8STRING
 inline std::string to_u8string(const path &p) { return p.u8string(); }
@@ -0,0 +1,321 @@
+/**
+ * \file flat_hash_map.h
+ *
+ * \brief Open-addressing hash map
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ *
+ * wr::flat_hash_map has the interface of std::unordered_map less the
+ * bucket interface and node handles; as there, value_type is
+ * std::pair<const Key, T>.  Elements are stored inline in the
+ * table (see flat_hash_table.h), so unlike with std::unordered_map any
+ * insertion or erasure that rehashes the table invalidates all iterators,
+ * references and pointers to elements, and moving elements requires the
+ * key and mapped types to be move constructible.  Erasure never
+ * rehashes, so erasing while iterating is safe.
+ *
+ * Maps keyed by std::string, wr::string_view or wr::u8string_view hash
+ * with wr::CityHash and can be searched using any of those types or a
+ * `const char *` without converting the key.
+ */
+#ifndef WRUTIL_FLAT_HASH_MAP_H
+#define WRUTIL_FLAT_HASH_MAP_H
+
+#include <initializer_list>
+#include <stdexcept>
+#include <tuple>
+#include <wrutil/flat_hash_table.h>
+
+
+namespace wr {
+
+
+namespace flat_hash_detail {
+
+
+struct map_key
+{
+        template <typename Pair>
+        const typename Pair::first_type &operator()(const Pair &p) const
+                { return p.first; }
+
+        template <typename Pair>
+        using value_type = std::pair<const typename Pair::first_type,
+                                     typename Pair::second_type>;
+};
+
+
+} // namespace flat_hash_detail
+
+//--------------------------------------
+
+template <typename Key, typename T, typename Hash = flat_hash<Key>,
+          typename KeyEqual = flat_hash_equal<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, T>>>
+class flat_hash_map :
+        public flat_hash_detail::raw_table<std::pair<Key, T>, Key,
+                                           flat_hash_detail::map_key,
+                                           Hash, KeyEqual, Alloc>
+{
+        using base = flat_hash_detail::raw_table<std::pair<Key, T>, Key,
+                                                 flat_hash_detail::map_key,
+                                                 Hash, KeyEqual, Alloc>;
+
+        template <typename K>
+        using if_transparent = typename flat_hash_detail::transparent_key<
+                                                Hash, KeyEqual, K>::type;
+
+public:
+        using mapped_type = T;
+        using typename base::key_type;
+        using typename base::value_type;
+        using typename base::size_type;
+        using typename base::hasher;
+        using typename base::key_equal;
+        using typename base::allocator_type;
+        using typename base::iterator;
+        using typename base::const_iterator;
+
+        using base::base;
+
+        flat_hash_map() {}
+
+        template <typename InputIt>
+        flat_hash_map(InputIt first, InputIt last, size_type bucket_count = 0,
+                      const hasher &hash = hasher(),
+                      const key_equal &equal = key_equal(),
+                      const allocator_type &alloc = allocator_type()) :
+                base(bucket_count, hash, equal, alloc)
+                        { insert(first, last); }
+
+        flat_hash_map(std::initializer_list<value_type> init,
+                      size_type bucket_count = 0,
+                      const hasher &hash = hasher(),
+                      const key_equal &equal = key_equal(),
+                      const allocator_type &alloc = allocator_type()) :
+                base(bucket_count, hash, equal, alloc)
+                        { insert(init); }
+
+        flat_hash_map &operator=(std::initializer_list<value_type> init)
+                { this->clear(); insert(init); return *this; }
+
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(const key_type &key,
+                                              Args &&...args)
+                { return tryEmplace(key, std::forward<Args>(args)...); }
+
+        template <typename... Args>
+        std::pair<iterator, bool> try_emplace(key_type &&key, Args &&...args)
+                { return tryEmplace(std::move(key),
+                                    std::forward<Args>(args)...); }
+
+        /*
+         * Only constructs a key_type from `key` if it is not already
+         * present, e.g. a map keyed by std::string will only allocate a
+         * string for a new key
+         */
+        template <typename K, typename... Args,
+                  typename = if_transparent<typename std::decay<K>::type>,
+                  typename = typename std::enable_if<
+                          !std::is_convertible<K, const_iterator>::value>::type>
+        std::pair<iterator, bool> try_emplace(K &&key, Args &&...args)
+                { return tryEmplace(std::forward<K>(key),
+                                    std::forward<Args>(args)...); }
+
+        template <typename... Args>
+        iterator try_emplace(const_iterator, const key_type &key,
+                             Args &&...args)
+                { return try_emplace(key, std::forward<Args>(args)...).first; }
+
+        template <typename... Args>
+        iterator try_emplace(const_iterator, key_type &&key, Args &&...args)
+                { return try_emplace(std::move(key),
+                                     std::forward<Args>(args)...).first; }
+
+        template <typename M>
+        std::pair<iterator, bool> insert_or_assign(const key_type &key,
+                                                   M &&obj)
+        {
+                auto result = try_emplace(key, std::forward<M>(obj));
+                if (!result.second) {
+                        result.first->second = std::forward<M>(obj);
+                }
+                return result;
+        }
+
+        template <typename M>
+        std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj)
+        {
+                auto result = try_emplace(std::move(key), std::forward<M>(obj));
+                if (!result.second) {
+                        result.first->second = std::forward<M>(obj);
+                }
+                return result;
+        }
+
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args &&...args)
+        {
+                std::pair<Key, T> value(std::forward<Args>(args)...);
+                return tryEmplace(std::move(value.first),
+                                  std::move(value.second));
+        }
+
+        template <typename... Args>
+        iterator emplace_hint(const_iterator, Args &&...args)
+                { return emplace(std::forward<Args>(args)...).first; }
+
+        std::pair<iterator, bool> insert(const value_type &value)
+                { return tryEmplace(value.first, value.second); }
+
+        std::pair<iterator, bool> insert(value_type &&value)
+                { return tryEmplace(std::move(value.first),
+                                    std::move(value.second)); }
+
+        template <typename P, typename = typename std::enable_if<
+                        std::is_constructible<value_type, P &&>::value>::type>
+        std::pair<iterator, bool> insert(P &&value)
+                { return emplace(std::forward<P>(value)); }
+
+        iterator insert(const_iterator, const value_type &value)
+                { return insert(value).first; }
+
+        iterator insert(const_iterator, value_type &&value)
+                { return insert(std::move(value)).first; }
+
+        template <typename InputIt>
+        void insert(InputIt first, InputIt last)
+        {
+                for (; first != last; ++first) {
+                        emplace(*first);
+                }
+        }
+
+        void insert(std::initializer_list<value_type> init)
+                { insert(init.begin(), init.end()); }
+
+        T &operator[](const key_type &key)
+                { return try_emplace(key).first->second; }
+
+        T &operator[](key_type &&key)
+                { return try_emplace(std::move(key)).first->second; }
+
+        T &at(const key_type &key)
+                { return atImpl(key); }
+
+        const T &at(const key_type &key) const
+                { return const_cast<flat_hash_map *>(this)->atImpl(key); }
+
+        template <typename K, typename = if_transparent<K>>
+        T &at(const K &key)
+                { return atImpl(key); }
+
+        template <typename K, typename = if_transparent<K>>
+        const T &at(const K &key) const
+                { return const_cast<flat_hash_map *>(this)->atImpl(key); }
+
+        void swap(flat_hash_map &other) noexcept { base::swap(other); }
+
+private:
+        template <typename K, typename... Args>
+        std::pair<iterator, bool> tryEmplace(K &&key, Args &&...args)
+        {
+                auto slot = this->findOrPrepareInsert(key);
+
+                if (slot.second) {
+                        try {
+                                this->constructAt(slot.first,
+                                        std::piecewise_construct,
+                                        std::forward_as_tuple(
+                                                std::forward<K>(key)),
+                                        std::forward_as_tuple(
+                                                std::forward<Args>(args)...));
+                        } catch (...) {
+                                this->abandonInsert(slot.first);
+                                throw;
+                        }
+                }
+                return { this->iteratorAt(slot.first), slot.second };
+        }
+
+        template <typename K>
+        T &atImpl(const K &key)
+        {
+                auto i = this->find(key);
+                if (i == this->end()) {
+                        throw std::out_of_range("wr::flat_hash_map::at");
+                }
+                return i->second;
+        }
+};
+
+//--------------------------------------
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+          typename Alloc>
+inline void
+swap(
+        flat_hash_map<Key, T, Hash, KeyEqual, Alloc> &a,
+        flat_hash_map<Key, T, Hash, KeyEqual, Alloc> &b
+) noexcept
+{
+        a.swap(b);
+}
+
+//--------------------------------------
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+          typename Alloc>
+bool
+operator==(
+        const flat_hash_map<Key, T, Hash, KeyEqual, Alloc> &a,
+        const flat_hash_map<Key, T, Hash, KeyEqual, Alloc> &b
+)
+{
+        if (a.size() != b.size()) {
+                return false;
+        }
+        for (const auto &value: a) {
+                auto i = b.find(value.first);
+                if ((i == b.end()) || !(i->second == value.second)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+//--------------------------------------
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+          typename Alloc>
+inline bool
+operator!=(
+        const flat_hash_map<Key, T, Hash, KeyEqual, Alloc> &a,
+        const flat_hash_map<Key, T, Hash, KeyEqual, Alloc> &b
+)
+{
+        return !(a == b);
+}
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_FLAT_HASH_MAP_H
@@ -0,0 +1,213 @@
+/**
+ * \file flat_hash_set.h
+ *
+ * \brief Open-addressing hash set
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ *
+ * wr::flat_hash_set has the interface of std::unordered_set less the
+ * bucket interface and node handles; as with wr::flat_hash_map, any
+ * insertion that rehashes the table invalidates all iterators and
+ * references to elements.
+ */
+#ifndef WRUTIL_FLAT_HASH_SET_H
+#define WRUTIL_FLAT_HASH_SET_H
+
+#include <initializer_list>
+#include <wrutil/flat_hash_table.h>
+
+
+namespace wr {
+
+
+namespace flat_hash_detail {
+
+
+struct set_key
+{
+        template <typename Key>
+        const Key &operator()(const Key &key) const { return key; }
+
+        template <typename Key> using value_type = Key;
+};
+
+
+} // namespace flat_hash_detail
+
+//--------------------------------------
+
+template <typename Key, typename Hash = flat_hash<Key>,
+          typename KeyEqual = flat_hash_equal<Key>,
+          typename Alloc = std::allocator<Key>>
+class flat_hash_set :
+        public flat_hash_detail::raw_table<Key, Key, flat_hash_detail::set_key,
+                                           Hash, KeyEqual, Alloc>
+{
+        using base = flat_hash_detail::raw_table<Key, Key,
+                                                 flat_hash_detail::set_key,
+                                                 Hash, KeyEqual, Alloc>;
+
+public:
+        using typename base::key_type;
+        using typename base::value_type;
+        using typename base::size_type;
+        using typename base::hasher;
+        using typename base::key_equal;
+        using typename base::allocator_type;
+        using typename base::const_iterator;
+
+        // elements may not be modified in place
+        using iterator = const_iterator;
+
+        using base::base;
+
+        flat_hash_set() {}
+
+        template <typename InputIt>
+        flat_hash_set(InputIt first, InputIt last, size_type bucket_count = 0,
+                      const hasher &hash = hasher(),
+                      const key_equal &equal = key_equal(),
+                      const allocator_type &alloc = allocator_type()) :
+                base(bucket_count, hash, equal, alloc)
+                        { insert(first, last); }
+
+        flat_hash_set(std::initializer_list<value_type> init,
+                      size_type bucket_count = 0,
+                      const hasher &hash = hasher(),
+                      const key_equal &equal = key_equal(),
+                      const allocator_type &alloc = allocator_type()) :
+                base(bucket_count, hash, equal, alloc)
+                        { insert(init); }
+
+        flat_hash_set &operator=(std::initializer_list<value_type> init)
+                { this->clear(); insert(init); return *this; }
+
+        const_iterator begin() const { return base::begin(); }
+        const_iterator end() const { return base::end(); }
+
+        const_iterator find(const key_type &key) const
+                { return base::find(key); }
+
+        template <typename K, typename = typename flat_hash_detail
+                                ::transparent_key<Hash, KeyEqual, K>::type>
+        const_iterator find(const K &key) const
+                { return base::find(key); }
+
+        std::pair<iterator, bool> insert(const value_type &value)
+                { return insertImpl(value); }
+
+        std::pair<iterator, bool> insert(value_type &&value)
+                { return insertImpl(std::move(value)); }
+
+        iterator insert(const_iterator, const value_type &value)
+                { return insert(value).first; }
+
+        iterator insert(const_iterator, value_type &&value)
+                { return insert(std::move(value)).first; }
+
+        template <typename InputIt>
+        void insert(InputIt first, InputIt last)
+        {
+                for (; first != last; ++first) {
+                        emplace(*first);
+                }
+        }
+
+        void insert(std::initializer_list<value_type> init)
+                { insert(init.begin(), init.end()); }
+
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args &&...args)
+                { return insertImpl(value_type(std::forward<Args>(args)...)); }
+
+        template <typename... Args>
+        iterator emplace_hint(const_iterator, Args &&...args)
+                { return emplace(std::forward<Args>(args)...).first; }
+
+        void swap(flat_hash_set &other) noexcept { base::swap(other); }
+
+private:
+        template <typename V>
+        std::pair<iterator, bool> insertImpl(V &&value)
+        {
+                auto slot = this->findOrPrepareInsert(value);
+
+                if (slot.second) {
+                        try {
+                                this->constructAt(slot.first,
+                                                  std::forward<V>(value));
+                        } catch (...) {
+                                this->abandonInsert(slot.first);
+                                throw;
+                        }
+                }
+                return { this->iteratorAt(slot.first), slot.second };
+        }
+};
+
+//--------------------------------------
+
+template <typename Key, typename Hash, typename KeyEqual, typename Alloc>
+inline void
+swap(
+        flat_hash_set<Key, Hash, KeyEqual, Alloc> &a,
+        flat_hash_set<Key, Hash, KeyEqual, Alloc> &b
+) noexcept
+{
+        a.swap(b);
+}
+
+//--------------------------------------
+
+template <typename Key, typename Hash, typename KeyEqual, typename Alloc>
+bool
+operator==(
+        const flat_hash_set<Key, Hash, KeyEqual, Alloc> &a,
+        const flat_hash_set<Key, Hash, KeyEqual, Alloc> &b
+)
+{
+        if (a.size() != b.size()) {
+                return false;
+        }
+        for (const auto &key: a) {
+                if (b.find(key) == b.end()) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+//--------------------------------------
+
+template <typename Key, typename Hash, typename KeyEqual, typename Alloc>
+inline bool
+operator!=(
+        const flat_hash_set<Key, Hash, KeyEqual, Alloc> &a,
+        const flat_hash_set<Key, Hash, KeyEqual, Alloc> &b
+)
+{
+        return !(a == b);
+}
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_FLAT_HASH_SET_H
@@ -0,0 +1,852 @@
+/**
+ * \file flat_hash_table.h
+ *
+ * \brief Open-addressing hash table underlying wr::flat_hash_map and
+ *        wr::flat_hash_set
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ *
+ * The table follows the "Swiss table" design: elements live directly in
+ * an array of slots, alongside which is an array of one-byte control
+ * values.  A control byte is negative if its slot is empty or holds an
+ * erased element, otherwise it holds seven bits of the element's hash.
+ * Lookups compare a whole group of 16 control bytes against the hash
+ * bits at once (with SSE2 where available) and only examine the slots
+ * whose control byte matches, so few keys are ever compared.
+ *
+ * The capacity is always one less than a power of two.  The control
+ * array has one extra byte holding a sentinel, which stops iteration,
+ * followed by copies of the first 15 control bytes, so that a group can
+ * be loaded starting from any slot.
+ */
+#ifndef WRUTIL_FLAT_HASH_TABLE_H
+#define WRUTIL_FLAT_HASH_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <wrutil/Config.h>
+#ifdef __SSE2__
+#       include <emmintrin.h>
+#endif
+#include <wrutil/CityHash.h>
+#include <wrutil/string_view.h>
+#include <wrutil/u8string_view.h>
+
+
+namespace wr {
+
+
+/*
+ * Default hash function for flat hash tables; strings and string views
+ * all hash with wr::CityHash so that containers keyed by std::string can
+ * be searched with a string_view and vice versa
+ */
+template <typename Key> struct flat_hash : std::hash<Key> {};
+
+template <> struct flat_hash<std::string> : CityHash
+        { using is_transparent = void; };
+
+template <> struct flat_hash<string_view> : CityHash
+        { using is_transparent = void; };
+
+template <> struct flat_hash<u8string_view> : CityHash
+        { using is_transparent = void; };
+
+/*
+ * Default key comparison for flat hash tables; transparent for strings
+ */
+template <typename Key> struct flat_hash_equal : std::equal_to<Key> {};
+
+template <> struct flat_hash_equal<std::string>
+{
+        using is_transparent = void;
+
+        bool operator()(string_view a, string_view b) const { return a == b; }
+};
+
+template <> struct flat_hash_equal<string_view>
+        : flat_hash_equal<std::string> {};
+
+template <> struct flat_hash_equal<u8string_view>
+{
+        using is_transparent = void;
+
+        bool operator()(const u8string_view &a, const u8string_view &b) const
+                { return a == b; }
+};
+
+//--------------------------------------
+
+namespace flat_hash_detail {
+
+
+using ctrl_t = int8_t;
+
+enum : ctrl_t
+{
+        EMPTY    = -128,
+        DELETED  = -2,
+        SENTINEL = -1
+};
+
+enum : size_t
+{
+        GROUP_WIDTH  = 16,
+        CLONED_BYTES = GROUP_WIDTH - 1,
+        MIN_CAPACITY = GROUP_WIDTH - 1
+};
+
+inline unsigned
+trailingZeros(
+        uint32_t mask  // != 0
+)
+{
+#if defined(__GNUC__)
+        return unsigned(__builtin_ctz(mask));
+#else
+        unsigned n = 0;
+        for (; !(mask & 1); mask >>= 1) {
+                ++n;
+        }
+        return n;
+#endif
+}
+
+// control bytes for tables with no storage allocated
+inline const ctrl_t *
+emptyGroup()
+{
+        alignas(16) static const ctrl_t group[GROUP_WIDTH] = {
+                SENTINEL, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+                EMPTY,    EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
+        };
+        return group;
+}
+
+// maximum number of elements for a given capacity (7/8 load factor)
+inline size_t capacityToGrowth(size_t capacity)
+        { return capacity - capacity / 8; }
+
+// smallest valid capacity able to hold `size` elements
+inline size_t
+growthToCapacity(
+        size_t size
+)
+{
+        size_t capacity = MIN_CAPACITY;
+        while (capacityToGrowth(capacity) < size) {
+                capacity = capacity * 2 + 1;
+        }
+        return capacity;
+}
+
+//--------------------------------------
+/*
+ * Match results are bit masks with bit i set if control byte i of the
+ * group matches
+ */
+class Group
+{
+public:
+#ifdef __SSE2__
+        explicit Group(const ctrl_t *pos) :
+                ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos)))
+                {}
+
+        uint32_t match(ctrl_t h2) const
+                { return uint32_t(_mm_movemask_epi8(
+                                _mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(h2)))); }
+
+        uint32_t matchEmpty() const
+                { return match(EMPTY); }
+
+        uint32_t matchEmptyOrDeleted() const
+                { return uint32_t(_mm_movemask_epi8(
+                                _mm_cmpgt_epi8(_mm_set1_epi8(SENTINEL),
+                                               ctrl_))); }
+
+private:
+        __m128i ctrl_;
+#else
+        explicit Group(const ctrl_t *pos) { memcpy(ctrl_, pos, sizeof(ctrl_)); }
+
+        uint32_t match(ctrl_t h2) const
+        {
+                uint32_t mask = 0;
+                for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+                        mask |= uint32_t(ctrl_[i] == h2) << i;
+                }
+                return mask;
+        }
+
+        uint32_t matchEmpty() const
+                { return match(EMPTY); }
+
+        uint32_t matchEmptyOrDeleted() const
+        {
+                uint32_t mask = 0;
+                for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+                        mask |= uint32_t(ctrl_[i] < SENTINEL) << i;
+                }
+                return mask;
+        }
+
+private:
+        ctrl_t ctrl_[GROUP_WIDTH];
+#endif
+};
+
+//--------------------------------------
+
+template <typename Value, bool Const>
+class table_iterator
+{
+public:
+        using value_type = Value;
+        using pointer = typename std::conditional<Const, const Value *,
+                                                  Value *>::type;
+        using reference = typename std::conditional<Const, const Value &,
+                                                    Value &>::type;
+        using difference_type = ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        table_iterator() : ctrl_(nullptr), slot_(nullptr) {}
+
+        // support copying non-const-type iterators to const-type iterators
+        template <bool OtherConst,
+                  typename = typename std::enable_if<Const
+                                                     && !OtherConst>::type>
+        table_iterator(const table_iterator<Value, OtherConst> &other) :
+                ctrl_(other.ctrl_), slot_(other.slot_) {}
+
+        reference operator*() const { return *slot_; }
+        pointer operator->() const { return slot_; }
+
+        table_iterator &operator++()
+                { ++ctrl_; ++slot_; skipEmpty(); return *this; }
+
+        table_iterator operator++(int)
+                { auto prev = *this; ++(*this); return prev; }
+
+        template <bool OtherConst>
+        bool operator==(const table_iterator<Value, OtherConst> &other) const
+                { return ctrl_ == other.ctrl_; }
+
+        template <bool OtherConst>
+        bool operator!=(const table_iterator<Value, OtherConst> &other) const
+                { return ctrl_ != other.ctrl_; }
+
+private:
+        template <typename, typename, typename, typename, typename, typename>
+                friend class raw_table;
+        template <typename, bool> friend class table_iterator;
+
+        table_iterator(const ctrl_t *ctrl, pointer slot) :
+                ctrl_(ctrl), slot_(slot) {}
+
+        void skipEmpty()
+        {
+                while (*ctrl_ < SENTINEL) {
+                        ++ctrl_;
+                        ++slot_;
+                }
+        }
+
+        const ctrl_t *ctrl_;
+        pointer       slot_;
+};
+
+//--------------------------------------
+/*
+ * Defines `type` (as K) only if both the hash function and key comparison
+ * accept keys of any type, enabling lookup without constructing a key_type
+ */
+template <typename...> struct make_void { using type = void; };
+
+template <typename Hash, typename KeyEqual, typename K, typename = void>
+struct transparent_key {};
+
+template <typename Hash, typename KeyEqual, typename K>
+struct transparent_key<Hash, KeyEqual, K,
+                       typename make_void<typename Hash::is_transparent,
+                                          typename KeyEqual::is_transparent>
+                                ::type>
+{
+        using type = K;
+};
+
+//--------------------------------------
+/*
+ * `KeyOf` maps a stored value to its key, and its member template
+ * `value_type<Value>` names the type through which users see a stored
+ * value, which must have the same layout (a map stores std::pair<Key, T>
+ * so that elements can be moved when the table is resized, but exposes
+ * std::pair<const Key, T> so that keys cannot be changed in place)
+ */
+template <typename Value, typename Key, typename KeyOf, typename Hash,
+          typename KeyEqual, typename Alloc>
+class raw_table
+{
+        using slot_storage = typename std::aligned_storage<
+                                        sizeof(Value), alignof(Value)>::type;
+        using storage_alloc = typename std::allocator_traits<Alloc>
+                                        ::template rebind_alloc<slot_storage>;
+        using storage_traits = std::allocator_traits<storage_alloc>;
+
+        template <typename K>
+        using if_transparent = typename transparent_key<Hash, KeyEqual,
+                                                        K>::type;
+
+public:
+        using key_type = Key;
+        using value_type = typename KeyOf::template value_type<Value>;
+        using size_type = size_t;
+        using difference_type = ptrdiff_t;
+        using hasher = Hash;
+        using key_equal = KeyEqual;
+        using allocator_type = Alloc;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using iterator = table_iterator<value_type, false>;
+        using const_iterator = table_iterator<value_type, true>;
+
+        static_assert(sizeof(value_type) == sizeof(Value)
+                        && alignof(value_type) == alignof(Value),
+                      "stored and exposed value types must have one layout");
+
+        raw_table() : raw_table(0) {}
+
+        explicit raw_table(size_type bucket_count, const hasher &hash = hasher(),
+                           const key_equal &equal = key_equal(),
+                           const allocator_type &alloc = allocator_type()) :
+                ctrl_(const_cast<ctrl_t *>(emptyGroup())), slots_(nullptr),
+                size_(0), capacity_(0), growth_left_(0),
+                hash_(hash), equal_(equal), alloc_(alloc)
+        {
+                if (bucket_count) {
+                        resize(growthToCapacity(bucket_count));
+                }
+        }
+
+        raw_table(const raw_table &other) :
+                raw_table(0, other.hash_, other.equal_,
+                          storage_traits::select_on_container_copy_construction(
+                                        other.alloc_))
+        {
+                reserve(other.size_);
+                for (const auto &value: other) {
+                        emplaceNew(hashOf(KeyOf()(value)), value);
+                }
+        }
+
+        raw_table(raw_table &&other) noexcept :
+                ctrl_(other.ctrl_), slots_(other.slots_), size_(other.size_),
+                capacity_(other.capacity_), growth_left_(other.growth_left_),
+                hash_(std::move(other.hash_)),
+                equal_(std::move(other.equal_)),
+                alloc_(std::move(other.alloc_))
+        {
+                other.resetStorage();
+        }
+
+        ~raw_table() { destroyAll(); deallocate(); }
+
+        raw_table &operator=(const raw_table &other)
+        {
+                if (this != &other) {
+                        raw_table copy(other);
+                        swap(copy);
+                }
+                return *this;
+        }
+
+        raw_table &operator=(raw_table &&other) noexcept
+        {
+                if (this != &other) {
+                        destroyAll();
+                        deallocate();
+                        ctrl_ = other.ctrl_;
+                        slots_ = other.slots_;
+                        size_ = other.size_;
+                        capacity_ = other.capacity_;
+                        growth_left_ = other.growth_left_;
+                        hash_ = std::move(other.hash_);
+                        equal_ = std::move(other.equal_);
+                        alloc_ = std::move(other.alloc_);
+                        other.resetStorage();
+                }
+                return *this;
+        }
+
+        iterator begin()
+                { iterator i(ctrl_, exposed(slots_)); i.skipEmpty();
+                  return i; }
+
+        const_iterator begin() const
+                { return const_cast<raw_table *>(this)->begin(); }
+
+        const_iterator cbegin() const { return begin(); }
+
+        iterator end() { return iterator(ctrl_ + capacity_,
+                                         exposed(slots_ + capacity_)); }
+
+        const_iterator end() const
+                { return const_cast<raw_table *>(this)->end(); }
+
+        const_iterator cend() const { return end(); }
+
+        bool empty() const { return size_ == 0; }
+        size_type size() const { return size_; }
+        size_type max_size() const
+                { return std::numeric_limits<size_type>::max()
+                         / sizeof(Value) / 2; }
+
+        size_type bucket_count() const { return capacity_; }
+
+        float load_factor() const
+                { return capacity_ ? float(size_) / float(capacity_) : 0.0f; }
+
+        float max_load_factor() const { return 0.875f; }
+        void max_load_factor(float) {}  // fixed
+
+        hasher hash_function() const { return hash_; }
+        key_equal key_eq() const { return equal_; }
+        allocator_type get_allocator() const { return alloc_; }
+
+        void clear() noexcept
+        {
+                destroyAll();
+                if (capacity_) {
+                        memset(ctrl_, EMPTY, capacity_ + 1 + CLONED_BYTES);
+                        ctrl_[capacity_] = SENTINEL;
+                        growth_left_ = capacityToGrowth(capacity_);
+                }
+                size_ = 0;
+        }
+
+        void reserve(size_type count)
+        {
+                if (count > size_ + growth_left_) {
+                        resize(growthToCapacity(count));
+                }
+        }
+
+        void rehash(size_type count)
+        {
+                if (!count && !size_) {
+                        deallocate();
+                        resetStorage();
+                } else {
+                        resize(growthToCapacity(std::max(count, size_)));
+                }
+        }
+
+        void swap(raw_table &other) noexcept
+        {
+                using std::swap;
+                swap(ctrl_, other.ctrl_);
+                swap(slots_, other.slots_);
+                swap(size_, other.size_);
+                swap(capacity_, other.capacity_);
+                swap(growth_left_, other.growth_left_);
+                swap(hash_, other.hash_);
+                swap(equal_, other.equal_);
+                swap(alloc_, other.alloc_);
+        }
+
+        iterator find(const key_type &key)
+                { return findImpl(key); }
+
+        const_iterator find(const key_type &key) const
+                { return const_cast<raw_table *>(this)->findImpl(key); }
+
+        template <typename K, typename = if_transparent<K>>
+        iterator find(const K &key)
+                { return findImpl(key); }
+
+        template <typename K, typename = if_transparent<K>>
+        const_iterator find(const K &key) const
+                { return const_cast<raw_table *>(this)->findImpl(key); }
+
+        size_type count(const key_type &key) const
+                { return find(key) != end(); }
+
+        template <typename K, typename = if_transparent<K>>
+        size_type count(const K &key) const
+                { return find(key) != end(); }
+
+        bool contains(const key_type &key) const
+                { return find(key) != end(); }
+
+        template <typename K, typename = if_transparent<K>>
+        bool contains(const K &key) const
+                { return find(key) != end(); }
+
+        iterator erase(const_iterator pos)
+        {
+                size_t i = slotIndex(pos);
+                eraseAt(i);
+                iterator next(ctrl_ + i, exposed(slots_ + i));
+                next.skipEmpty();
+                return next;
+        }
+
+        iterator erase(iterator pos)
+                { return erase(const_iterator(pos)); }
+
+        iterator erase(const_iterator first, const_iterator last)
+        {
+                while (first != last) {
+                        first = erase(first);
+                }
+                return iterator(const_cast<ctrl_t *>(last.ctrl_),
+                                const_cast<value_type *>(last.slot_));
+        }
+
+        size_type erase(const key_type &key)
+                { return eraseKey(key); }
+
+        template <typename K, typename = if_transparent<K>>
+        size_type erase(const K &key)
+                { return eraseKey(key); }
+
+protected:
+        /*
+         * Returns the slot holding `key` and false, or an empty slot in
+         * which an element with that key must be constructed (by a call
+         * to constructAt()) and true
+         */
+        template <typename K>
+        std::pair<size_t, bool>
+        findOrPrepareInsert(
+                const K &key
+        )
+        {
+                size_t hash = hashOf(key);
+                size_t mask = capacity_, pos = h1(hash) & mask, step = 0;
+                ctrl_t h2 = this->h2(hash);
+
+                for (;;) {
+                        Group group(ctrl_ + pos);
+
+                        for (uint32_t m = group.match(h2); m; m &= m - 1) {
+                                size_t i = (pos + trailingZeros(m)) & mask;
+                                if (equal_(KeyOf()(slots_[i]), key)) {
+                                        return { i, false };
+                                }
+                        }
+                        if (group.matchEmpty()) {
+                                break;
+                        }
+                        step += GROUP_WIDTH;
+                        pos = (pos + step) & mask;
+                }
+
+                return { prepareInsert(hash), true };
+        }
+
+        template <typename... Args>
+        Value *constructAt(size_t i, Args &&...args)
+        {
+                return ::new (static_cast<void *>(slots_ + i))
+                                        Value(std::forward<Args>(args)...);
+        }
+
+        /*
+         * Aborts an insertion prepared by findOrPrepareInsert(); the slot
+         * is marked deleted as it may have been so before, in which case
+         * marking it empty could cut short other keys' probe sequences
+         */
+        void abandonInsert(size_t i)
+        {
+                setCtrl(i, DELETED);
+                --size_;
+        }
+
+        iterator iteratorAt(size_t i)
+                { return iterator(ctrl_ + i, exposed(slots_ + i)); }
+
+        /*
+         * Inserts a value known not to be present
+         */
+        template <typename... Args>
+        iterator emplaceNew(size_t hash, Args &&...args)
+        {
+                size_t i = prepareInsert(hash);
+                try {
+                        constructAt(i, std::forward<Args>(args)...);
+                } catch (...) {
+                        abandonInsert(i);
+                        throw;
+                }
+                return iteratorAt(i);
+        }
+
+        template <typename K>
+        size_t hashOf(const K &key) const
+        {
+                // spread the bits of weak hashes (such as the identity
+                // hash commonly used for integers) across the whole word
+                uint64_t mixed = uint64_t(hash_(key)) * 0x9e3779b97f4a7c15ull;
+                return size_t(mixed ^ (mixed >> 32));
+        }
+
+private:
+        static value_type *exposed(Value *slot)
+                { return reinterpret_cast<value_type *>(slot); }
+
+        size_t slotIndex(const_iterator i) const
+                { return size_t(reinterpret_cast<const Value *>(i.slot_)
+                                - slots_); }
+
+        static size_t h1(size_t hash) { return hash >> 7; }
+        static ctrl_t h2(size_t hash) { return ctrl_t(hash & 0x7f); }
+
+        template <typename K>
+        iterator findImpl(const K &key)
+        {
+                size_t hash = hashOf(key);
+                size_t mask = capacity_, pos = h1(hash) & mask, step = 0;
+                ctrl_t h2 = this->h2(hash);
+
+                for (;;) {
+                        Group group(ctrl_ + pos);
+
+                        for (uint32_t m = group.match(h2); m; m &= m - 1) {
+                                size_t i = (pos + trailingZeros(m)) & mask;
+                                if (equal_(KeyOf()(slots_[i]), key)) {
+                                        return iteratorAt(i);
+                                }
+                        }
+                        if (group.matchEmpty()) {
+                                return end();
+                        }
+                        step += GROUP_WIDTH;
+                        pos = (pos + step) & mask;
+                }
+        }
+
+        template <typename K>
+        size_type eraseKey(const K &key)
+        {
+                auto i = findImpl(key);
+                if (i == end()) {
+                        return 0;
+                }
+                eraseAt(slotIndex(i));
+                return 1;
+        }
+
+        void eraseAt(size_t i)
+        {
+                slots_[i].~Value();
+                --size_;
+
+                // a slot can be marked empty rather than deleted if no
+                // probe sequence can ever have passed over it, i.e. if
+                // the run of full slots around it is shorter than a group
+                size_t   before = (i - GROUP_WIDTH) & capacity_;
+                uint32_t empty_after = Group(ctrl_ + i).matchEmpty(),
+                         empty_before = Group(ctrl_ + before).matchEmpty();
+
+                if (empty_before && empty_after
+                                 && (trailingZeros(empty_after)
+                                     + leadingZeros16(empty_before)
+                                     < GROUP_WIDTH)) {
+                        setCtrl(i, EMPTY);
+                        ++growth_left_;
+                } else {
+                        setCtrl(i, DELETED);
+                }
+        }
+
+        static unsigned leadingZeros16(uint32_t mask)  // mask != 0
+        {
+                unsigned n = 0;
+                for (uint32_t bit = 0x8000; !(mask & bit); bit >>= 1) {
+                        ++n;
+                }
+                return n;
+        }
+
+        // first empty or deleted slot in the probe sequence for `hash`
+        size_t findFirstNonFull(size_t hash) const
+        {
+                size_t mask = capacity_, pos = h1(hash) & mask, step = 0;
+
+                for (;;) {
+                        uint32_t m = Group(ctrl_ + pos).matchEmptyOrDeleted();
+                        if (m) {
+                                return (pos + trailingZeros(m)) & mask;
+                        }
+                        step += GROUP_WIDTH;
+                        pos = (pos + step) & mask;
+                }
+        }
+
+        size_t prepareInsert(size_t hash)
+        {
+                size_t i = findFirstNonFull(hash);
+
+                if (!growth_left_ && (ctrl_[i] != DELETED)) {
+                        // grow, or just clear out deleted slots if at
+                        // most half full
+                        resize((size_ * 2 + 1 > capacityToGrowth(capacity_))
+                               ? std::max<size_t>(capacity_ * 2 + 1,
+                                                  MIN_CAPACITY)
+                               : capacity_);
+                        i = findFirstNonFull(hash);
+                }
+
+                growth_left_ -= (ctrl_[i] == EMPTY);
+                setCtrl(i, h2(hash));
+                ++size_;
+                return i;
+        }
+
+        void setCtrl(size_t i, ctrl_t h)
+        {
+                ctrl_[i] = h;
+                ctrl_[((i - CLONED_BYTES) & capacity_) + CLONED_BYTES] = h;
+        }
+
+        static size_t storageUnits(size_t capacity)
+        {
+                size_t ctrl_bytes = capacity + 1 + CLONED_BYTES;
+                return capacity + (ctrl_bytes + sizeof(slot_storage) - 1)
+                                  / sizeof(slot_storage);
+        }
+
+        /*
+         * Moves all elements into new storage of `new_capacity` slots,
+         * which also drops any deleted slots; elements are copied instead
+         * if their move constructor may throw and they are copyable, so
+         * that if an exception is thrown other than by the hasher the
+         * table is left unchanged (as with std::vector)
+         */
+        void resize(size_t new_capacity)
+        {
+                ctrl_t *old_ctrl = ctrl_;
+                Value  *old_slots = slots_;
+                size_t  old_capacity = capacity_,
+                        old_growth_left = growth_left_;
+
+                auto storage = storage_traits::allocate(
+                                        alloc_, storageUnits(new_capacity));
+
+                slots_ = reinterpret_cast<Value *>(storage);
+                ctrl_ = reinterpret_cast<ctrl_t *>(storage + new_capacity);
+                capacity_ = new_capacity;
+                memset(ctrl_, EMPTY, new_capacity + 1 + CLONED_BYTES);
+                ctrl_[new_capacity] = SENTINEL;
+                growth_left_ = capacityToGrowth(new_capacity) - size_;
+
+                try {
+                        for (size_t i = 0; i < old_capacity; ++i) {
+                                if (old_ctrl[i] >= 0) {
+                                        size_t hash = hashOf(
+                                                    KeyOf()(old_slots[i])),
+                                               j = findFirstNonFull(hash);
+                                        constructAt(j, std::move_if_noexcept(
+                                                                old_slots[i]));
+                                        setCtrl(j, h2(hash));
+                                }
+                        }
+                } catch (...) {
+                        destroyAll();
+                        deallocate();
+                        ctrl_ = old_ctrl;
+                        slots_ = old_slots;
+                        capacity_ = old_capacity;
+                        growth_left_ = old_growth_left;
+                        throw;
+                }
+
+                if (!std::is_trivially_destructible<Value>::value) {
+                        for (size_t i = 0; i < old_capacity; ++i) {
+                                if (old_ctrl[i] >= 0) {
+                                        old_slots[i].~Value();
+                                }
+                        }
+                }
+                if (old_capacity) {
+                        storage_traits::deallocate(
+                                alloc_,
+                                reinterpret_cast<slot_storage *>(old_slots),
+                                storageUnits(old_capacity));
+                }
+        }
+
+        void destroyAll()
+        {
+                if (!std::is_trivially_destructible<Value>::value) {
+                        for (size_t i = 0; i < capacity_; ++i) {
+                                if (ctrl_[i] >= 0) {
+                                        slots_[i].~Value();
+                                }
+                        }
+                }
+        }
+
+        void deallocate()
+        {
+                if (capacity_) {
+                        storage_traits::deallocate(
+                                alloc_,
+                                reinterpret_cast<slot_storage *>(slots_),
+                                storageUnits(capacity_));
+                }
+        }
+
+        void resetStorage()
+        {
+                ctrl_ = const_cast<ctrl_t *>(emptyGroup());
+                slots_ = nullptr;
+                size_ = capacity_ = growth_left_ = 0;
+        }
+
+        ctrl_t        *ctrl_;
+        Value         *slots_;
+        size_t         size_;
+        size_t         capacity_;
+        size_t         growth_left_;
+        hasher         hash_;
+        key_equal      equal_;
+        storage_alloc  alloc_;
+};
+
+
+} // namespace flat_hash_detail
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_FLAT_HASH_TABLE_H
@@ -0,0 +1,66 @@
+/**
+ * \file hex.h
+ *
+ * \brief Hexadecimal encoding and decoding of binary data
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_HEX_H
+#define WRUTIL_HEX_H
+
+#include <stddef.h>
+#include <string>
+#include <wrutil/Config.h>
+#include <wrutil/string_view.h>
+
+
+namespace wr {
+
+
+constexpr size_t hex_encoded_size(size_t bytes) { return bytes * 2; }
+constexpr size_t hex_decoded_size(size_t digits) { return digits / 2; }
+
+/*
+ * Writes the two hex digits for each of the `size` bytes at `src` to
+ * `dst`, which must have room for hex_encoded_size(size) chars (no
+ * terminating null is written); returns a pointer to the end of the output
+ */
+WRUTIL_API char *hex_encode(const void *src, size_t size, char *dst,
+                            bool upper_case = false);
+
+WRUTIL_API std::string hex_encode(const void *src, size_t size,
+                                  bool upper_case = false);
+
+inline std::string hex_encode(const string_view &src, bool upper_case = false)
+        { return hex_encode(src.data(), src.size(), upper_case); }
+
+/*
+ * Decodes the hex digits (of either case) in `src` into `dst`, which must
+ * have room for hex_decoded_size(src.size()) bytes; returns false without
+ * defining the contents of `dst` if `src` is of odd length or contains
+ * anything other than hex digits
+ */
+WRUTIL_API bool hex_decode(const string_view &src, void *dst);
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_HEX_H
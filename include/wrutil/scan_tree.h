@@ -0,0 +1,91 @@
+/**
+ * \file scan_tree.h
+ *
+ * \brief Parallel scanning of directory trees
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_SCAN_TREE_H
+#define WRUTIL_SCAN_TREE_H
+
+#include <stdint.h>
+#include <functional>
+#include <wrutil/Config.h>
+#include <wrutil/filesystem.h>
+#include <wrutil/u8string_view.h>
+
+
+namespace wr {
+
+
+/*
+ * Describes one directory entry to a scan_tree() callback; `dir` and
+ * `name` refer to buffers that are reused once the callback returns
+ */
+struct scan_entry
+{
+        u8string_view dir;    // path of the containing directory
+        u8string_view name;
+        file_type     type;   // of the entry itself; links are not followed
+        unsigned      depth;  // 1 for entries of the root directory
+
+        // set only if scan_options::want_stat is true
+        uint64_t      dev, ino, size;
+        int64_t       mtime_ns;
+        uint32_t      mode;
+};
+
+struct scan_options
+{
+        unsigned threads = 0;  // 0 selects std::thread::hardware_concurrency()
+        bool     want_stat = false;
+};
+
+/*
+ * Returning false for a directory stops scan_tree() descending into it;
+ * the return value is ignored for other entries
+ */
+using scan_callback = std::function<bool (const scan_entry &entry)>;
+
+/*
+ * Calls `callback` for every entry below the directory `root` (but not
+ * for `root` itself), never following symbolic links. Directories are
+ * read by a pool of worker threads, each taking directories from its own
+ * queue and taking the oldest from another's queue when its own is empty,
+ * so `callback` must be safe to call from several threads at once. The
+ * entries of each directory are reported by a single thread in the order
+ * they are read.
+ *
+ * An entry's type comes from the directory itself where the system
+ * provides it (as Linux and the BSDs do); entries are only stat'ed when
+ * want_stat is set or the type is not otherwise known. The first error
+ * encountered ends the scan, as does an exception thrown by `callback`,
+ * which is rethrown unchanged by either overload.
+ */
+WRUTIL_API void scan_tree(const path &root, const scan_options &options,
+                          const scan_callback &callback);
+WRUTIL_API void scan_tree(const path &root, const scan_options &options,
+                          const scan_callback &callback, fs_error_code &ec);
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_SCAN_TREE_H
@@ -0,0 +1,213 @@
+/**
+ * \file string_pool.h
+ *
+ * \brief String interning pools
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_STRING_POOL_H
+#define WRUTIL_STRING_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <wrutil/Config.h>
+#include <wrutil/CityHash.h>
+#include <wrutil/flat_hash_set.h>
+#include <wrutil/string_view.h>
+#include <wrutil/u8string_view.h>
+
+
+namespace wr {
+
+
+/*
+ * Stores a single copy of each distinct string given to it.  intern()
+ * returns a view of the pool's copy of a string, which remains valid
+ * until the pool is cleared or destroyed, so two interned strings are
+ * equal if and only if their data() pointers are equal.  Each distinct
+ * string is also numbered in order of interning, starting from 0, giving
+ * a compact 32-bit alternative to a view.
+ *
+ * Copies are packed into large blocks and null-terminated, so data() of
+ * an interned string can be passed to functions expecting a C string.
+ *
+ * string_pool is not thread-safe; see concurrent_string_pool.
+ */
+class WRUTIL_API string_pool
+{
+public:
+        using id_type = uint32_t;
+
+        static constexpr id_type npos = ~id_type(0);
+
+        string_pool();
+        string_pool(string_pool &&other);
+        string_pool &operator=(string_pool &&other);
+        ~string_pool();
+
+        string_view intern(const string_view &s)
+                { return insert(s, stdHash(s.data(), s.size())).first; }
+
+        string_view intern(const char *s)
+                { return intern(string_view(s)); }
+
+        string_view intern(const std::string &s)
+                { return intern(string_view(s)); }
+
+        u8string_view intern(const u8string_view &s);
+
+        // interns `s` if necessary and returns its ID
+        id_type id(const string_view &s)
+                { return insert(s, stdHash(s.data(), s.size())).second; }
+
+        /*
+         * Return the interned copy of `s`, or a null view if `s` is not
+         * in the pool; the pool is not modified
+         */
+        string_view find(const string_view &s) const;
+
+        // returns npos if `s` is not in the pool
+        id_type find_id(const string_view &s) const;
+
+        // `id` must have been returned by id() since the pool was cleared
+        string_view str(id_type id) const { return strings_[id]; }
+
+        size_t size() const { return strings_.size(); }
+        bool empty() const { return strings_.empty(); }
+
+        // total size of the blocks holding string data
+        size_t arena_size() const { return arena_size_; }
+
+        void clear();
+
+private:
+        friend class concurrent_string_pool;
+
+        struct Entry
+        {
+                string_view str;
+                size_t      hash;
+                id_type     id;
+        };
+
+        struct Probe
+        {
+                const string_view &str;
+                size_t             hash;
+        };
+
+        // hashes are computed once per string and stored in its entry
+        struct EntryHash
+        {
+                using is_transparent = void;
+
+                size_t operator()(const Entry &e) const { return e.hash; }
+                size_t operator()(const Probe &p) const { return p.hash; }
+        };
+
+        struct EntryEqual
+        {
+                using is_transparent = void;
+
+                bool operator()(const Entry &a, const Entry &b) const
+                        { return a.str.data() == b.str.data(); }
+
+                bool operator()(const Entry &a, const Probe &b) const
+                        { return (a.hash == b.hash) && (a.str == b.str); }
+        };
+
+        std::pair<string_view, id_type> insert(const string_view &s,
+                                               size_t hash);
+
+        const Entry *lookup(const string_view &s, size_t hash) const;
+
+        const char *store(const string_view &s);
+
+        std::vector<std::unique_ptr<char[]>>         blocks_;
+        char                                        *next_;
+        size_t                                       left_;
+        size_t                                       arena_size_;
+        std::vector<string_view>                     strings_;
+        flat_hash_set<Entry, EntryHash, EntryEqual>  index_;
+};
+
+//--------------------------------------
+/*
+ * A string_pool that may be used by many threads at once.  Strings are
+ * divided between a number of independently locked shards according to
+ * their hashes, so threads interning different strings seldom contend.
+ *
+ * IDs are unique across the whole pool but, unlike those of string_pool,
+ * are not consecutive.
+ */
+class WRUTIL_API concurrent_string_pool
+{
+public:
+        using id_type = string_pool::id_type;
+
+        static constexpr id_type npos = string_pool::npos;
+
+        /*
+         * `shards` is rounded up to a power of two no greater than 256;
+         * 0 selects four times std::thread::hardware_concurrency()
+         */
+        explicit concurrent_string_pool(unsigned shards = 0);
+        ~concurrent_string_pool();
+
+        string_view intern(const string_view &s);
+
+        string_view intern(const char *s)
+                { return intern(string_view(s)); }
+
+        string_view intern(const std::string &s)
+                { return intern(string_view(s)); }
+
+        u8string_view intern(const u8string_view &s);
+
+        id_type id(const string_view &s);
+
+        string_view find(const string_view &s) const;
+        id_type find_id(const string_view &s) const;
+
+        string_view str(id_type id) const;
+
+        size_t size() const;
+        size_t arena_size() const;
+
+        void clear();
+
+private:
+        struct Shard;
+
+        Shard &shard(size_t hash) const;
+
+        std::unique_ptr<Shard[]> shards_;
+        unsigned                 shard_bits_;
+};
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_STRING_POOL_H
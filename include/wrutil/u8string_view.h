@@ -205,7 +205,16 @@ public:
         template <typename Traits = std::char_traits<char16_t>,
                   typename Alloc = std::allocator<char16_t>>
         std::basic_string<char16_t, Traits, Alloc>
-        to_u16string(const Alloc &a = Alloc()) const;
+        to_u16string(
+                const Alloc &a = Alloc()
+        ) const
+        {
+                // never more UTF-16 code units than UTF-8 bytes
+                std::basic_string<char16_t, Traits, Alloc> result(
+                                                bytes(), char16_t(), a);
+                result.resize(size_t(copy_utf16(&result[0]) - &result[0]));
+                return result;
+        }
 
         template <typename Traits = std::char_traits<char16_t>,
                   typename Alloc = std::allocator<char16_t>>
@@ -368,6 +377,8 @@ public:
 private:
         void ensure_is_safe();
 
+        WRUTIL_API char16_t *copy_utf16(char16_t *out) const;
+
         template <typename Traits = std::char_traits<char>,
                   typename Alloc = std::allocator<char>>
         std::basic_string<char, Traits, Alloc>
@@ -35,6 +35,51 @@ namespace wr {
 extern WRUTIL_API std::istream &uin;
 extern WRUTIL_API std::ostream &uout, &uerr, &ulog;
 
+/**
+ * \brief Get the calling thread's proxy for `wr::uout`, `wr::uerr` or
+ *        `wr::ulog`
+ *
+ * Output to a proxy is held by the calling thread until a complete line
+ * has been written or the proxy is flushed, whereupon it is passed to the
+ * shared stream in one piece so that output from concurrent threads is
+ * never interleaved within a line. Output from a thread that is still
+ * pending when the thread exits is passed on at that point.
+ *
+ * Output to the proxies is only ordered with respect to other output to
+ * the proxies; the shared streams themselves must not be written to
+ * directly while other threads may be using the proxies.
+ */
+WRUTIL_API std::ostream &uout_local();
+WRUTIL_API std::ostream &uerr_local();  ///< \copydoc uout_local()
+WRUTIL_API std::ostream &ulog_local();  ///< \copydoc uout_local()
+
+//--------------------------------------
+
+enum class ubuffering
+{
+        unbuffered,  ///< output is written after every output operation
+        line,        ///< output is written at the end of each line
+        full         ///< output is written when the buffer is full or flushed
+};
+
+/**
+ * \brief Set how output to `wr::uout`, `wr::uerr` or `wr::ulog` is buffered
+ *
+ * By default `wr::uerr` is unbuffered, while `wr::uout` and `wr::ulog` are
+ * line-buffered when writing to a terminal and fully buffered otherwise.
+ * `wr::uerr` and `wr::ulog` share one buffer, so pending `wr::ulog` output
+ * is written before any `wr::uerr` output and a line or full buffering
+ * setting applies to both streams unless either is unbuffered.
+ *
+ * Output written by other means, such as `std::cout` or `printf()`, may
+ * appear out of order relative to buffered output that has not yet been
+ * flushed.
+ *
+ * Where the platform does not distinguish line and full buffering for
+ * `stream` only the unbuffered setting has any effect.
+ */
+WRUTIL_API void set_ubuffering(std::ostream &stream, ubuffering mode);
+
 //--------------------------------------
 
 static class WRUTIL_API uiostream_init
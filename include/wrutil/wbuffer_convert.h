@@ -52,8 +52,10 @@ private:
     wbuffer_convert(const wbuffer_convert&);
     wbuffer_convert& operator=(const wbuffer_convert&);
 public:
+    // __bufsize is the size of each of the internal and external buffers
     wbuffer_convert(std::streambuf* __bytebuf = 0, 
-            _Codecvt* __pcvt = new _Codecvt, state_type __state = state_type());
+            _Codecvt* __pcvt = new _Codecvt, state_type __state = state_type(),
+            std::streamsize __bufsize = 16384);
     ~wbuffer_convert();
 
     std::streambuf* rdbuf() const {return __bufptr_;}
@@ -70,6 +72,8 @@ protected:
     virtual int_type underflow();
     virtual int_type pbackfail(int_type __c = traits_type::eof());
     virtual int_type overflow (int_type __c = traits_type::eof());
+    virtual std::streamsize xsgetn(char_type* __s, std::streamsize __n);
+    virtual std::streamsize xsputn(const char_type* __s, std::streamsize __n);
     virtual std::basic_streambuf<char_type, traits_type>*
         setbuf(char_type* __s, std::streamsize __n);
     virtual pos_type seekoff(off_type __off, std::ios_base::seekdir __way,
@@ -87,7 +91,7 @@ private:
 template <class _Codecvt, class _Elem, class _Tr>
 wbuffer_convert<_Codecvt, _Elem, _Tr>::
     wbuffer_convert(std::streambuf* __bytebuf, _Codecvt* __pcvt,
-                    state_type __state)
+                    state_type __state, std::streamsize __bufsize)
     : __extbuf_(0),
       __extbufnext_(0),
       __extbufend_(0),
@@ -102,7 +106,7 @@ wbuffer_convert<_Codecvt, _Elem, _Tr>::
       __owns_ib_(false),
       __always_noconv_(__cv_ ? __cv_->always_noconv() : false)
 {
-    setbuf(0, 4096);
+    setbuf(0, __bufsize);
 }
 
 template <class _Codecvt, class _Elem, class _Tr>
@@ -235,7 +239,18 @@ wbuffer_convert<_Codecvt, _Elem, _Tr>::overflow(int_type __c)
                 __r = __cv_->out(__st_, this->pbase(), this->pptr(), __e,
                                         __extbuf_, __extbuf_ + __ebs_, __extbe);
                 if (__e == this->pbase())
-                    return traits_type::eof();
+                {
+                    // what remains is the start of a multibyte character;
+                    // keep it in the buffer to be completed by later output
+                    if (__r != std::codecvt_base::partial || __pb_save == 0
+                            || __extbe != __extbuf_)
+                        return traits_type::eof();
+                    std::streamsize __nkeep = this->pptr() - this->pbase();
+                    memmove(__pb_save, this->pbase(), __nkeep * sizeof(char_type));
+                    this->setp(__pb_save, __epb_save);
+                    this->pbump(static_cast<int>(__nkeep));
+                    return traits_type::not_eof(__c);
+                }
                 if (__r == std::codecvt_base::noconv)
                 {
                     std::streamsize __nmemb = static_cast<size_t>(this->pptr() - this->pbase());
@@ -262,6 +277,120 @@ wbuffer_convert<_Codecvt, _Elem, _Tr>::overflow(int_type __c)
     return traits_type::not_eof(__c);
 }
 
+// Reads of at least a buffer's worth bypass the get area, converting
+// straight into __s or, if no conversion is needed, reading straight from
+// the underlying streambuf
+template <class _Codecvt, class _Elem, class _Tr>
+std::streamsize
+wbuffer_convert<_Codecvt, _Elem, _Tr>::xsgetn(char_type* __s, std::streamsize __n)
+{
+    if (__cv_ == 0 || __bufptr_ == 0)
+        return 0;
+    __read_mode();
+    std::streamsize __r = this->egptr() - this->gptr();
+    const std::streamsize __min = static_cast<std::streamsize>(
+                                        __always_noconv_ ? __ebs_ : __ibs_);
+    if (__n - __r < __min || this->eback() == 0)
+        return std::basic_streambuf<_Elem, _Tr>::xsgetn(__s, __n);
+    traits_type::copy(__s, this->gptr(), static_cast<size_t>(__r));
+    if (__always_noconv_)
+        __r += __bufptr_->sgetn((char*)(__s + __r), __n - __r);
+    else
+    {
+        while (__n - __r >= __min)
+        {
+            const size_t __nleft = static_cast<size_t>(__extbufend_ - __extbufnext_);
+            memmove(__extbuf_, __extbufnext_, __nleft);
+            std::streamsize __nr = __bufptr_->sgetn(__extbuf_ + __nleft,
+                                        static_cast<std::streamsize>(__ebs_ - __nleft));
+            __extbufnext_ = __extbuf_;
+            __extbufend_ = __extbuf_ + __nleft + __nr;
+            if (__extbufnext_ == __extbufend_)
+                break;
+            char_type* __inext;
+            std::codecvt_base::result __cr = __cv_->in(__st_, __extbuf_, __extbufend_,
+                                                       __extbufnext_, __s + __r,
+                                                       __s + __n, __inext);
+            if (__cr == std::codecvt_base::noconv)
+            {
+                std::streamsize __nc = std::min<std::streamsize>(
+                                            __extbufend_ - __extbuf_, __n - __r);
+                traits_type::copy(__s + __r, (const char_type*)__extbuf_, __nc);
+                __extbufnext_ = __extbuf_ + __nc;
+                __inext = __s + __r + __nc;
+            }
+            const bool __progress = __inext != __s + __r;
+            __r = __inext - __s;
+            if (__cr == std::codecvt_base::error || (!__progress && __nr == 0))
+                break;
+        }
+    }
+    // leave the get area empty but for the last few characters read, which
+    // underflow() keeps for putback
+    char_type* __gend = this->eback() + __min;
+    const std::streamsize __nkeep = std::min<std::streamsize>(__r, 4);
+    traits_type::copy(__gend - __nkeep, __s + __r - __nkeep, __nkeep);
+    this->setg(this->eback(), __gend, __gend);
+    if (__r < __n)
+        __r += std::basic_streambuf<_Elem, _Tr>::xsgetn(__s + __r, __n - __r);
+    return __r;
+}
+
+// Writes of at least a buffer's worth bypass the put area, after anything
+// already buffered has been written out
+template <class _Codecvt, class _Elem, class _Tr>
+std::streamsize
+wbuffer_convert<_Codecvt, _Elem, _Tr>::xsputn(const char_type* __s, std::streamsize __n)
+{
+    if (__cv_ == 0 || __bufptr_ == 0)
+        return 0;
+    __write_mode();
+    const std::streamsize __min = static_cast<std::streamsize>(
+                                        __always_noconv_ ? __ebs_ : __ibs_);
+    if (__n < __min || this->pbase() == 0)
+        return std::basic_streambuf<_Elem, _Tr>::xsputn(__s, __n);
+    if (overflow() == traits_type::eof())
+        return 0;
+    // complete any character left part-written in the buffer
+    std::streamsize __w = 0;
+    while (this->pptr() != this->pbase() && __w < __n)
+    {
+        *this->pptr() = __s[__w++];
+        this->pbump(1);
+        if (overflow() == traits_type::eof())
+            return __w;
+    }
+    if (__always_noconv_)
+        return __w + __bufptr_->sputn((const char*)(__s + __w), __n - __w);
+    const char_type* __p = __s + __w;
+    const char_type* __end = __s + __n;
+    std::codecvt_base::result __r = std::codecvt_base::ok;
+    while (__p != __end)
+    {
+        const char_type* __e;
+        char* __extbe;
+        __r = __cv_->out(__st_, __p, __end, __e,
+                                __extbuf_, __extbuf_ + __ebs_, __extbe);
+        if (__r == std::codecvt_base::noconv)
+        {
+            return (__p - __s) + __bufptr_->sputn((const char*)__p, __end - __p);
+        }
+        if (__r == std::codecvt_base::error)
+            break;
+        std::streamsize __nmemb = static_cast<std::streamsize>(__extbe - __extbuf_);
+        if (__bufptr_->sputn(__extbuf_, __nmemb) != __nmemb)
+            break;
+        if (__e == __p)
+            break;
+        __p = __e;
+    }
+    // an incomplete character at the end is buffered to be completed by
+    // the next write
+    if (__p != __end && __r == std::codecvt_base::partial)
+        __p += std::basic_streambuf<_Elem, _Tr>::xsputn(__p, __end - __p);
+    return __p - __s;
+}
+
 template <class _Codecvt, class _Elem, class _Tr>
 std::basic_streambuf<_Elem, _Tr>*
 wbuffer_convert<_Codecvt, _Elem, _Tr>::setbuf(char_type* __s,
@@ -29,9 +29,13 @@
 
 //#include "config.h"
 #include <wrutil/CityHash.h>
+#include "CityHash_private.h"
 
 #include <algorithm>
 #include <string.h>  // for memcpy and memset
+#if WR_HAVE_X86_CRC32_INTRINSICS
+#include <nmmintrin.h>
+#endif
 
 using namespace std;
 
@@ -93,6 +97,22 @@ static uint32 UNALIGNED_LOAD32(const char *p) {
 #define uint64_in_expected_order(x) (x)
 #endif
 
+#if !defined(ALWAYS_INLINE)
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+#endif
+
+#if !defined(PREFETCH)
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void) 0)
+#endif
+#endif
+
 #if !defined(LIKELY)
 #if HAVE_BUILTIN_EXPECT
 #define LIKELY(x) (__builtin_expect(!!(x), 1))
@@ -402,6 +422,136 @@ WRUTIL_API uint64 CityHash64WithSeeds(const char *s, size_t len,
   return HashLen16(CityHash64(s, len) - seed0, seed1);
 }
 
+// The short-input cases of CityHash64() inlined into the batch loops below,
+// leaving only inputs over 64 bytes to the out-of-line call.
+static ALWAYS_INLINE uint64 CityHash64Short(const char *s, size_t len) {
+  if (len <= 16) {
+    return HashLen0to16(s, len);
+  } else if (len <= 32) {
+    return HashLen17to32(s, len);
+  } else if (len <= 64) {
+    return HashLen33to64(s, len);
+  }
+  return CityHash64(s, len);
+}
+
+// How many keys ahead of the one being hashed to prefetch.  Far enough to
+// cover a cache miss at the rate short keys are hashed.
+static const size_t kPrefetchDistance = 8;
+
+WRUTIL_API void CityHash64Many(const char *const *keys, const size_t *lens,
+                               size_t n, uint64 *hashes) {
+  size_t i = 0;
+  for (; i + kPrefetchDistance < n; ++i) {
+    PREFETCH(keys[i + kPrefetchDistance]);
+    hashes[i] = CityHash64Short(keys[i], lens[i]);
+  }
+  for (; i < n; ++i) {
+    hashes[i] = CityHash64Short(keys[i], lens[i]);
+  }
+}
+
+WRUTIL_API void CityHash64Many(const string_view *keys, size_t n,
+                               uint64 *hashes) {
+  size_t i = 0;
+  for (; i + kPrefetchDistance < n; ++i) {
+    PREFETCH(keys[i + kPrefetchDistance].data());
+    hashes[i] = CityHash64Short(keys[i].data(), keys[i].size());
+  }
+  for (; i < n; ++i) {
+    hashes[i] = CityHash64Short(keys[i].data(), keys[i].size());
+  }
+}
+
+WRUTIL_API CityHash64Stream& CityHash64Stream::reset() {
+  reset(0);
+  seeded_ = false;
+  return *this;
+}
+
+WRUTIL_API CityHash64Stream& CityHash64Stream::reset(uint64 seed) {
+  // Stands in for the state CityHash64() derives from the message's end.
+  x_ = seed ^ k1;
+  y_ = k2;
+  z_ = HashLen16(seed, k0);
+  v_ = uint128(k0, Rotate(seed, 32) + k1);
+  w_ = uint128(seed * k2, k0 ^ k2);
+  seed_ = seed;
+  seeded_ = true;
+  total_ = 0;
+  buf_len_ = 0;
+  return *this;
+}
+
+// The CityHash64() loop body.
+void CityHash64Stream::block(const char *s) {
+  x_ = Rotate(x_ + y_ + v_.first + Fetch64(s + 8), 37) * k1;
+  y_ = Rotate(y_ + v_.second + Fetch64(s + 48), 42) * k1;
+  x_ ^= w_.second;
+  y_ += v_.first + Fetch64(s + 40);
+  z_ = Rotate(z_ + w_.first, 33) * k1;
+  v_ = WeakHashLen32WithSeeds(s, v_.second * k1, x_ + w_.first);
+  w_ = WeakHashLen32WithSeeds(s + 32, z_ + w_.second, y_ + Fetch64(s + 16));
+  std::swap(z_, x_);
+}
+
+// At least one byte is always left buffered so that finish() has the
+// final block to hand.
+WRUTIL_API CityHash64Stream& CityHash64Stream::update(const void *data,
+                                                      size_t len) {
+  const char *s = static_cast<const char *>(data);
+  total_ += len;
+
+  if (buf_len_ + len <= sizeof(buf_)) {
+    if (len) {
+      memcpy(buf_ + buf_len_, s, len);
+    }
+    buf_len_ += len;
+    return *this;
+  }
+
+  if (buf_len_) {
+    size_t fill = sizeof(buf_) - buf_len_;
+    memcpy(buf_ + buf_len_, s, fill);
+    s += fill;
+    len -= fill;
+    block(buf_);
+    memcpy(prev_, buf_, sizeof(prev_));
+  }
+
+  if (len > 64) {
+    for (; len > 64; s += 64, len -= 64) {
+      block(s);
+    }
+    memcpy(prev_, s - 64, sizeof(prev_));
+  }
+
+  memcpy(buf_, s, len);
+  buf_len_ = len;
+  return *this;
+}
+
+WRUTIL_API uint64 CityHash64Stream::finish() const {
+  if (total_ <= sizeof(buf_)) {
+    return seeded_ ? CityHash64WithSeed(buf_, buf_len_, seed_)
+                   : CityHash64(buf_, buf_len_);
+  }
+
+  // The last 64 bytes of the message.
+  char last[64];
+  memcpy(last, prev_ + buf_len_, sizeof(last) - buf_len_);
+  memcpy(last + sizeof(last) - buf_len_, buf_, buf_len_);
+
+  CityHash64Stream final_state(*this);
+  final_state.z_ += total_ * k0;
+  final_state.block(last);
+
+  uint64 x = final_state.x_, y = final_state.y_, z = final_state.z_;
+  uint128 v = final_state.v_, w = final_state.w_;
+  return HashLen16(HashLen16(v.first, w.first) + ShiftMix(y) * k1 + z,
+                   HashLen16(v.second, w.second) + x);
+}
+
 // A subroutine for CityHash128().  Returns a decent 128-bit hash for strings
 // of any length representable in signed long.  Based on City and Murmur.
 static uint128 CityMurmur(const char *s, size_t len, uint128 seed) {
@@ -505,13 +655,44 @@ WRUTIL_API uint128 CityHash128(const char *s, size_t len) {
       CityHash128WithSeed(s, len, uint128(k0, k1));
 }
 
-#ifdef __SSE4_2__
-#include <citycrc.h>
-#include <nmmintrin.h>
+// CRC-32C (Castagnoli) tables for slicing by eight, used to compute the
+// same values as the SSE4.2 CRC32 instruction on CPUs that lack it.
+static const struct Crc32cTables {
+  Crc32cTables() {
+    for (uint32 i = 0; i < 256; ++i) {
+      uint32 crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+      }
+      t[0][i] = crc;
+    }
+    for (int k = 1; k < 8; ++k) {
+      for (uint32 i = 0; i < 256; ++i) {
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+      }
+    }
+  }
+
+  uint32 t[8][256];
+} kCrc32c;
 
-// Requires len >= 240.
-static void CityHashCrc256Long(const char *s, size_t len,
-                               uint32 seed, uint64 *result) {
+struct SoftCrc {
+  uint64 operator()(uint64 crc, uint64 v) const {
+    uint64 x = v ^ static_cast<uint32>(crc);
+    return kCrc32c.t[7][x & 0xff] ^ kCrc32c.t[6][(x >> 8) & 0xff] ^
+           kCrc32c.t[5][(x >> 16) & 0xff] ^ kCrc32c.t[4][(x >> 24) & 0xff] ^
+           kCrc32c.t[3][(x >> 32) & 0xff] ^ kCrc32c.t[2][(x >> 40) & 0xff] ^
+           kCrc32c.t[1][(x >> 48) & 0xff] ^ kCrc32c.t[0][x >> 56];
+  }
+};
+
+// Requires len >= 240.  Crc is a function object computing the equivalent
+// of _mm_crc32_u64().  Always inlined so that each instantiation is
+// compiled with the instruction set of the function that calls it.
+template <typename Crc>
+static ALWAYS_INLINE void CityHashCrc256Long(const char *s, size_t len,
+                                      uint32 seed, uint64 *result) {
+  Crc crc;
   uint64 a = Fetch64(s + 56) + k0;
   uint64 b = Fetch64(s + 96) + k0;
   uint64 c = result[0] = HashLen16(b, len);
@@ -543,9 +724,9 @@ static void CityHashCrc256Long(const char *s, size_t len,
     g += e;                                     \
     e += z;                                     \
     g += x;                                     \
-    z = _mm_crc32_u64(z, b + g);                \
-    y = _mm_crc32_u64(y, e + h);                \
-    x = _mm_crc32_u64(x, f + a);                \
+    z = crc(z, b + g);                          \
+    y = crc(y, e + h);                          \
+    x = crc(x, f + a);                          \
     e = Rotate(e, r);                           \
     c += e;                                     \
     s += 40
@@ -597,23 +778,57 @@ static void CityHashCrc256Long(const char *s, size_t len,
   result[3] = a + result[2];
 }
 
+void CityHashCrc256LongSoft(const char *s, size_t len,
+                            uint32 seed, uint64 *result) {
+  CityHashCrc256Long<SoftCrc>(s, len, seed, result);
+}
+
+#if WR_HAVE_X86_CRC32_INTRINSICS
+struct HardCrc {
+  __attribute__((target("sse4.2")))
+  uint64 operator()(uint64 crc, uint64 v) const {
+    return _mm_crc32_u64(crc, v);
+  }
+};
+
+// flatten so that HardCrc is inlined, which it cannot be into the generic
+// instantiation of CityHashCrc256Long().
+__attribute__((target("sse4.2"), flatten))
+void CityHashCrc256LongSse42(const char *s, size_t len,
+                             uint32 seed, uint64 *result) {
+  CityHashCrc256Long<HardCrc>(s, len, seed, result);
+}
+#endif
+
+// Picks the CityHashCrc256Long() variant for the CPU on first use; all
+// variants produce identical results.
+static void CityHashCrc256LongDispatch(const char *s, size_t len,
+                                       uint32 seed, uint64 *result) {
+  static const CityHashCrc256LongFn fn =
+#if WR_HAVE_X86_CRC32_INTRINSICS
+      __builtin_cpu_supports("sse4.2") ? &CityHashCrc256LongSse42 :
+#endif
+      &CityHashCrc256LongSoft;
+  fn(s, len, seed, result);
+}
+
 // Requires len < 240.
 static void CityHashCrc256Short(const char *s, size_t len, uint64 *result) {
   char buf[240];
   memcpy(buf, s, len);
   memset(buf + len, 0, 240 - len);
-  CityHashCrc256Long(buf, 240, ~static_cast<uint32>(len), result);
+  CityHashCrc256LongDispatch(buf, 240, ~static_cast<uint32>(len), result);
 }
 
-void CityHashCrc256(const char *s, size_t len, uint64 *result) {
+WRUTIL_API void CityHashCrc256(const char *s, size_t len, uint64 *result) {
   if (LIKELY(len >= 240)) {
-    CityHashCrc256Long(s, len, 0, result);
+    CityHashCrc256LongDispatch(s, len, 0, result);
   } else {
     CityHashCrc256Short(s, len, result);
   }
 }
 
-uint128 CityHashCrc128WithSeed(const char *s, size_t len, uint128 seed) {
+WRUTIL_API uint128 CityHashCrc128WithSeed(const char *s, size_t len, uint128 seed) {
   if (len <= 900) {
     return CityHash128WithSeed(s, len, seed);
   } else {
@@ -626,7 +841,7 @@ uint128 CityHashCrc128WithSeed(const char *s, size_t len, uint128 seed) {
   }
 }
 
-uint128 CityHashCrc128(const char *s, size_t len) {
+WRUTIL_API uint128 CityHashCrc128(const char *s, size_t len) {
   if (len <= 900) {
     return CityHash128(s, len);
   } else {
@@ -636,6 +851,4 @@ uint128 CityHashCrc128(const char *s, size_t len) {
   }
 }
 
-#endif
-
 } // namespace wr
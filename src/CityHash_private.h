@@ -0,0 +1,56 @@
+/**
+ * \file CityHash_private.h
+ *
+ * \brief Declarations of the internal CityHashCrc256() long-input functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_CITYHASH_PRIVATE_H
+#define WRUTIL_CITYHASH_PRIVATE_H
+
+#include <stddef.h>
+#include <wrutil/Config.h>
+#include <wrutil/CityHash.h>
+
+
+namespace wr {
+
+
+/*
+ * Hashes `len` >= 240 bytes at `s` into result[0..3]; CityHashCrc256()
+ * calls the variant for the CPU with a `seed` of 0, or with
+ * ~(input length) on its input padded with zeros to 240 bytes
+ */
+typedef void (*CityHashCrc256LongFn)(const char *s, size_t len,
+                                     uint32 seed, uint64 *result);
+
+void CityHashCrc256LongSoft(const char *s, size_t len, uint32 seed,
+                            uint64 *result);  // slicing-by-8 CRC-32C
+
+#if WR_HAVE_X86_CRC32_INTRINSICS
+void CityHashCrc256LongSse42(const char *s, size_t len, uint32 seed,
+                             uint64 *result);  // requires SSE4.2
+#endif
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_CITYHASH_PRIVATE_H
@@ -25,13 +25,13 @@
 #include <ctype.h>
 #include <errno.h>
 #include <algorithm>
-#include <map>
 #include <memory>
 #include <vector>
 
 #include <wrutil/Format.h>
 #include <wrutil/codecvt.h>
 #include <wrutil/ctype.h>
+#include <wrutil/flat_hash_map.h>
 #include <wrutil/Option.h>
 #include <wrutil/utf8.h>
 
@@ -185,7 +185,7 @@ Option::parse(
 
         const Option           *nonopt_handler = nullptr;
         OptionsByPrefix::Entry  unknown_handler;
-        std::map<string_view, OptionsByPrefix> prefixes;
+        flat_hash_map<string_view, OptionsByPrefix> prefixes;
         string_view pfx;
         ArgVStorage utf8_args;
 
@@ -24,6 +24,7 @@
  */
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 #include <stdexcept>
 #include <wrutil/Config.h>
 
@@ -33,14 +34,15 @@
 #       include <arpa/inet.h>
 #endif
 
-#include <wrutil/Format.h>
+#include <wrutil/hex.h>
 #include <wrutil/SHA256.h>
+#include "SHA256_private.h"
 
 
 namespace wr {
 
 
-const uint32_t SHA256::K_[64] = {
+const uint32_t SHA256_K[64] = {
         0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
         0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
         0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -67,24 +69,32 @@ SHA256::append(
         size_t      size
 )
 {
-        while (size) {
-                size_t pos = size_t(total_length_ & 63),
-                       bytes_this_block = 64 - pos;
-
-                if (size < bytes_this_block) {
-                        memcpy(reinterpret_cast<uint8_t *>(W_) + pos, data,
-                               size);
-                        total_length_ += size;
-                        break;
-                } else {
-                        memcpy(reinterpret_cast<uint8_t *>(W_) + pos, data,
-                               bytes_this_block);
-                        computeBlock(H_, W_);
-                        size -= bytes_this_block;
-                        total_length_ += bytes_this_block;
+        auto   in  = static_cast<const uint8_t *>(data);
+        size_t pos = size_t(total_length_ & 63);
+
+        total_length_ += size;
+
+        if (pos) {  // top up buffered partial block first
+                size_t n = std::min(size, 64 - pos);
+
+                memcpy(reinterpret_cast<uint8_t *>(W_) + pos, in, n);
+                if (pos + n < 64) {
+                        return *this;
                 }
+                computeBlocks(H_, W_, 1);
+                in += n;
+                size -= n;
         }
 
+        if (size >= 64) {  // whole blocks are hashed in place, not copied
+                computeBlocks(H_, in, size / 64);
+                in += size & ~size_t(63);
+                size &= 63;
+        }
+
+        if (size) {
+                memcpy(W_, in, size);
+        }
         return *this;
 }
 
@@ -102,8 +112,8 @@ WRUTIL_API SHA256::Hash
 SHA256::chash() const
 {
         Hash     h = H_;
-        uint32_t w[64];
-        std::copy_n(W_, 64, w);
+        uint32_t w[16];
+        std::copy_n(W_, 16, w);
         hash(h, w, total_length_);
         return h;
 }
@@ -113,7 +123,7 @@ SHA256::chash() const
 SHA256::Hash &
 SHA256::hash(
         Hash      &h,
-        uint32_t (&w)[64],
+        uint32_t (&w)[16],
         size_t     total_length
 ) // static
 {
@@ -128,7 +138,7 @@ SHA256::hash(
                 memset(dst, 0, pad - 8);
         } else if (pad < 8) {
                 memset(dst, 0, pad);
-                computeBlock(h, w);
+                computeBlocks(h, w, 1);
                 dst = reinterpret_cast<uint8_t *>(w);
                 pos = 0;
                 memset(dst, 0, pad = 56);
@@ -146,89 +156,319 @@ SHA256::hash(
         w[15] = ntohl(uint32_t(total_length_bits));
         w[14] = ntohl(uint32_t(total_length_bits >>= 32));
 #endif
-        computeBlock(h, w);
+        computeBlocks(h, w, 1);
         return h;
 }
 
 //--------------------------------------
 
+static const SHA256::Hash IV = {{
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+}};
+
+//--------------------------------------
+
 WRUTIL_API SHA256 &
 SHA256::reset()
 {
         total_length_ = 0;
-        H_ = {{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-                0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }};
+        H_ = IV;
         return *this;
 }
 
 //--------------------------------------
 
-inline uint32_t rotateRight(uint32_t x, unsigned bits)
-        { return (x >> bits) | (x << (32 - bits)); }
+void
+sha256BlocksScalar(
+        SHA256::Hash  &h,
+        const uint8_t *data,
+        size_t         blocks
+)
+{
+        uint32_t w[64];
 
-inline uint32_t Ch(uint32_t x, uint32_t y, uint32_t z)
-        { return (x & y) ^ ((~x) & z); }
+        for (; blocks; --blocks, data += 64) {
+                memcpy(w, data, 64);
+#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+                for (size_t i = 0; i < 16; ++i) {
+                        w[i] = htonl(w[i]);
+                }
+#endif
+                for (size_t j = 16; j < 64; ++j) {
+                        w[j] = sigma1(w[j - 2]) + w[j - 7] + sigma0(w[j - 15])
+                                                + w[j - 16];
+                }
 
-inline uint32_t Maj(uint32_t x, uint32_t y, uint32_t z)
-        { return (x & y) ^ (x & z) ^ (y & z); }
+                for (size_t j = 0; j < 64; ++j) {
+                        w[j] += SHA256_K[j];
+                }
 
-inline uint32_t SIGMA0(uint32_t x)
-        { return rotateRight(x, 2) ^ rotateRight(x, 13) ^ rotateRight(x, 22); }
+                sha256Rounds(h, w);
+        }
+}
 
-inline uint32_t SIGMA1(uint32_t x)
-        { return rotateRight(x, 6) ^ rotateRight(x, 11) ^ rotateRight(x, 25); }
+//--------------------------------------
+/*
+ * Picks the fastest block function supported by the host CPU; the
+ * scalar implementation is the reference and the fallback for all other
+ * platforms
+ */
+static SHA256BlockFn
+selectBlockFn()
+{
+#if WR_HAVE_X86_SHA_INTRINSICS
+        if (haveX86ShaExtensions()) {
+                return &sha256BlocksX86Sha;
+        } else if (haveX86Ssse3()) {
+                return &sha256BlocksSsse3;
+        }
+#elif WR_HAVE_ARM_SHA2_INTRINSICS
+        if (haveArmSha2()) {
+                return &sha256BlocksArmSha2;
+        }
+#endif
+        return &sha256BlocksScalar;
+}
 
-inline uint32_t sigma0(uint32_t x)
-        { return rotateRight(x, 7) ^ rotateRight(x, 18) ^ (x >> 3); }
+//--------------------------------------
+
+static void resolveBlockFn(SHA256::Hash &h, const uint8_t *data,
+                           size_t blocks);
+
+static std::atomic<SHA256BlockFn> block_fn(&resolveBlockFn);
+        /* constant-initialised so that hashing works during static
+           initialisation of other modules */
+
+static void
+resolveBlockFn(
+        SHA256::Hash  &h,
+        const uint8_t *data,
+        size_t         blocks
+)
+{
+        SHA256BlockFn fn = selectBlockFn();
+        block_fn.store(fn, std::memory_order_relaxed);
+        fn(h, data, blocks);
+}
 
-inline uint32_t sigma1(uint32_t x)
-        { return rotateRight(x, 17) ^ rotateRight(x, 19) ^ (x >> 10); }
+static struct BlockFnInit
+{
+        BlockFnInit()
+        {
+                block_fn.store(selectBlockFn(), std::memory_order_relaxed);
+        }
+} block_fn_init_;  // select at load time where static init order allows
 
 //--------------------------------------
 
 void
-SHA256::computeBlock(
-        Hash      &h,
-        uint32_t (&w)[64]
+SHA256::computeBlocks(
+        Hash       &h,
+        const void *data,
+        size_t      blocks
 ) // static
 {
-#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
-        for (size_t i = 0; i < 16; ++i) {
-                w[i] = htonl(w[i]);
+        block_fn.load(std::memory_order_relaxed)(
+                h, static_cast<const uint8_t *>(data), blocks);
+}
+
+//--------------------------------------
+/*
+ * Writes the padded final block(s) of a `total_length`-byte message whose
+ * trailing partial block starts at `rest`; returns the number of blocks
+ * written to `out` (1 or 2)
+ */
+static size_t
+padFinalBlocks(
+        uint8_t      (&out)[128],
+        const uint8_t *rest,
+        size_t         total_length
+)
+{
+        size_t   pos    = size_t(total_length & 63),
+                 blocks = (pos < 56) ? 1 : 2;
+        uint64_t bits   = uint64_t(total_length) << 3;
+
+        if ((bits >> 3) != total_length) {
+                throw std::overflow_error("message too long");
         }
-#endif
-        for (size_t j = 16; j < 64; ++j) {
-                w[j] = sigma1(w[j - 2]) + w[j - 7] + sigma0(w[j - 15])
-                                        + w[j - 16];
+
+        memcpy(out, rest, pos);
+        out[pos] = 0x80;
+        memset(out + pos + 1, 0, blocks * 64 - pos - 1);
+
+        for (uint8_t *p = out + blocks * 64; bits; bits >>= 8) {
+                *(--p) = static_cast<uint8_t>(bits);
         }
 
-        union
+        return blocks;
+}
+
+//--------------------------------------
+
+static void
+hashOne(
+        const string_view &message,
+        SHA256::Hash      &h
+)
+{
+        auto    data   = reinterpret_cast<const uint8_t *>(message.data());
+        size_t  blocks = message.size() / 64;
+        uint8_t tail[128];
+        auto    fn     = block_fn.load(std::memory_order_relaxed);
+
+        h = IV;
+        if (blocks) {
+                fn(h, data, blocks);
+        }
+        fn(h, tail, padFinalBlocks(tail, data + blocks * 64, message.size()));
+}
+
+//--------------------------------------
+/*
+ * Hashes `count` messages N at a time with `lanes_fn`; each lane takes the
+ * next waiting message as soon as its current one is finished, and idle
+ * lanes are fed a dummy block whose result is discarded. Once too few
+ * messages remain to keep the lanes busy they are finished one at a time.
+ */
+template <size_t N> static void
+hashManyLanes(
+        SHA256LanesFn<N>   lanes_fn,
+        const string_view *messages,
+        SHA256::Hash      *hashes,
+        size_t             count
+)
+{
+        struct Lane
         {
-                struct
-                {
-                        uint32_t a, b, c, d, e, f, g, h;
-                };
-                Hash hash;
-        } reg;
-
-        reg.hash = h;
-
-        for (size_t j = 0; j < 64; ++j) {
-                uint32_t T1 = reg.h + SIGMA1(reg.e) + Ch(reg.e, reg.f, reg.g)
-                                    + K_[j] + w[j],
-                         T2 = SIGMA0(reg.a) + Maj(reg.a, reg.b, reg.c);
-                reg.h = reg.g;
-                reg.g = reg.f;
-                reg.f = reg.e;
-                reg.e = reg.d + T1;
-                reg.d = reg.c;
-                reg.c = reg.b;
-                reg.b = reg.a;
-                reg.a = T1 + T2;
+                const uint8_t *data,
+                              *tail_next;
+                size_t         blocks,
+                               tail_blocks,
+                               index;
+                uint8_t        tail[128];
+        };
+
+        static const uint8_t IDLE_BLOCK[64] = {};
+        static const size_t  IDLE = size_t(-1);
+
+        alignas(64) uint32_t state[8][N];
+        Lane                 lanes[N];
+        const uint8_t       *in[N];
+        size_t               next = 0, active = 0;
+
+        auto start = [&](size_t i) {
+                Lane &lane = lanes[i];
+
+                if (next == count) {
+                        lane.index = IDLE;
+                        return;
+                }
+
+                const string_view &message = messages[next];
+
+                lane.data        = reinterpret_cast<const uint8_t *>(
+                                                        message.data());
+                lane.blocks      = message.size() / 64;
+                lane.tail_blocks = padFinalBlocks(lane.tail,
+                                                  lane.data + lane.blocks * 64,
+                                                  message.size());
+                lane.tail_next   = lane.tail;
+                lane.index       = next++;
+                ++active;
+
+                for (size_t word = 0; word < 8; ++word) {
+                        state[word][i] = IV[word];
+                }
+        };
+
+        for (size_t i = 0; i < N; ++i) {
+                start(i);
+        }
+
+        while ((next < count) || (active > N / 4)) {
+                for (size_t i = 0; i < N; ++i) {
+                        const Lane &lane = lanes[i];
+
+                        if (lane.index == IDLE) {
+                                in[i] = IDLE_BLOCK;
+                        } else if (lane.blocks) {
+                                in[i] = lane.data;
+                        } else {
+                                in[i] = lane.tail_next;
+                        }
+                }
+
+                lanes_fn(state, in);
+
+                for (size_t i = 0; i < N; ++i) {
+                        Lane &lane = lanes[i];
+
+                        if (lane.index == IDLE) {
+                                continue;
+                        } else if (lane.blocks) {
+                                lane.data += 64;
+                                --lane.blocks;
+                                continue;
+                        } else if (--lane.tail_blocks) {
+                                lane.tail_next += 64;
+                                continue;
+                        }
+
+                        for (size_t word = 0; word < 8; ++word) {
+                                hashes[lane.index][word] = state[word][i];
+                        }
+
+                        --active;
+                        start(i);
+                }
         }
 
-        for (size_t i = 0; i < reg.hash.size(); ++i) {
-                h[i] += reg.hash[i];
+        auto fn = block_fn.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < N; ++i) {
+                Lane &lane = lanes[i];
+
+                if (lane.index != IDLE) {
+                        SHA256::Hash &h = hashes[lane.index];
+
+                        for (size_t word = 0; word < 8; ++word) {
+                                h[word] = state[word][i];
+                        }
+                        if (lane.blocks) {
+                                fn(h, lane.data, lane.blocks);
+                        }
+                        fn(h, lane.tail_next, lane.tail_blocks);
+                }
+        }
+}
+
+//--------------------------------------
+
+WRUTIL_API void
+SHA256::hashMany(
+        const string_view *messages,
+        Hash              *hashes,
+        size_t             count
+) // static
+{
+#if WR_HAVE_X86_SHA_INTRINSICS
+        // eight AVX2 lanes don't keep up with one SHA extensions stream
+        static const size_t lanes = haveX86Avx512() ? 16
+                                  : (haveX86Avx2() && !haveX86ShaExtensions())
+                                                    ? 8 : 0;
+
+        if ((lanes == 16) && (count >= 8)) {
+                return hashManyLanes<16>(&sha256Lanes16Avx512, messages,
+                                         hashes, count);
+        } else if ((lanes == 8) && (count >= 4)) {
+                return hashManyLanes<8>(&sha256Lanes8Avx2, messages, hashes,
+                                        count);
+        }
+#endif
+        for (size_t i = 0; i < count; ++i) {
+                hashOne(messages[i], hashes[i]);
         }
 }
 
@@ -239,39 +479,57 @@ SHA256::toString(
         const Hash &h
 )
 {
-        
-        return printStr("%.08x%.08x%.08x%.08x%.08x%.08x%.08x%.08x",
-                        h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+        uint8_t bytes[32];
+        char    digits[hex_encoded_size(sizeof(bytes))];
+
+        for (size_t i = 0; i < 8; ++i) {
+                bytes[4 * i]     = uint8_t(h[i] >> 24);
+                bytes[4 * i + 1] = uint8_t(h[i] >> 16);
+                bytes[4 * i + 2] = uint8_t(h[i] >> 8);
+                bytes[4 * i + 3] = uint8_t(h[i]);
+        }
+
+        hex_encode(bytes, sizeof(bytes), digits);
+        return std::string(digits, sizeof(digits));
 }
 
 //--------------------------------------
-
+/*
+ * Characters beyond the first 64 are ignored and any that are not hex
+ * digits count as zero, as do any digits missing from the end
+ */
 SHA256::Hash
 WRUTIL_API SHA256::toHash(
         const string_view &str
 )
 {
-        Hash      h;
-        uint32_t *element;
-        size_t    i, n = std::min(str.size(), size_t(64));
-
-        for (i = 0, element = &h[-1]; i < n; ++i) {
-                if (i & 7) {
-                        *element <<= 4;
-                } else {  // i is a multiple of 8
-                        *(++element) = 0;
+        Hash    h;
+        uint8_t bytes[32];
+
+        if ((str.size() >= 64) && hex_decode(str.substr(0, 64), bytes)) {
+                for (size_t i = 0; i < 8; ++i) {
+                        h[i] = loadBE32(&bytes[4 * i]);
                 }
+                return h;
+        }
 
-                char ch = str[i];
+        size_t n = std::min(str.size(), size_t(64));
 
-                if (isdigit(ch)) {
-                        *element |= ch - '0';
-                } else {
-                        ch = tolower(ch);
-                        if ((ch >= 'a') && (ch <= 'f')) {
-                                *element |= ch - 'a';
-                        }
+        h.fill(0);
+
+        for (size_t i = 0; i < n; ++i) {
+                char    ch = str[i];
+                uint8_t value = 0;
+
+                if ((ch >= '0') && (ch <= '9')) {
+                        value = uint8_t(ch - '0');
+                } else if ((ch >= 'a') && (ch <= 'f')) {
+                        value = uint8_t(ch - 'a' + 10);
+                } else if ((ch >= 'A') && (ch <= 'F')) {
+                        value = uint8_t(ch - 'A' + 10);
                 }
+
+                h[i / 8] |= uint32_t(value) << (28 - 4 * (i % 8));
         }
 
         return h;
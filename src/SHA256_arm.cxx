@@ -0,0 +1,137 @@
+/**
+ * \file SHA256_arm.cxx
+ *
+ * \brief ARMv8-specific SHA-256 block function (SHA-2 crypto extension)
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <wrutil/Config.h>
+#if WR_LINUX || WR_ANDROID
+#       include <sys/auxv.h>
+#endif
+#include <arm_neon.h>
+#include "SHA256_private.h"
+
+#ifdef __clang__
+#       define WR_TARGET_SHA2 __attribute__((target("crypto")))
+#else
+#       define WR_TARGET_SHA2 __attribute__((target("+crypto")))
+#endif
+
+#ifndef HWCAP_SHA2
+#       define HWCAP_SHA2 (1 << 6)
+#endif
+
+
+namespace wr {
+
+
+bool
+haveArmSha2()
+{
+#if WR_LINUX || WR_ANDROID
+        return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#elif WR_MACOS
+        return true;  // all 64-bit Apple processors implement SHA-2
+#else
+        return false;
+#endif
+}
+
+//--------------------------------------
+/*
+ * Four rounds of SHA-256; `cur` holds message words 4*I to 4*I+3 and is
+ * replaced with words 4*I+16 to 4*I+19 using the following groups `m1`
+ * to `m3`
+ */
+template <int I>
+WR_TARGET_SHA2 __attribute__((always_inline)) inline void
+armSha2Rounds4(
+        uint32x4_t       &state0,
+        uint32x4_t       &state1,
+        uint32x4_t       &cur,
+        const uint32x4_t &m1,
+        const uint32x4_t &m2,
+        const uint32x4_t &m3
+)
+{
+        uint32x4_t wk = vaddq_u32(cur, vld1q_u32(&SHA256_K[4 * I])),
+                   tmp = state0;
+
+        if (I < 12) {
+                cur = vsha256su0q_u32(cur, m1);
+        }
+
+        state0 = vsha256hq_u32(state0, state1, wk);
+        state1 = vsha256h2q_u32(state1, tmp, wk);
+
+        if (I < 12) {
+                cur = vsha256su1q_u32(cur, m2, m3);
+        }
+}
+
+//--------------------------------------
+
+WR_TARGET_SHA2 void
+sha256BlocksArmSha2(
+        SHA256::Hash  &h,
+        const uint8_t *data,
+        size_t         blocks
+)
+{
+        uint32x4_t state0 = vld1q_u32(&h[0]),
+                   state1 = vld1q_u32(&h[4]),
+                   m0, m1, m2, m3;
+
+        for (; blocks; --blocks, data += 64) {
+                uint32x4_t abcd_save = state0, efgh_save = state1;
+
+                m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+                m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+                m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+                m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+                armSha2Rounds4<0> (state0, state1, m0, m1, m2, m3);
+                armSha2Rounds4<1> (state0, state1, m1, m2, m3, m0);
+                armSha2Rounds4<2> (state0, state1, m2, m3, m0, m1);
+                armSha2Rounds4<3> (state0, state1, m3, m0, m1, m2);
+                armSha2Rounds4<4> (state0, state1, m0, m1, m2, m3);
+                armSha2Rounds4<5> (state0, state1, m1, m2, m3, m0);
+                armSha2Rounds4<6> (state0, state1, m2, m3, m0, m1);
+                armSha2Rounds4<7> (state0, state1, m3, m0, m1, m2);
+                armSha2Rounds4<8> (state0, state1, m0, m1, m2, m3);
+                armSha2Rounds4<9> (state0, state1, m1, m2, m3, m0);
+                armSha2Rounds4<10>(state0, state1, m2, m3, m0, m1);
+                armSha2Rounds4<11>(state0, state1, m3, m0, m1, m2);
+                armSha2Rounds4<12>(state0, state1, m0, m1, m2, m3);
+                armSha2Rounds4<13>(state0, state1, m1, m2, m3, m0);
+                armSha2Rounds4<14>(state0, state1, m2, m3, m0, m1);
+                armSha2Rounds4<15>(state0, state1, m3, m0, m1, m2);
+
+                state0 = vaddq_u32(state0, abcd_save);
+                state1 = vaddq_u32(state1, efgh_save);
+        }
+
+        vst1q_u32(&h[0], state0);
+        vst1q_u32(&h[4], state1);
+}
+
+
+} // namespace wr
@@ -0,0 +1,289 @@
+/**
+ * \file SHA256_file.cxx
+ *
+ * \brief Implementation of the wr::sha256_file() functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <wrutil/Config.h>
+
+#if WR_POSIX
+#       include <fcntl.h>
+#       include <sys/mman.h>
+#       include <sys/stat.h>
+#       include <unistd.h>
+#else
+#       include <fstream>
+#endif
+#include <errno.h>
+#include <algorithm>
+#include <memory>
+
+#include <wrutil/SHA256.h>
+
+#if WR_HAVE_STD_FILESYSTEM
+#       include <system_error>
+#else
+#       include <boost/system/error_code.hpp>
+#endif
+
+
+namespace wr {
+
+
+#if WR_HAVE_STD_FILESYSTEM
+using std::system_category;
+#else
+using boost::system_category;
+#endif
+
+
+/*
+ * read() buffer size; also the size of the chunks fed to SHA256::append()
+ * by the fallback paths, which is large enough to keep the block function
+ * working on many blocks per call
+ */
+static constexpr size_t READ_BUFFER_SIZE = 1 << 20;
+
+#if WR_POSIX
+
+/*
+ * Regular files are mapped this many bytes at a time, bounding the address
+ * space used for very large files (must be a multiple of the page size)
+ */
+static constexpr size_t MAP_WINDOW_SIZE = size_t(64) << 20;
+
+/*
+ * Regular files smaller than this are read into a stack buffer rather than
+ * mapped, as setting up and tearing down a mapping costs more than the
+ * copy for small files
+ */
+static constexpr size_t SMALL_FILE_SIZE = 16384;
+
+//--------------------------------------
+
+static bool
+hashByReading(
+        SHA256        &hasher,
+        int            fd,
+        char          *buf,
+        size_t         buf_size,
+        fs_error_code &ec
+)
+{
+        for (;;) {
+                ssize_t n = ::read(fd, buf, buf_size);
+                if (n > 0) {
+                        hasher.append(buf, size_t(n));
+                } else if (n == 0) {
+                        return true;
+                } else if (errno != EINTR) {
+                        ec.assign(errno, system_category());
+                        return false;
+                }
+        }
+}
+
+//--------------------------------------
+/*
+ * Hashes a regular file through read-only mappings so that the block
+ * function reads straight from the page cache; returns the number of bytes
+ * hashed, which is less than `size` if a mapping could not be created
+ */
+static off_t
+hashByMapping(
+        SHA256 &hasher,
+        int     fd,
+        off_t   size
+)
+{
+        off_t offset = 0;
+
+        while (offset < size) {
+                size_t len = size_t(std::min<off_t>(size - offset,
+                                                    MAP_WINDOW_SIZE));
+                void *map = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd,
+                                   offset);
+                if (map == MAP_FAILED) {
+                        break;
+                }
+#ifdef MADV_SEQUENTIAL
+                ::madvise(map, len, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+                ::madvise(map, len, MADV_WILLNEED);
+#endif
+                hasher.append(map, len);
+                ::munmap(map, len);
+                offset += off_t(len);
+        }
+
+        return offset;
+}
+
+#endif // WR_POSIX
+//--------------------------------------
+
+static SHA256::Hash
+hashFile(
+        const path    &p,
+        bool           may_map,
+        fs_error_code &ec
+)
+{
+        SHA256 hasher;
+
+        ec.clear();
+
+#if WR_POSIX
+        int flags = O_RDONLY;
+#ifdef O_CLOEXEC
+        flags |= O_CLOEXEC;
+#endif
+        int fd;
+
+        do {
+                fd = ::open(p.c_str(), flags);
+        } while ((fd < 0) && (errno == EINTR));
+
+        if (fd < 0) {
+                ec.assign(errno, system_category());
+                return SHA256::Hash();
+        }
+
+        struct stat st;
+        bool        ok;
+
+        if (::fstat(fd, &st) != 0) {
+                ec.assign(errno, system_category());
+                ok = false;
+        } else {
+                bool  small = S_ISREG(st.st_mode)
+                              && (st.st_size < off_t(SMALL_FILE_SIZE));
+                off_t mapped = 0;
+
+                if (S_ISREG(st.st_mode) && !small) {
+#if defined(POSIX_FADV_SEQUENTIAL) && !WR_MACOS
+                        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+                        if (may_map) {
+                                mapped = hashByMapping(hasher, fd,
+                                                       st.st_size);
+                        }
+                }
+                if ((mapped > 0) && (::lseek(fd, mapped, SEEK_SET) < 0)) {
+                        ec.assign(errno, system_category());
+                        ok = false;
+                } else if (small) {
+                        char buf[SMALL_FILE_SIZE];
+                        ok = hashByReading(hasher, fd, buf, sizeof(buf), ec);
+                } else {
+                        // picks up anything not mapped, including any
+                        // data appended since fstat()
+                        std::unique_ptr<char[]> buf(
+                                                new char[READ_BUFFER_SIZE]);
+                        ok = hashByReading(hasher, fd, buf.get(),
+                                           READ_BUFFER_SIZE, ec);
+                }
+        }
+
+        ::close(fd);
+
+        if (!ok) {
+                return SHA256::Hash();
+        }
+#else // !WR_POSIX
+        (void) may_map;
+
+        std::ifstream in(p.c_str(), std::ios::in | std::ios::binary);
+        if (!in) {
+                ec.assign(errno ? errno : EIO, system_category());
+                return SHA256::Hash();
+        }
+
+        std::unique_ptr<char[]> buf(new char[READ_BUFFER_SIZE]);
+
+        while (in.read(buf.get(), READ_BUFFER_SIZE) || in.gcount()) {
+                hasher.append(buf.get(), size_t(in.gcount()));
+        }
+
+        if (in.bad()) {
+                ec.assign(errno ? errno : EIO, system_category());
+                return SHA256::Hash();
+        }
+#endif
+
+        return hasher.hash();
+}
+
+//--------------------------------------
+
+WRUTIL_API SHA256::Hash
+sha256_file(
+        const path &p
+)
+{
+        fs_error_code ec;
+        SHA256::Hash  result = sha256_file(p, ec);
+        if (ec) {
+                throw filesystem_error("error hashing file", p, ec);
+        }
+        return result;
+}
+
+//--------------------------------------
+
+WRUTIL_API SHA256::Hash
+sha256_file(
+        const path    &p,
+        fs_error_code &ec
+)
+{
+        return hashFile(p, true, ec);
+}
+
+//--------------------------------------
+
+WRUTIL_API SHA256::Hash
+sha256_file_read(
+        const path &p
+)
+{
+        fs_error_code ec;
+        SHA256::Hash  result = sha256_file_read(p, ec);
+        if (ec) {
+                throw filesystem_error("error hashing file", p, ec);
+        }
+        return result;
+}
+
+//--------------------------------------
+
+WRUTIL_API SHA256::Hash
+sha256_file_read(
+        const path    &p,
+        fs_error_code &ec
+)
+{
+        return hashFile(p, false, ec);
+}
+
+
+} // namespace wr
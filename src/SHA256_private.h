@@ -0,0 +1,139 @@
+/**
+ * \file SHA256_private.h
+ *
+ * \brief Shared declarations for internal SHA-256 block functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_SHA256_PRIVATE_H
+#define WRUTIL_SHA256_PRIVATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wrutil/Config.h>
+#include <wrutil/SHA256.h>
+
+
+namespace wr {
+
+
+/*
+ * A block function processes `blocks` consecutive 64-byte message blocks
+ * starting at `data` (no alignment requirement) and updates `h` in place
+ */
+using SHA256BlockFn = void (*)(SHA256::Hash &h, const uint8_t *data,
+                               size_t blocks);
+
+/*
+ * A lanes function processes one 64-byte block for each of N independent
+ * messages; `state` holds the N hash states transposed (state[i][lane]
+ * is word i of that lane's hash)
+ */
+template <size_t N>
+using SHA256LanesFn = void (*)(uint32_t (&state)[8][N],
+                               const uint8_t *const (&blocks)[N]);
+
+extern const uint32_t SHA256_K[64];
+
+//--------------------------------------
+
+inline uint32_t loadBE32(const uint8_t *p)
+        { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16)
+                 | (uint32_t(p[2]) << 8) | uint32_t(p[3]); }
+
+inline uint32_t rotateRight(uint32_t x, unsigned bits)
+        { return (x >> bits) | (x << (32 - bits)); }
+
+inline uint32_t Ch(uint32_t x, uint32_t y, uint32_t z)
+        { return (x & y) ^ ((~x) & z); }
+
+inline uint32_t Maj(uint32_t x, uint32_t y, uint32_t z)
+        { return (x & y) ^ (x & z) ^ (y & z); }
+
+inline uint32_t SIGMA0(uint32_t x)
+        { return rotateRight(x, 2) ^ rotateRight(x, 13) ^ rotateRight(x, 22); }
+
+inline uint32_t SIGMA1(uint32_t x)
+        { return rotateRight(x, 6) ^ rotateRight(x, 11) ^ rotateRight(x, 25); }
+
+inline uint32_t sigma0(uint32_t x)
+        { return rotateRight(x, 7) ^ rotateRight(x, 18) ^ (x >> 3); }
+
+inline uint32_t sigma1(uint32_t x)
+        { return rotateRight(x, 17) ^ rotateRight(x, 19) ^ (x >> 10); }
+
+//--------------------------------------
+/*
+ * Runs the 64 compression rounds over a fully expanded message schedule;
+ * each element of `wk` holds W[j] + K[j]
+ */
+inline void
+sha256Rounds(
+        SHA256::Hash   &h,
+        const uint32_t *wk
+)
+{
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3],
+                 e = h[4], f = h[5], g = h[6], hh = h[7];
+
+        for (size_t j = 0; j < 64; ++j) {
+                uint32_t T1 = hh + SIGMA1(e) + Ch(e, f, g) + wk[j],
+                         T2 = SIGMA0(a) + Maj(a, b, c);
+                hh = g;
+                g = f;
+                f = e;
+                e = d + T1;
+                d = c;
+                c = b;
+                b = a;
+                a = T1 + T2;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+//--------------------------------------
+
+void sha256BlocksScalar(SHA256::Hash &h, const uint8_t *data, size_t blocks);
+
+#if WR_HAVE_X86_SHA_INTRINSICS
+bool haveX86ShaExtensions();
+bool haveX86Ssse3();
+bool haveX86Avx2();
+bool haveX86Avx512();
+void sha256BlocksX86Sha(SHA256::Hash &h, const uint8_t *data, size_t blocks);
+void sha256BlocksSsse3(SHA256::Hash &h, const uint8_t *data, size_t blocks);
+void sha256Lanes8Avx2(uint32_t (&state)[8][8],
+                      const uint8_t *const (&blocks)[8]);
+void sha256Lanes16Avx512(uint32_t (&state)[8][16],
+                         const uint8_t *const (&blocks)[16]);
+#endif
+
+#if WR_HAVE_ARM_SHA2_INTRINSICS
+bool haveArmSha2();
+void sha256BlocksArmSha2(SHA256::Hash &h, const uint8_t *data, size_t blocks);
+#endif
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_SHA256_PRIVATE_H
@@ -0,0 +1,547 @@
+/**
+ * \file SHA256_x86.cxx
+ *
+ * \brief x86-specific SHA-256 block functions (SHA extensions, SSSE3) and
+ *        multi-buffer lane functions (AVX2, AVX-512)
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <cpuid.h>
+#include <immintrin.h>
+#include "SHA256_private.h"
+
+
+namespace wr {
+
+
+static uint64_t
+xcr0()
+{
+        uint32_t lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return (uint64_t(hi) << 32) | lo;
+}
+
+//--------------------------------------
+/*
+ * Checks for CPUID.7.0:EBX `feature_bit`, provided the OS saves all of the
+ * register state indicated by `xcr0_mask`
+ */
+static bool
+haveX86ExtendedFeature(
+        unsigned feature_bit,
+        uint64_t xcr0_mask
+)
+{
+        unsigned a, b, c, d;
+
+        if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & (1u << 27))) { // OSXSAVE
+                return false;
+        }
+
+        if (((xcr0() & xcr0_mask) != xcr0_mask)
+                        || (__get_cpuid_max(0, nullptr) < 7)) {
+                return false;
+        }
+
+        __cpuid_count(7, 0, a, b, c, d);
+        return (b & (1u << feature_bit)) != 0;
+}
+
+//--------------------------------------
+
+bool
+haveX86ShaExtensions()
+{
+        unsigned a, b, c, d;
+
+        if (!haveX86Ssse3() || !__get_cpuid(1, &a, &b, &c, &d)
+                            || !(c & (1u << 19))) {     // SSE4.1
+                return false;
+        }
+
+        if (__get_cpuid_max(0, nullptr) < 7) {
+                return false;
+        }
+
+        __cpuid_count(7, 0, a, b, c, d);
+        return (b & (1u << 29)) != 0;                   // SHA
+}
+
+//--------------------------------------
+
+bool
+haveX86Ssse3()
+{
+        unsigned a, b, c, d;
+        return __get_cpuid(1, &a, &b, &c, &d) && (c & (1u << 9));
+}
+
+//--------------------------------------
+
+bool
+haveX86Avx2()
+{
+        return haveX86ExtendedFeature(5, 0x06);         // XMM, YMM state
+}
+
+//--------------------------------------
+
+bool
+haveX86Avx512()
+{
+        return haveX86ExtendedFeature(16, 0xe6);  // XMM, YMM, opmask, ZMM
+}
+
+//--------------------------------------
+/*
+ * Four rounds of SHA-256 using the SHA extensions; `cur` holds message
+ * words 4*I to 4*I+3, `prev` and `next` the groups either side of it
+ * (modulo 4). The schedule for later rounds is computed in place.
+ */
+template <int I>
+__attribute__((always_inline, target("sha,sse4.1"))) inline void
+x86ShaRounds4(
+        __m128i &state0,
+        __m128i &state1,
+        __m128i &cur,
+        __m128i &prev,
+        __m128i &next
+)
+{
+        __m128i msg = _mm_add_epi32(cur, _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(&SHA256_K[4 * I])));
+
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+        if ((I >= 3) && (I <= 14)) {
+                __m128i tmp = _mm_alignr_epi8(cur, prev, 4);
+                next = _mm_add_epi32(next, tmp);
+                next = _mm_sha256msg2_epu32(next, cur);
+        }
+
+        msg = _mm_shuffle_epi32(msg, 0x0e);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+        if ((I >= 1) && (I <= 12)) {
+                prev = _mm_sha256msg1_epu32(prev, cur);
+        }
+}
+
+//--------------------------------------
+
+__attribute__((target("sha,sse4.1"))) void
+sha256BlocksX86Sha(
+        SHA256::Hash  &h,
+        const uint8_t *data,
+        size_t         blocks
+)
+{
+        const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                             0x0405060700010203ULL);
+        __m128i       tmp, state0, state1, m0, m1, m2, m3;
+
+        // rearrange H into the ABEF/CDGH form used by SHA256RNDS2
+        tmp    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h[0]));
+        state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h[4]));
+        tmp    = _mm_shuffle_epi32(tmp, 0xb1);          // CDAB
+        state1 = _mm_shuffle_epi32(state1, 0x1b);       // EFGH
+        state0 = _mm_alignr_epi8(tmp, state1, 8);       // ABEF
+        state1 = _mm_blend_epi16(state1, tmp, 0xf0);    // CDGH
+
+        for (; blocks; --blocks, data += 64) {
+                __m128i abef_save = state0, cdgh_save = state1;
+                auto    in = reinterpret_cast<const __m128i *>(data);
+
+                m0 = _mm_shuffle_epi8(_mm_loadu_si128(in), bswap);
+                m1 = _mm_shuffle_epi8(_mm_loadu_si128(in + 1), bswap);
+                m2 = _mm_shuffle_epi8(_mm_loadu_si128(in + 2), bswap);
+                m3 = _mm_shuffle_epi8(_mm_loadu_si128(in + 3), bswap);
+
+                x86ShaRounds4<0> (state0, state1, m0, m3, m1);
+                x86ShaRounds4<1> (state0, state1, m1, m0, m2);
+                x86ShaRounds4<2> (state0, state1, m2, m1, m3);
+                x86ShaRounds4<3> (state0, state1, m3, m2, m0);
+                x86ShaRounds4<4> (state0, state1, m0, m3, m1);
+                x86ShaRounds4<5> (state0, state1, m1, m0, m2);
+                x86ShaRounds4<6> (state0, state1, m2, m1, m3);
+                x86ShaRounds4<7> (state0, state1, m3, m2, m0);
+                x86ShaRounds4<8> (state0, state1, m0, m3, m1);
+                x86ShaRounds4<9> (state0, state1, m1, m0, m2);
+                x86ShaRounds4<10>(state0, state1, m2, m1, m3);
+                x86ShaRounds4<11>(state0, state1, m3, m2, m0);
+                x86ShaRounds4<12>(state0, state1, m0, m3, m1);
+                x86ShaRounds4<13>(state0, state1, m1, m0, m2);
+                x86ShaRounds4<14>(state0, state1, m2, m1, m3);
+                x86ShaRounds4<15>(state0, state1, m3, m2, m0);
+
+                state0 = _mm_add_epi32(state0, abef_save);
+                state1 = _mm_add_epi32(state1, cdgh_save);
+        }
+
+        tmp    = _mm_shuffle_epi32(state0, 0x1b);       // FEBA
+        state1 = _mm_shuffle_epi32(state1, 0xb1);       // DCHG
+        state0 = _mm_blend_epi16(tmp, state1, 0xf0);    // DCBA
+        state1 = _mm_alignr_epi8(state1, tmp, 8);       // ABEF
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&h[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&h[4]), state1);
+}
+
+//--------------------------------------
+
+__attribute__((always_inline, target("ssse3"))) inline __m128i
+rotateRight(__m128i x, int bits)
+{
+        return _mm_or_si128(_mm_srli_epi32(x, bits),
+                            _mm_slli_epi32(x, 32 - bits));
+}
+
+//--------------------------------------
+/*
+ * Computes message schedule words W[t] to W[t+3] from x0-x3, which hold
+ * W[t-16] to W[t-1]
+ */
+__attribute__((always_inline, target("ssse3"))) inline __m128i
+ssse3Schedule4(
+        __m128i x0,
+        __m128i x1,
+        __m128i x2,
+        __m128i x3
+)
+{
+        __m128i w15 = _mm_alignr_epi8(x1, x0, 4),       // W[t-15..t-12]
+                w7  = _mm_alignr_epi8(x3, x2, 4),       // W[t-7..t-4]
+                s0  = _mm_xor_si128(_mm_xor_si128(rotateRight(w15, 7),
+                                                  rotateRight(w15, 18)),
+                                    _mm_srli_epi32(w15, 3)),
+                w   = _mm_add_epi32(_mm_add_epi32(x0, w7), s0),
+                lo  = _mm_set_epi32(0, 0, -1, -1);
+
+        // sigma1 depends on W[t-2], so do two words at a time
+        __m128i x = _mm_shuffle_epi32(x3, _MM_SHUFFLE(3, 3, 3, 2)),
+                s1 = _mm_xor_si128(_mm_xor_si128(rotateRight(x, 17),
+                                                 rotateRight(x, 19)),
+                                   _mm_srli_epi32(x, 10));
+        w = _mm_add_epi32(w, _mm_and_si128(s1, lo));
+
+        x  = _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 0, 0, 0));
+        s1 = _mm_xor_si128(_mm_xor_si128(rotateRight(x, 17),
+                                         rotateRight(x, 19)),
+                           _mm_srli_epi32(x, 10));
+        return _mm_add_epi32(w, _mm_andnot_si128(lo, s1));
+}
+
+//--------------------------------------
+
+__attribute__((target("ssse3"))) void
+sha256BlocksSsse3(
+        SHA256::Hash  &h,
+        const uint8_t *data,
+        size_t         blocks
+)
+{
+        const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                             0x0405060700010203ULL);
+        auto          k = reinterpret_cast<const __m128i *>(SHA256_K);
+        alignas(16) uint32_t wk[64];
+        auto                 out = reinterpret_cast<__m128i *>(wk);
+
+        for (; blocks; --blocks, data += 64) {
+                auto    in = reinterpret_cast<const __m128i *>(data);
+                __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128(in), bswap),
+                        x1 = _mm_shuffle_epi8(_mm_loadu_si128(in + 1), bswap),
+                        x2 = _mm_shuffle_epi8(_mm_loadu_si128(in + 2), bswap),
+                        x3 = _mm_shuffle_epi8(_mm_loadu_si128(in + 3), bswap);
+
+                _mm_store_si128(out,
+                                _mm_add_epi32(x0, _mm_loadu_si128(k)));
+                _mm_store_si128(out + 1,
+                                _mm_add_epi32(x1, _mm_loadu_si128(k + 1)));
+                _mm_store_si128(out + 2,
+                                _mm_add_epi32(x2, _mm_loadu_si128(k + 2)));
+                _mm_store_si128(out + 3,
+                                _mm_add_epi32(x3, _mm_loadu_si128(k + 3)));
+
+                for (size_t j = 4; j < 16; ++j) {
+                        __m128i w = ssse3Schedule4(x0, x1, x2, x3);
+                        _mm_store_si128(out + j, _mm_add_epi32(
+                                                w, _mm_loadu_si128(k + j)));
+                        x0 = x1;
+                        x1 = x2;
+                        x2 = x3;
+                        x3 = w;
+                }
+
+                sha256Rounds(h, wk);
+        }
+}
+
+
+//--------------------------------------
+/*
+ * Loads message words `first` to `first + 7` of eight blocks and
+ * transposes them so that out[i] holds word `first + i` of every block
+ */
+__attribute__((always_inline, target("avx2"))) inline void
+avx2LoadTransposed(
+        const uint8_t *const *blocks,
+        size_t                first,
+        __m256i             (&out)[8]
+)
+{
+        const __m256i bswap = _mm256_set_epi64x(
+                                0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+                                0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        __m256i r[8], t[8], u[8];
+
+        for (size_t i = 0; i < 8; ++i) {
+                r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256(
+                                reinterpret_cast<const __m256i *>(
+                                        blocks[i] + 4 * first)), bswap);
+        }
+
+        for (size_t i = 0; i < 8; i += 2) {
+                t[i]     = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+                t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+
+        for (size_t i = 0; i < 8; i += 4) {
+                u[i]     = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+                u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+                u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+                u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+        }
+
+        for (size_t i = 0; i < 4; ++i) {
+                out[i]     = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+                out[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+        }
+}
+
+//--------------------------------------
+
+__attribute__((always_inline, target("avx2"))) inline __m256i
+rotateRight(__m256i x, int bits)
+{
+        return _mm256_or_si256(_mm256_srli_epi32(x, bits),
+                               _mm256_slli_epi32(x, 32 - bits));
+}
+
+//--------------------------------------
+
+__attribute__((target("avx2"))) void
+sha256Lanes8Avx2(
+        uint32_t            (&state)[8][8],
+        const uint8_t *const (&blocks)[8]
+)
+{
+        __m256i w[16], s[8];
+
+        avx2LoadTransposed(blocks, 0, *reinterpret_cast<__m256i (*)[8]>(w));
+        avx2LoadTransposed(blocks, 8,
+                           *reinterpret_cast<__m256i (*)[8]>(w + 8));
+
+        for (size_t i = 0; i < 8; ++i) {
+                s[i] = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(state[i]));
+        }
+
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3],
+                e = s[4], f = s[5], g = s[6], h = s[7];
+
+        for (size_t j = 0; j < 64; ++j) {
+                __m256i wj = w[j & 15];
+
+                if (j >= 16) {
+                        __m256i w15 = w[(j - 15) & 15], w2 = w[(j - 2) & 15],
+                                s0 = _mm256_xor_si256(
+                                        _mm256_xor_si256(rotateRight(w15, 7),
+                                                         rotateRight(w15, 18)),
+                                        _mm256_srli_epi32(w15, 3)),
+                                s1 = _mm256_xor_si256(
+                                        _mm256_xor_si256(rotateRight(w2, 17),
+                                                         rotateRight(w2, 19)),
+                                        _mm256_srli_epi32(w2, 10));
+                        wj = _mm256_add_epi32(
+                                _mm256_add_epi32(wj, s0),
+                                _mm256_add_epi32(w[(j - 7) & 15], s1));
+                        w[j & 15] = wj;
+                }
+
+                __m256i S1 = _mm256_xor_si256(
+                                _mm256_xor_si256(rotateRight(e, 6),
+                                                 rotateRight(e, 11)),
+                                rotateRight(e, 25)),
+                        ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                              _mm256_andnot_si256(e, g)),
+                        T1 = _mm256_add_epi32(
+                                _mm256_add_epi32(h, S1),
+                                _mm256_add_epi32(
+                                        _mm256_add_epi32(ch, wj),
+                                        _mm256_set1_epi32(SHA256_K[j]))),
+                        S0 = _mm256_xor_si256(
+                                _mm256_xor_si256(rotateRight(a, 2),
+                                                 rotateRight(a, 13)),
+                                rotateRight(a, 22)),
+                        maj = _mm256_or_si256(
+                                _mm256_and_si256(a, b),
+                                _mm256_and_si256(c, _mm256_or_si256(a, b))),
+                        T2 = _mm256_add_epi32(S0, maj);
+
+                h = g;
+                g = f;
+                f = e;
+                e = _mm256_add_epi32(d, T1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm256_add_epi32(T1, T2);
+        }
+
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+
+        for (size_t i = 0; i < 8; ++i) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[i]),
+                                    s[i]);
+        }
+}
+
+//--------------------------------------
+/*
+ * The unmasked forms of these intrinsics pass an uninitialized vector as
+ * the merge source in GCC's headers before 12.3, which -Wall reports; the
+ * zero-masked forms with every lane selected are the same instructions
+ */
+template <int Bits>
+__attribute__((always_inline, target("avx512f"))) inline __m512i
+rotateRight(__m512i x)
+{
+        return _mm512_maskz_ror_epi32(0xffff, x, Bits);
+}
+
+template <int Bits>
+__attribute__((always_inline, target("avx512f"))) inline __m512i
+shiftRight(__m512i x)
+{
+        return _mm512_maskz_srli_epi32(0xffff, x, Bits);
+}
+
+__attribute__((always_inline, target("avx512f"))) inline __m512i
+combine(__m256i lo, __m256i hi)
+{
+        return _mm512_maskz_inserti64x4(0xff, _mm512_maskz_inserti64x4(
+                                0xff, _mm512_setzero_si512(), lo, 0), hi, 1);
+}
+
+//--------------------------------------
+
+__attribute__((target("avx512f"))) void
+sha256Lanes16Avx512(
+        uint32_t            (&state)[8][16],
+        const uint8_t *const (&blocks)[16]
+)
+{
+        __m512i w[16], s[8];
+
+        {
+                __m256i lo[16], hi[16];
+
+                avx2LoadTransposed(blocks, 0,
+                                   *reinterpret_cast<__m256i (*)[8]>(lo));
+                avx2LoadTransposed(blocks, 8,
+                                   *reinterpret_cast<__m256i (*)[8]>(lo + 8));
+                avx2LoadTransposed(blocks + 8, 0,
+                                   *reinterpret_cast<__m256i (*)[8]>(hi));
+                avx2LoadTransposed(blocks + 8, 8,
+                                   *reinterpret_cast<__m256i (*)[8]>(hi + 8));
+
+                for (size_t i = 0; i < 16; ++i) {
+                        w[i] = combine(lo[i], hi[i]);
+                }
+        }
+
+        for (size_t i = 0; i < 8; ++i) {
+                s[i] = _mm512_loadu_si512(state[i]);
+        }
+
+        __m512i a = s[0], b = s[1], c = s[2], d = s[3],
+                e = s[4], f = s[5], g = s[6], h = s[7];
+
+        // ternary logic immediates: XOR3 = 0x96, Ch = 0xca, Maj = 0xe8
+        for (size_t j = 0; j < 64; ++j) {
+                __m512i wj = w[j & 15];
+
+                if (j >= 16) {
+                        __m512i w15 = w[(j - 15) & 15], w2 = w[(j - 2) & 15],
+                                s0 = _mm512_ternarylogic_epi32(
+                                        rotateRight<7>(w15),
+                                        rotateRight<18>(w15),
+                                        shiftRight<3>(w15), 0x96),
+                                s1 = _mm512_ternarylogic_epi32(
+                                        rotateRight<17>(w2),
+                                        rotateRight<19>(w2),
+                                        shiftRight<10>(w2), 0x96);
+                        wj = _mm512_add_epi32(
+                                _mm512_add_epi32(wj, s0),
+                                _mm512_add_epi32(w[(j - 7) & 15], s1));
+                        w[j & 15] = wj;
+                }
+
+                __m512i S1 = _mm512_ternarylogic_epi32(
+                                rotateRight<6>(e), rotateRight<11>(e),
+                                rotateRight<25>(e), 0x96),
+                        ch = _mm512_ternarylogic_epi32(e, f, g, 0xca),
+                        T1 = _mm512_add_epi32(
+                                _mm512_add_epi32(h, S1),
+                                _mm512_add_epi32(
+                                        _mm512_add_epi32(ch, wj),
+                                        _mm512_set1_epi32(SHA256_K[j]))),
+                        S0 = _mm512_ternarylogic_epi32(
+                                rotateRight<2>(a), rotateRight<13>(a),
+                                rotateRight<22>(a), 0x96),
+                        maj = _mm512_ternarylogic_epi32(a, b, c, 0xe8),
+                        T2 = _mm512_add_epi32(S0, maj);
+
+                h = g;
+                g = f;
+                f = e;
+                e = _mm512_add_epi32(d, T1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm512_add_epi32(T1, T2);
+        }
+
+        s[0] = _mm512_add_epi32(s[0], a); s[1] = _mm512_add_epi32(s[1], b);
+        s[2] = _mm512_add_epi32(s[2], c); s[3] = _mm512_add_epi32(s[3], d);
+        s[4] = _mm512_add_epi32(s[4], e); s[5] = _mm512_add_epi32(s[5], f);
+        s[6] = _mm512_add_epi32(s[6], g); s[7] = _mm512_add_epi32(s[7], h);
+
+        for (size_t i = 0; i < 8; ++i) {
+                _mm512_storeu_si512(state[i], s[i]);
+        }
+}
+
+
+} // namespace wr
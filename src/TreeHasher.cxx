@@ -0,0 +1,617 @@
+/**
+ * \file TreeHasher.cxx
+ *
+ * \brief Implementation of the wr::TreeHasher class
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <wrutil/Config.h>
+
+#if WR_POSIX
+#       include <sys/stat.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <wrutil/TreeHasher.h>
+
+#if WR_HAVE_STD_FILESYSTEM
+#       include <system_error>
+#else
+#       include <boost/system/error_code.hpp>
+#endif
+
+
+namespace wr {
+
+
+#if WR_HAVE_STD_FILESYSTEM
+using std::system_category;
+#else
+using boost::system_category;
+#endif
+
+
+namespace {
+
+
+/*
+ * Identifies one version of a file's contents for the hash cache; on
+ * platforms without inode numbers `ino` holds a hash of the file's path
+ */
+struct FileKey
+{
+        uint64_t dev, ino, size;
+        int64_t  mtime_ns;
+
+        bool operator==(const FileKey &other) const
+                { return (dev == other.dev) && (ino == other.ino)
+                         && (size == other.size)
+                         && (mtime_ns == other.mtime_ns); }
+};
+
+struct FileKeyHash
+{
+        size_t operator()(const FileKey &k) const
+        {
+                uint64_t h = k.ino * 0x9e3779b97f4a7c15ull;
+                h ^= (k.dev + (h << 6) + (h >> 2));
+                h ^= (k.size + (h << 6) + (h >> 2));
+                h ^= (uint64_t(k.mtime_ns) + (h << 6) + (h >> 2));
+                return size_t(h);
+        }
+};
+
+using HashCache = std::unordered_map<FileKey, TreeHasher::Hash, FileKeyHash>;
+using CacheRecord = std::pair<FileKey, TreeHasher::Hash>;
+
+/*
+ * Cache files consist of this signature followed by fixed-size records,
+ * each holding a FileKey then a Hash in native byte order (the cache only
+ * means anything on the machine that wrote it)
+ */
+const char CACHE_SIGNATURE[16] = "wrutil-tree-v1\n";
+
+/*
+ * Files modified this recently are hashed but not cached, since a further
+ * change within the timestamp granularity would leave their key unchanged
+ */
+constexpr int64_t RACY_WINDOW_NS = int64_t(2) * 1000000000;
+
+//--------------------------------------
+
+struct Node
+{
+        Node                              *parent;
+        path                               p;
+        std::string                        name;  // UTF-8, for sorting
+        char                               type;  // 'f', 'd', 'l' or 'o'
+        std::atomic<size_t>                pending;  // unhashed children
+        std::vector<std::unique_ptr<Node>> children;
+        TreeHasher::Hash                   hash;
+
+        Node(Node *parent, const path &p, char type) :
+                parent(parent), p(p), type(type), pending(0), hash() {}
+};
+
+//--------------------------------------
+
+char
+typeCode(
+        const file_status &st
+)
+{
+        switch (st.type()) {
+        case file_type::regular:
+                return 'f';
+        case file_type::directory:
+                return 'd';
+        case file_type::symlink:
+                return 'l';
+        default:
+                return 'o';
+        }
+}
+
+//--------------------------------------
+
+void
+appendHash(
+        SHA256                 &hasher,
+        const TreeHasher::Hash &h
+)
+{
+        uint8_t bytes[32];
+
+        for (size_t i = 0; i < 8; ++i) {
+                bytes[4 * i]     = uint8_t(h[i] >> 24);
+                bytes[4 * i + 1] = uint8_t(h[i] >> 16);
+                bytes[4 * i + 2] = uint8_t(h[i] >> 8);
+                bytes[4 * i + 3] = uint8_t(h[i]);
+        }
+
+        hasher.append(bytes, sizeof(bytes));
+}
+
+//--------------------------------------
+
+void
+hashDirectory(
+        Node &dir
+)
+{
+        SHA256 hasher;
+
+        for (auto &child: dir.children) {
+                hasher.append(&child->type, 1);
+                hasher.append(child->name.data(), child->name.size() + 1);
+                if (child->type != 'o') {
+                        appendHash(hasher, child->hash);
+                }
+        }
+
+        dir.hash = hasher.hash();
+        dir.children.clear();  // no longer needed
+}
+
+//--------------------------------------
+
+void
+loadCache(
+        const path &cache_file,
+        HashCache  &cache
+)
+{
+        std::ifstream in(cache_file.c_str(), std::ios::in | std::ios::binary);
+        char          signature[sizeof(CACHE_SIGNATURE)];
+        CacheRecord   record;
+
+        if (!in.read(signature, sizeof(signature))
+                        || (memcmp(signature, CACHE_SIGNATURE,
+                                   sizeof(signature)) != 0)) {
+                return;  // missing or unrecognised: start afresh
+        }
+
+        while (in.read(reinterpret_cast<char *>(&record.first),
+                       sizeof(record.first))
+               && in.read(reinterpret_cast<char *>(record.second.data()),
+                          sizeof(record.second))) {
+                cache.insert(record);
+        }
+}
+
+//--------------------------------------
+/*
+ * Writes the cache to a temporary file that then replaces `cache_file`,
+ * so that concurrent readers never see a partially written cache; failure
+ * is not an error since the cache is only advisory
+ */
+void
+saveCache(
+        const path                     &cache_file,
+        const std::vector<CacheRecord> &records
+)
+{
+        fs_error_code ec;
+        path          tmp = cache_file;
+
+        tmp += unique_path(".%%%%-%%%%-%%%%", ec);
+        if (ec) {
+                return;
+        }
+
+        bool ok;
+        {
+                std::ofstream out(tmp.c_str(), std::ios::out
+                                                | std::ios::binary
+                                                | std::ios::trunc);
+                out.write(CACHE_SIGNATURE, sizeof(CACHE_SIGNATURE));
+                for (auto &record: records) {
+                        out.write(reinterpret_cast<const char *>(
+                                                &record.first),
+                                  sizeof(record.first));
+                        out.write(reinterpret_cast<const char *>(
+                                                record.second.data()),
+                                  sizeof(record.second));
+                }
+                out.close();
+                ok = !out.fail();
+        }
+
+        if (ok) {
+                rename(tmp, cache_file, ec);
+                ok = !ec;
+        }
+        if (!ok) {
+                remove(tmp, ec);
+        }
+}
+
+//--------------------------------------
+
+class Walk
+{
+public:
+        Walk(const HashCache &cache, int64_t now_ns) :
+                cache_(cache), now_ns_(now_ns), busy_(0), failed_(false) {}
+
+        void push(Node *node)
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queue_.push_back(node);
+        }
+
+        void work(std::vector<CacheRecord> &new_records);
+
+        void fail(const fs_error_code &ec, std::exception_ptr exc);
+
+        bool failed(fs_error_code &ec, std::exception_ptr &exc) const
+                { ec = ec_; exc = exc_; return failed_; }
+
+private:
+        void process(Node *node, std::vector<CacheRecord> &new_records);
+        void listDirectory(Node *dir);
+        void hashFile(Node *file, std::vector<CacheRecord> &new_records);
+        void complete(Node *node);
+
+        const HashCache         &cache_;
+        int64_t                  now_ns_;
+        std::mutex               mutex_;
+        std::condition_variable  cond_;
+        std::deque<Node *>       queue_;
+        unsigned                 busy_;
+        bool                     failed_;
+        fs_error_code            ec_;
+        std::exception_ptr       exc_;
+};
+
+//--------------------------------------
+/*
+ * Worker thread body; returns once the queue is empty and no other worker
+ * is busy (and so cannot add any more work)
+ */
+void
+Walk::work(
+        std::vector<CacheRecord> &new_records
+)
+{
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        for (;;) {
+                cond_.wait(lock, [this] {
+                        return !queue_.empty() || (busy_ == 0);
+                });
+
+                if (queue_.empty()) {
+                        cond_.notify_all();
+                        return;
+                }
+
+                Node *node = queue_.front();
+                queue_.pop_front();
+                ++busy_;
+                lock.unlock();
+
+                try {
+                        process(node, new_records);
+                } catch (const filesystem_error &e) {
+                        fail(e.code(), std::exception_ptr());
+                } catch (...) {
+                        fail(fs_error_code(), std::current_exception());
+                }
+
+                lock.lock();
+                --busy_;
+                if (!queue_.empty() || (busy_ == 0)) {
+                        cond_.notify_all();
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+Walk::process(
+        Node                     *node,
+        std::vector<CacheRecord> &new_records
+)
+{
+        switch (node->type) {
+        case 'd':
+                listDirectory(node);
+                break;
+        case 'f':
+                hashFile(node, new_records);
+                complete(node);
+                break;
+        case 'l': {
+                fs_error_code ec;
+                path          target = read_symlink(node->p, ec);
+                if (ec) {
+                        fail(ec, std::exception_ptr());
+                        return;
+                }
+                node->hash = SHA256().append(to_u8string(target)).hash();
+                complete(node);
+                break;
+        }
+        default:
+                complete(node);
+                break;
+        }
+}
+
+//--------------------------------------
+
+void
+Walk::listDirectory(
+        Node *dir
+)
+{
+        fs_error_code ec;
+
+        for (directory_iterator i(dir->p, ec), end; !ec && (i != end);
+                                                    i.increment(ec)) {
+                file_status st = i->symlink_status(ec);
+                if (ec) {
+                        break;
+                }
+                std::unique_ptr<Node> child(new Node(dir, i->path(),
+                                                     typeCode(st)));
+                child->name = to_u8string(child->p.filename());
+                dir->children.push_back(std::move(child));
+        }
+
+        if (ec) {
+                fail(ec, std::exception_ptr());
+                return;
+        }
+
+        std::sort(dir->children.begin(), dir->children.end(),
+                  [](const std::unique_ptr<Node> &a,
+                     const std::unique_ptr<Node> &b) {
+                        return a->name < b->name;
+                  });
+
+        std::vector<Node *> queued;
+
+        for (auto &child: dir->children) {
+                if (child->type != 'o') {
+                        queued.push_back(child.get());
+                }
+        }
+
+        if (queued.empty()) {
+                hashDirectory(*dir);
+                complete(dir);
+                return;
+        }
+
+        // dir must not be touched once its children are visible to
+        // other workers, as the last of them to finish hashes it
+        dir->pending = queued.size();
+        {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (failed_) {
+                        return;
+                }
+                queue_.insert(queue_.end(), queued.begin(), queued.end());
+        }
+        cond_.notify_all();
+}
+
+//--------------------------------------
+
+void
+Walk::hashFile(
+        Node                     *file,
+        std::vector<CacheRecord> &new_records
+)
+{
+        fs_error_code ec;
+        FileKey       key;
+
+#if WR_POSIX
+        struct stat st;
+
+        if (::lstat(file->p.c_str(), &st) != 0) {
+                throw filesystem_error("error hashing file", file->p,
+                                       fs_error_code(errno,
+                                                     system_category()));
+        }
+
+        key.dev = uint64_t(st.st_dev);
+        key.ino = uint64_t(st.st_ino);
+        key.size = uint64_t(st.st_size);
+#if WR_MACOS
+        key.mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000
+                       + st.st_mtimespec.tv_nsec;
+#else
+        key.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000
+                       + st.st_mtim.tv_nsec;
+#endif
+#else // !WR_POSIX
+        key.dev = 0;
+        key.ino = std::hash<path::string_type>()(file->p.native());
+        key.size = file_size(file->p);
+        key.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        last_write_time(file->p).time_since_epoch()).count();
+#endif
+
+        auto cached = cache_.find(key);
+
+        if (cached != cache_.end()) {
+                file->hash = cached->second;
+        } else {
+                file->hash = sha256_file(file->p);
+        }
+
+        if (key.mtime_ns < now_ns_ - RACY_WINDOW_NS) {
+                new_records.emplace_back(key, file->hash);
+        }
+}
+
+//--------------------------------------
+/*
+ * Called once `node` has been hashed; hashes each ancestor directory
+ * whose last outstanding child this was
+ */
+void
+Walk::complete(
+        Node *node
+)
+{
+        while ((node = node->parent) && (node->pending.fetch_sub(1) == 1)) {
+                hashDirectory(*node);
+        }
+}
+
+//--------------------------------------
+
+void
+Walk::fail(
+        const fs_error_code &ec,
+        std::exception_ptr   exc
+)
+{
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!failed_) {
+                failed_ = true;
+                ec_ = ec;
+                exc_ = exc;
+        }
+        queue_.clear();
+        cond_.notify_all();
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+WRUTIL_API TreeHasher::Hash
+TreeHasher::hash(
+        const path &root
+)
+{
+        fs_error_code ec;
+        Hash          result = hash(root, ec);
+        if (ec) {
+                throw filesystem_error("error hashing directory tree",
+                                       root, ec);
+        }
+        return result;
+}
+
+//--------------------------------------
+
+WRUTIL_API TreeHasher::Hash
+TreeHasher::hash(
+        const path    &root,
+        fs_error_code &ec
+)
+{
+        file_status st = symlink_status(root, ec);
+        if (ec) {
+                return Hash();
+        } else if (st.type() == file_type::not_found) {
+                ec.assign(ENOENT, system_category());
+                return Hash();
+        }
+
+        HashCache cache;
+
+        if (!cache_file_.empty()) {
+                loadCache(cache_file_, cache);
+        }
+
+        unsigned threads = threads_ ? threads_
+                                    : std::thread::hardware_concurrency();
+        if (threads == 0) {
+                threads = 1;
+        }
+
+        std::vector<std::vector<CacheRecord>> new_records(threads);
+        std::vector<std::thread>              workers;
+        Node                                  top(nullptr, root,
+                                                  typeCode(st));
+        Walk                                  walk(cache,
+                                                   int64_t(::time(nullptr))
+                                                   * 1000000000);
+
+        walk.push(&top);
+
+        try {
+                for (unsigned i = 1; i < threads; ++i) {
+                        workers.emplace_back(&Walk::work, &walk,
+                                             std::ref(new_records[i]));
+                }
+        } catch (...) {
+                // destroying a joinable std::thread calls std::terminate(),
+                // so stop and join the workers already started first
+                walk.fail(fs_error_code(), std::exception_ptr());
+                for (auto &worker: workers) {
+                        worker.join();
+                }
+                throw;
+        }
+        walk.work(new_records[0]);
+        for (auto &worker: workers) {
+                worker.join();
+        }
+
+        std::exception_ptr exc;
+
+        if (walk.failed(ec, exc)) {
+                if (exc) {
+                        std::rethrow_exception(exc);
+                }
+                return Hash();
+        }
+
+        if (!cache_file_.empty()) {
+                for (size_t i = 1; i < threads; ++i) {
+                        new_records[0].insert(new_records[0].end(),
+                                              new_records[i].begin(),
+                                              new_records[i].end());
+                }
+                saveCache(cache_file_, new_records[0]);
+        }
+
+        return top.hash;
+}
+
+
+} // namespace wr
@@ -0,0 +1,214 @@
+/**
+ * \file base64.cxx
+ *
+ * \brief Implementation of base64 encoding and decoding functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdint.h>
+#include <string.h>
+#include <wrutil/base64.h>
+
+
+namespace wr {
+
+
+static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                   "abcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static constexpr uint32_t INVALID = 0x01000000;
+
+//--------------------------------------
+/*
+ * Returns the six bits `c` stands for, or 64 if it is not in ALPHABET
+ */
+static constexpr uint32_t
+sextet(
+        unsigned c
+)
+{
+        return ((c >= 'A') && (c <= 'Z')) ? c - 'A'
+             : ((c >= 'a') && (c <= 'z')) ? c - 'a' + 26
+             : ((c >= '0') && (c <= '9')) ? c - '0' + 52
+             : (c == '+') ? 62
+             : (c == '/') ? 63
+             : 64;
+}
+
+//--------------------------------------
+/*
+ * `pair` maps each 12-bit group to its two output chars, so each three
+ * input bytes take two lookups; `decode[i]` maps a char in position i of
+ * a four-char group to its six bits shifted into place, or to INVALID, so
+ * a group decodes to the bitwise or of four lookups
+ *
+ * The tables are constant-initialized, being filled in at compile time by
+ * the macros below, as the codecs may be called by other static
+ * initializers
+ */
+static constexpr struct Base64Tables
+{
+        char     pair[4096][2];
+        uint32_t decode[4][256];
+} TABLES = {
+#define PAIR(i)         { ALPHABET[(i) >> 6], ALPHABET[(i) & 0x3f] }
+#define DECODE(pos, c)  ((sextet(c) < 64) ? sextet(c) << (18 - 6 * (pos)) \
+                                          : INVALID)
+#define X4(f, n)        f(n), f(n + 1), f(n + 2), f(n + 3)
+#define X16(f, n)       X4(f, n), X4(f, n + 4), X4(f, n + 8), X4(f, n + 12)
+#define X64(f, n)       X16(f, n), X16(f, n + 16), X16(f, n + 32), \
+                        X16(f, n + 48)
+#define X256(f, n)      X64(f, n), X64(f, n + 64), X64(f, n + 128), \
+                        X64(f, n + 192)
+#define X1024(f, n)     X256(f, n), X256(f, n + 256), X256(f, n + 512), \
+                        X256(f, n + 768)
+#define DECODE0(c)      DECODE(0, c)
+#define DECODE1(c)      DECODE(1, c)
+#define DECODE2(c)      DECODE(2, c)
+#define DECODE3(c)      DECODE(3, c)
+
+        { X1024(PAIR, 0), X1024(PAIR, 1024), X1024(PAIR, 2048),
+          X1024(PAIR, 3072) },
+        { { X256(DECODE0, 0) }, { X256(DECODE1, 0) },
+          { X256(DECODE2, 0) }, { X256(DECODE3, 0) } }
+
+#undef PAIR
+#undef DECODE
+#undef X4
+#undef X16
+#undef X64
+#undef X256
+#undef X1024
+#undef DECODE0
+#undef DECODE1
+#undef DECODE2
+#undef DECODE3
+};
+
+//--------------------------------------
+
+WRUTIL_API char *
+base64_encode(
+        const void *src,
+        size_t      size,
+        char       *dst
+)
+{
+        auto in = static_cast<const uint8_t *>(src);
+        auto end = in + size - (size % 3);
+
+        for (; in != end; in += 3, dst += 4) {
+                uint32_t bits = (uint32_t(in[0]) << 16)
+                                | (uint32_t(in[1]) << 8) | in[2];
+                memcpy(dst, TABLES.pair[bits >> 12], 2);
+                memcpy(dst + 2, TABLES.pair[bits & 0xfff], 2);
+        }
+
+        switch (size % 3) {
+        case 1:
+                *(dst++) = ALPHABET[in[0] >> 2];
+                *(dst++) = ALPHABET[(in[0] & 0x03) << 4];
+                *(dst++) = '=';
+                *(dst++) = '=';
+                break;
+        case 2:
+                *(dst++) = ALPHABET[in[0] >> 2];
+                *(dst++) = ALPHABET[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+                *(dst++) = ALPHABET[(in[1] & 0x0f) << 2];
+                *(dst++) = '=';
+                break;
+        }
+
+        return dst;
+}
+
+//--------------------------------------
+
+WRUTIL_API std::string
+base64_encode(
+        const void *src,
+        size_t      size
+)
+{
+        std::string result(base64_encoded_size(size), '\0');
+
+        if (size) {
+                base64_encode(src, size, &result[0]);
+        }
+        return result;
+}
+
+//--------------------------------------
+
+WRUTIL_API bool
+base64_decode(
+        const string_view &src,
+        void              *dst,
+        size_t            &size
+)
+{
+        auto   in = reinterpret_cast<const uint8_t *>(src.data());
+        size_t n = src.size();
+
+        if (((n & 3) == 0) && (n > 0) && (in[n - 1] == '=')) {
+                n -= (in[n - 2] == '=') ? 2 : 1;
+        }
+        if ((n & 3) == 1) {
+                return false;
+        }
+
+        auto     end = in + (n & ~size_t(3));
+        auto     out = static_cast<uint8_t *>(dst);
+        uint32_t check = 0;
+
+        for (; in != end; in += 4, out += 3) {
+                uint32_t bits = TABLES.decode[0][in[0]]
+                                | TABLES.decode[1][in[1]]
+                                | TABLES.decode[2][in[2]]
+                                | TABLES.decode[3][in[3]];
+                check |= bits;
+                out[0] = uint8_t(bits >> 16);
+                out[1] = uint8_t(bits >> 8);
+                out[2] = uint8_t(bits);
+        }
+
+        if (n & 3) {
+                uint32_t bits = TABLES.decode[0][in[0]]
+                                | TABLES.decode[1][in[1]];
+                if ((n & 3) == 3) {
+                        bits |= TABLES.decode[2][in[2]];
+                }
+                check |= bits;
+                *(out++) = uint8_t(bits >> 16);
+                if ((n & 3) == 3) {
+                        *(out++) = uint8_t(bits >> 8);
+                }
+        }
+
+        if (check & INVALID) {
+                return false;
+        }
+
+        size = size_t(out - static_cast<uint8_t *>(dst));
+        return true;
+}
+
+
+} // namespace wr
@@ -0,0 +1,531 @@
+/**
+ * \file codecvt_charset.cxx
+ *
+ * \brief Conversion between UTF-8 and arbitrary charsets using iconv(3)
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <errno.h>
+#include <iconv.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <wrutil/codecvt.h>
+#include <wrutil/ctype.h>  // for wr::INVALID_CHAR
+#include <wrutil/utf8.h>
+
+
+namespace wr {
+
+
+namespace {
+
+
+enum
+{
+        MAX_HANDLES = 8  // per thread
+};
+
+enum class Status
+{
+        OK,
+        OUTPUT_FULL,
+        INCOMPLETE,     // input ends part way through a sequence
+        INVALID
+};
+
+const char UTF8[] = "UTF-8";
+
+//--------------------------------------
+/*
+ * POSIX declares the input argument of iconv() as char ** but some
+ * implementations (including older versions of GNU libiconv) declare it
+ * as const char **
+ */
+template <typename In> size_t
+callIconv(
+        size_t      (*fn)(iconv_t, In, size_t *, char **, size_t *),
+        iconv_t       cd,
+        const char  **in,
+        size_t       *in_left,
+        char        **out,
+        size_t       *out_left
+)
+{
+        return fn(cd, const_cast<In>(in), in_left, out, out_left);
+}
+
+//--------------------------------------
+
+Status
+convert(
+        iconv_t      cd,
+        const char *&from,
+        const char  *from_end,
+        char       *&to,
+        char        *to_end
+)
+{
+        size_t in_left = size_t(from_end - from),
+               out_left = size_t(to_end - to);
+
+        if (callIconv(::iconv, cd, &from, &in_left, &to, &out_left)
+                                                        != size_t(-1)) {
+                return Status::OK;
+        }
+
+        switch (errno) {
+        case E2BIG:
+                return Status::OUTPUT_FULL;
+        case EINVAL:
+                return Status::INCOMPLETE;
+        default:  // EILSEQ
+                return Status::INVALID;
+        }
+}
+
+//--------------------------------------
+/*
+ * Writes any sequence needed to return `cd` to its initial shift state
+ */
+Status
+flush(
+        iconv_t  cd,
+        char   *&to,
+        char    *to_end
+)
+{
+        size_t out_left = size_t(to_end - to);
+
+        if (::iconv(cd, nullptr, nullptr, &to, &out_left) != size_t(-1)) {
+                return Status::OK;
+        }
+        return (errno == E2BIG) ? Status::OUTPUT_FULL : Status::INVALID;
+}
+
+//--------------------------------------
+/*
+ * Returns false if converting to the charset with `cd` can leave a shift
+ * state to be undone, or if a character's conversion depends on what was
+ * converted before it (as with a byte order mark), either of which would
+ * need iconv state to be carried between codecvt calls. Each sample
+ * character the charset can represent is converted once and twice over
+ * from the initial state; a stateless charset needs no reset sequence and
+ * converts the pair to the single conversion repeated.
+ */
+bool
+isStateless(
+        iconv_t cd
+)
+{
+        static const char *const SAMPLES[] = {
+                "a", "\xc3\xa9", "\xce\xb1", "\xd0\x96", "\xd7\xa9",
+                "\xd8\xb9", "\xe0\xb8\x81", "\xe3\x81\x82",
+                "\xe6\x97\xa5", "\xea\xb0\x80", "\xf0\x9f\x98\x80"
+        };
+
+        for (auto sample: SAMPLES) {
+                std::string twice = std::string(sample) + sample;
+                char        once_buf[64], twice_buf[64];
+                char       *once_end = once_buf, *twice_end = twice_buf;
+                const char *in = sample;
+
+                ::iconv(cd, nullptr, nullptr, nullptr, nullptr);
+                if (convert(cd, in, sample + strlen(sample), once_end,
+                            once_buf + sizeof(once_buf)) != Status::OK) {
+                        continue;  // not representable
+                }
+
+                char *flush_start = once_end;
+                if ((flush(cd, once_end, once_buf + sizeof(once_buf))
+                                                        != Status::OK)
+                                || (once_end != flush_start)) {
+                        return false;
+                }
+
+                in = twice.data();
+                ::iconv(cd, nullptr, nullptr, nullptr, nullptr);
+                if ((convert(cd, in, in + twice.size(), twice_end,
+                             twice_buf + sizeof(twice_buf)) != Status::OK)
+                                || (flush(cd, twice_end,
+                                          twice_buf + sizeof(twice_buf))
+                                                        != Status::OK)) {
+                        return false;
+                }
+
+                size_t once_len = size_t(once_end - once_buf);
+                if ((size_t(twice_end - twice_buf) != 2 * once_len)
+                                || memcmp(twice_buf, once_buf, once_len)
+                                || memcmp(twice_buf + once_len, once_buf,
+                                          once_len)) {
+                        return false;
+                }
+        }
+
+        ::iconv(cd, nullptr, nullptr, nullptr, nullptr);
+        return true;
+}
+
+//--------------------------------------
+/*
+ * Opening an iconv handle is costly, so each thread keeps those it has
+ * used most recently
+ */
+class HandleCache
+{
+public:
+        HandleCache() = default;
+        HandleCache(const HandleCache &other) = delete;
+        ~HandleCache();
+
+        HandleCache &operator=(const HandleCache &other) = delete;
+
+        // returns a handle in its initial state
+        iconv_t get(const char *from, const char *to);
+
+private:
+        struct Entry
+        {
+                std::string from, to;
+                iconv_t     cd;
+        };
+
+        std::vector<Entry> entries_;  // most recently used first
+};
+
+//--------------------------------------
+
+HandleCache::~HandleCache()
+{
+        for (auto &entry: entries_) {
+                iconv_close(entry.cd);
+        }
+}
+
+//--------------------------------------
+
+iconv_t
+HandleCache::get(
+        const char *from,
+        const char *to
+)
+{
+        for (auto i = entries_.begin(); i != entries_.end(); ++i) {
+                if ((i->to == to) && (i->from == from)) {
+                        std::rotate(entries_.begin(), i, i + 1);
+                        iconv_t cd = entries_.front().cd;
+                        ::iconv(cd, nullptr, nullptr, nullptr, nullptr);
+                        return cd;
+                }
+        }
+
+        iconv_t cd = iconv_open(to, from);
+        if (cd == iconv_t(-1)) {
+                throw std::invalid_argument(
+                        std::string("wr: no conversion from charset \"")
+                                + from + "\" to \"" + to + '"');
+        }
+
+        try {
+                entries_.insert(entries_.begin(), Entry { from, to, cd });
+        } catch (...) {
+                iconv_close(cd);
+                throw;
+        }
+
+        if (entries_.size() > MAX_HANDLES) {
+                iconv_close(entries_.back().cd);
+                entries_.pop_back();
+        }
+        return cd;
+}
+
+//--------------------------------------
+
+HandleCache &
+handles()
+{
+        static thread_local HandleCache cache;
+        return cache;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+WRUTIL_API std::locale::id codecvt_charset::id;
+
+//--------------------------------------
+
+WRUTIL_API
+codecvt_charset::codecvt_charset(
+        const char  *charset,
+        std::size_t  refs
+) :
+        base_type(refs),
+        charset_ (charset),
+        noconv_  (is_utf8(charset))
+{
+        if (!noconv_) {  // check that both conversions are supported
+                handles().get(charset, UTF8);
+                if (!isStateless(handles().get(UTF8, charset))) {
+                        throw std::invalid_argument(
+                                std::string("wr: charset \"") + charset
+                                        + "\" is stateful, use"
+                                          " wr::transcode() instead");
+                }
+        }
+}
+
+//--------------------------------------
+
+WRUTIL_API
+codecvt_charset::~codecvt_charset() = default;
+
+//--------------------------------------
+/*
+ * Characters that the charset cannot represent are replaced by '?',
+ * converted to the charset in case it is not ASCII-compatible
+ */
+WRUTIL_API auto
+codecvt_charset::do_out(
+        state_type         &state,
+        const intern_type  *from,
+        const intern_type  *from_end,
+        const intern_type *&from_next,
+        extern_type        *to,
+        extern_type        *to_end,
+        extern_type       *&to_next
+) const -> result
+{
+        (void) state;
+
+        if (noconv_) {
+                return noconv;
+        }
+
+        iconv_t cd = handles().get(UTF8, charset_.c_str());
+
+        from_next = from;
+        to_next = to;
+
+        while (true) {
+                switch (convert(cd, from_next, from_end, to_next, to_end)) {
+                case Status::OK:
+                        return ok;
+                case Status::OUTPUT_FULL:
+                case Status::INCOMPLETE:
+                        return partial;
+                case Status::INVALID:
+                        break;
+                }
+
+                auto p = reinterpret_cast<const uint8_t *>(from_next),
+                     end = reinterpret_cast<const uint8_t *>(from_end);
+                const uint8_t *next;
+                char32_t       c = utf8_char(p, end, &next);
+
+                if ((c == INVALID_CHAR) && ((next - p != 3)
+                                || (memcmp(p, "\xef\xbf\xbd", 3) != 0))) {
+                        return error;  // not valid UTF-8
+                }
+
+                const char *q = "?";
+                if (convert(cd, q, q + 1, to_next, to_end) != Status::OK) {
+                        return partial;
+                }
+                from_next = reinterpret_cast<const intern_type *>(next);
+        }
+}
+
+//--------------------------------------
+
+WRUTIL_API auto
+codecvt_charset::do_in(
+        state_type         &state,
+        const extern_type  *from,
+        const extern_type  *from_end,
+        const extern_type *&from_next,
+        intern_type        *to,
+        intern_type        *to_end,
+        intern_type       *&to_next
+) const -> result
+{
+        (void) state;
+
+        if (noconv_) {
+                return noconv;
+        }
+
+        iconv_t cd = handles().get(charset_.c_str(), UTF8);
+
+        from_next = from;
+        to_next = to;
+
+        switch (convert(cd, from_next, from_end, to_next, to_end)) {
+        case Status::OK:
+                return ok;
+        case Status::OUTPUT_FULL:
+        case Status::INCOMPLETE:
+                return partial;
+        default:
+                return error;
+        }
+}
+
+//--------------------------------------
+
+WRUTIL_API auto
+codecvt_charset::do_unshift(
+        state_type   &state,
+        extern_type  *to,
+        extern_type  *to_end,
+        extern_type *&to_next
+) const -> result
+{
+        (void) state;
+        (void) to_end;
+
+        to_next = to;
+        return noconv;  // every call starts and ends in the initial state
+}
+
+//--------------------------------------
+
+WRUTIL_API int
+codecvt_charset::do_encoding() const noexcept
+{
+        return noconv_ ? 1 : 0;
+}
+
+//--------------------------------------
+
+WRUTIL_API bool
+codecvt_charset::do_always_noconv() const noexcept
+{
+        return noconv_;
+}
+
+//--------------------------------------
+/*
+ * Counts the input that converts to no more than `max` bytes of UTF-8 by
+ * converting it into a scratch buffer
+ */
+WRUTIL_API int
+codecvt_charset::do_length(
+        state_type        &state,
+        const extern_type *from,
+        const extern_type *from_end,
+        std::size_t        max
+) const
+{
+        (void) state;
+
+        if (noconv_) {
+                return static_cast<int>(
+                      std::min(static_cast<std::size_t>(from_end - from), max));
+        }
+
+        iconv_t     cd = handles().get(charset_.c_str(), UTF8);
+        const char *from_next = from;
+        char        buf[1024];
+
+        while ((max > 0) && (from_next < from_end)) {
+                char *to = buf;
+                auto  status = convert(cd, from_next, from_end, to,
+                                       buf + std::min(max, sizeof(buf)));
+
+                max -= size_t(to - buf);
+                if ((status != Status::OUTPUT_FULL) || (to == buf)) {
+                        break;
+                }
+        }
+
+        return static_cast<int>(from_next - from);
+}
+
+//--------------------------------------
+/*
+ * No stateless charset known to iconv needs more than four bytes for a
+ * character (UTF-32, GB18030 and EUC-TW being the longest), while each
+ * character's UTF-8 takes at least one
+ */
+WRUTIL_API int
+codecvt_charset::do_max_length() const noexcept
+{
+        return 4;
+}
+
+//--------------------------------------
+/*
+ * The output grows geometrically, conversion continuing from where it
+ * ran out of space
+ */
+WRUTIL_API std::string &
+transcode(
+        const char        *from,
+        const char        *to,
+        const string_view &in,
+        std::string       &out
+)
+{
+        iconv_t     cd = handles().get(from, to);
+        size_t      start = out.size();
+        const char *in_next = in.data(), *in_end = in_next + in.size();
+        Status      status;
+
+        out.resize(start + in.size() + 16);
+
+        char *out_next = &out[0] + start;
+
+        auto grow = [&] {
+                size_t used = size_t(out_next - &out[0]);
+                out.resize(out.size() * 2);
+                out_next = &out[0] + used;
+        };
+
+        while ((status = convert(cd, in_next, in_end, out_next,
+                                 &out[0] + out.size()))
+                                        == Status::OUTPUT_FULL) {
+                grow();
+        }
+        if (status == Status::OK) {
+                while ((status = flush(cd, out_next, &out[0] + out.size()))
+                                        == Status::OUTPUT_FULL) {
+                        grow();
+                }
+        }
+
+        if (status != Status::OK) {
+                out.resize(start);
+                throw std::range_error(std::string("wr::transcode: invalid or"
+                                " incomplete input for conversion from \"")
+                                + from + "\" to \"" + to + '"');
+        }
+
+        out.resize(size_t(out_next - &out[0]));
+        return out;
+}
+
+
+} // namespace wr
@@ -24,8 +24,15 @@
  * \endparblock
  */
 #include <ctype.h>
+#include <string.h>
+#include <wchar.h>
 #include <algorithm>
+#include <memory>
 #include <type_traits>
+#include <wrutil/Config.h>
+#ifdef __SSE2__
+#       include <emmintrin.h>
+#endif
 #include <wrutil/codecvt.h>
 
 
@@ -44,8 +51,10 @@ struct codecvt_utf8_narrow::Body
 #endif
         std::locale                                        narrow_loc_;
         const std::codecvt<wchar_t, char, std::mbstate_t> &narrow_;
+        bool                                               ascii_;
 
         Body(std::locale loc);
+        Body(std::locale loc, bool ascii);
 
         template <typename FromCvt, typename ToCvt>
                 auto do_inout(state_type &state, const FromCvt &from_cvt,
@@ -54,9 +63,103 @@ struct codecvt_utf8_narrow::Body
                               const intern_type *&from_next,
                               const ToCvt &to_cvt, extern_type *to,
                               extern_type *to_end,
-                              extern_type *&to_next) -> result;
+                              extern_type *&to_next,
+                              bool utf8_input) -> result;
 };
 
+//-------------------------------------
+/*
+ * ASCII characters other than the shift and escape codes used by
+ * stateful encodings such as ISO-2022 (which are left to the converter
+ * facets) can be copied between UTF-8 and an ASCII-compatible encoding
+ */
+static inline bool
+isPassThrough(
+        unsigned char c
+)
+{
+        return (c < 0x80) && (c != 0x0e) && (c != 0x0f) && (c != 0x1b);
+}
+
+//-------------------------------------
+
+static size_t
+passThroughPrefix(
+        const char *s,
+        const char *end
+)
+{
+        const char *p = s;
+
+#ifdef __SSE2__
+        const __m128i so = _mm_set1_epi8(0x0e), si = _mm_set1_epi8(0x0f),
+                      esc = _mm_set1_epi8(0x1b);
+
+        for (; end - p >= 16; p += 16) {
+                __m128i chars = _mm_loadu_si128(
+                                        reinterpret_cast<const __m128i *>(p)),
+                        stop = _mm_or_si128(
+                                _mm_or_si128(_mm_cmpeq_epi8(chars, so),
+                                             _mm_cmpeq_epi8(chars, si)),
+                                _mm_or_si128(_mm_cmpeq_epi8(chars, esc),
+                                             chars));
+                if (_mm_movemask_epi8(stop)) {
+                        break;  // find which below
+                }
+        }
+#endif
+
+        while ((p != end) && isPassThrough(static_cast<unsigned char>(*p))) {
+                ++p;
+        }
+        return size_t(p - s);
+}
+
+//-------------------------------------
+/*
+ * Checks that every pass-through character converts to and from the
+ * narrow encoding unchanged
+ */
+static bool
+isAsciiCompatible(
+        const std::codecvt<wchar_t, char, std::mbstate_t> &cvt
+)
+{
+        char    narrow[0x80], back[0x80];
+        wchar_t wide[0x80];
+        size_t  n = 0;
+
+        for (int c = 1; c < 0x80; ++c) {
+                if (isPassThrough(static_cast<unsigned char>(c))) {
+                        narrow[n++] = static_cast<char>(c);
+                }
+        }
+
+        std::mbstate_t  state = std::mbstate_t();
+        const char     *narrow_next;
+        wchar_t        *wide_next;
+
+        if ((cvt.in(state, narrow, narrow + n, narrow_next,
+                        wide, wide + n, wide_next) != std::codecvt_base::ok)
+                        || (wide_next != wide + n)) {
+                return false;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+                if (wide[i] != static_cast<wchar_t>(narrow[i])) {
+                        return false;
+                }
+        }
+
+        const wchar_t *wide_next_c;
+        char          *back_next;
+
+        state = std::mbstate_t();
+        return (cvt.out(state, wide, wide + n, wide_next_c,
+                            back, back + n, back_next) == std::codecvt_base::ok)
+                && (back_next == back + n) && (memcmp(narrow, back, n) == 0);
+}
+
 //-------------------------------------
 
 WRUTIL_API std::locale::id codecvt_utf8_narrow::id;
@@ -79,14 +182,31 @@ WRUTIL_API
 codecvt_utf8_narrow::codecvt_utf8_narrow(
         std::size_t refs
 ) :
-        codecvt_utf8_narrow(std::locale(""), refs)
+        base_type(refs),
+        body_    (nullptr)
 {
+        auto native = get_native_charset();
+
+        if (!native->utf8) {
+                body_ = new Body(native->locale, native->ascii_compatible);
+        }
 }
 
 //--------------------------------------
 
 codecvt_utf8_narrow::Body::Body(
         std::locale loc
+) :
+        Body(loc, isAsciiCompatible(std::use_facet<std::codecvt<wchar_t, char,
+                                                std::mbstate_t>>(loc)))
+{
+}
+
+//--------------------------------------
+
+codecvt_utf8_narrow::Body::Body(
+        std::locale loc,
+        bool        ascii
 ) :
 #if !WR_WINDOWS && !defined(__STDC_ISO_10646__)
         utf8_loc_  ("en_US.utf8"),
@@ -95,7 +215,8 @@ codecvt_utf8_narrow::Body::Body(
 #endif
         narrow_loc_(loc),
         narrow_    (std::use_facet<std::codecvt<wchar_t, char,
-                                                std::mbstate_t>>(narrow_loc_))
+                                                std::mbstate_t>>(narrow_loc_)),
+        ascii_     (ascii)
 {
 }
 
@@ -108,6 +229,23 @@ codecvt_utf8_narrow::~codecvt_utf8_narrow()
 
 //--------------------------------------
 
+/*
+ * Converts via wchar_t a run of up to PIVOT_SIZE characters at a time,
+ * limited to the space left for output (every character converts to at
+ * least one byte).  If the output for the run turns out not to fit, the
+ * input is converted again up to the last character that did, which sets
+ * `from_next` and `state` precisely.
+ *
+ * Only as much input as the run can need is passed to from_cvt.in(), as
+ * some implementations scan the whole input range on every call.
+ *
+ * If the narrow encoding is ASCII-compatible, runs of ASCII characters
+ * are copied straight through, leaving only the rest to the pivot.  A
+ * UTF-8 byte below 0x80 is always a whole character, so when converting
+ * from UTF-8 a pivot run also ends at the next ASCII character; in a
+ * multibyte narrow encoding such a byte may be part of a character, so
+ * the other way the next run begins wherever the pivot run ends.
+ */
 template <typename FromCvt, typename ToCvt> auto
 codecvt_utf8_narrow::Body::do_inout(
         state_type         &state,
@@ -118,61 +256,103 @@ codecvt_utf8_narrow::Body::do_inout(
         const ToCvt        &to_cvt,
         extern_type        *to,
         extern_type        *to_end,
-        extern_type       *&to_next
+        extern_type       *&to_next,
+        bool                 utf8_input
 ) -> result
 {
+        enum { PIVOT_SIZE = 256 };
+
         from_next = from;
         to_next = to;
 
-        wchar_t  pivot[2],  // array size of 2 for platforms with 16-bit wchar_t
-                *pivot_pos = &pivot[0];
+        wchar_t pivot[PIVOT_SIZE];
 
         while ((from_next < from_end) && (to_next < to_end)) {
+                if (ascii_ && mbsinit(&state)) {
+                        auto   limit = std::min(from_end - from_next,
+                                                    to_end - to_next);
+                        size_t n = passThroughPrefix(from_next,
+                                                     from_next + limit);
+                        memcpy(to_next, from_next, n);
+                        from_next += n;
+                        to_next += n;
+                        if ((from_next == from_end) || (to_next == to_end)) {
+                                break;
+                        }
+                }
+
                 from = from_next;
 
-                result res = from_cvt.in(state, from, from_end, from_next,
-                                         pivot_pos, pivot_pos + 1, pivot_pos);
-                switch (res) {
-                case error: case noconv:
+                // at least two elements for UTF-16 surrogate pairs
+                auto        pivot_size = std::max<ptrdiff_t>(
+                                std::min<ptrdiff_t>(PIVOT_SIZE,
+                                                    to_end - to_next), 2);
+                auto        chunk_end = from + std::min<ptrdiff_t>(
+                                        from_end - from,
+                                        pivot_size * from_cvt.max_length());
+                if (ascii_ && utf8_input) {
+                        chunk_end = std::find_if(from + 1, chunk_end,
+                                        [](char c) { return (c & 0x80) == 0; });
+                }
+                state_type  prev_state = state;
+                wchar_t    *pivot_end;
+
+                result res = from_cvt.in(state, from, chunk_end, from_next,
+                                         pivot, pivot + pivot_size,
+                                         pivot_end);
+                if (res == noconv) {
                         return res;
-                case partial:
-                        if (from_next == from_end) {
-                                return res;     // need more input
-                        } else if ((pivot_pos == &pivot[1])
-                                        && (pivot[0] >= 0xd800)
-                                        && (pivot[0] <= 0xdbff)) {
-                                continue;       /* two-part UTF-16 sequence;
-                                                   get low surrogate */
-                        } else {
-                                break;          // got a full character
+                } else if (pivot_end == pivot) {
+                        if ((res != error) && (from_next != from)) {
+                                continue;  // input absorbed into state
+                        } else if ((res == partial) && (chunk_end < from_end)) {
+                                return error;  // cut short by ASCII
                         }
-                case ok:
-                        break;
+                        // invalid or incomplete sequence at start of input
+                        return (res == ok) ? partial : res;
                 }
 
-                const wchar_t *pivot_cend;
-                std::mbstate_t to_state = { 0 };
-                res = to_cvt.out(to_state, &pivot[0], pivot_pos, pivot_cend,
-                                 to_next, to_end, to_next);
-                pivot_pos = &pivot[0];
+                const wchar_t  *pivot_next = pivot;
+                std::mbstate_t  to_state = { 0 };
+                result          out_res;
 
-                switch (res) {
-                case noconv:
-                        return res;
-                case error:
-                        if (to_next < to_end) {
-                                *to_next++ = '?';
+                for (;;) {
+                        out_res = to_cvt.out(to_state, pivot_next, pivot_end,
+                                             pivot_next, to_next, to_end,
+                                             to_next);
+                        if ((out_res != error) || (to_next == to_end)) {
+                                break;
                         }
-                        break;
-                case partial:
-                        from_next = from;
-                        return res;
-                case ok:
-                        break;
+                        // not representable in the target encoding
+                        *to_next++ = '?';
+                        ++pivot_next;
+                }
+
+                if (out_res == noconv) {
+                        return out_res;
+                } else if (pivot_next != pivot_end) {
+                        // output full, or a surrogate pair split between
+                        // runs; consume only the input for what was output
+                        state = prev_state;
+                        const wchar_t *pivot_cend = pivot_next;
+                        from_cvt.in(state, from, chunk_end, from_next,
+                                    pivot, pivot + (pivot_cend - pivot),
+                                    pivot_end);
+                        if (from_next == from) {
+                                return partial;
+                        }
+                        continue;
+                }
+
+                if (res == error) {
+                        return res;  // from_next is at the invalid sequence
+                } else if ((res == partial) && (chunk_end == from_end)
+                                && (pivot_end < pivot + pivot_size)) {
+                        return res;  // incomplete sequence at end of input
                 }
         }
 
-        return ok;
+        return (from_next < from_end) ? partial : ok;
 }
 
 //--------------------------------------
@@ -193,7 +373,7 @@ codecvt_utf8_narrow::do_out(
         }
 
         return body_->do_inout(state, body_->utf8_, from, from_end, from_next,
-                               body_->narrow_, to, to_end, to_next);
+                               body_->narrow_, to, to_end, to_next, true);
 }
 
 //--------------------------------------
@@ -214,7 +394,7 @@ codecvt_utf8_narrow::do_in(
         }
 
         return body_->do_inout(state, body_->narrow_, from, from_end, from_next,
-                               body_->utf8_, to, to_end, to_next);
+                               body_->utf8_, to, to_end, to_next, false);
 }
 
 //--------------------------------------
@@ -278,6 +458,93 @@ codecvt_utf8_narrow::do_length(
         return -1;
 }
 
+//--------------------------------------
+/*
+ * Every character takes at least one byte in the narrow encoding, and a
+ * single-byte character always lies in the BMP, taking at most three
+ * bytes in UTF-8
+ */
+WRUTIL_API std::size_t
+codecvt_utf8_narrow::max_utf8_size(
+        std::size_t n
+) const
+{
+        return body_ ? 3 * n : n;
+}
+
+//--------------------------------------
+/*
+ * Every character, or invalid byte replaced by '?', takes at least one
+ * byte in UTF-8
+ */
+WRUTIL_API std::size_t
+codecvt_utf8_narrow::max_narrow_size(
+        std::size_t n
+) const
+{
+        if (!body_) {
+                return n;
+        }
+        return n * static_cast<std::size_t>(body_->narrow_.max_length());
+}
+
+//--------------------------------------
+
+static std::shared_ptr<const native_charset> &
+nativeCharset()
+{
+        static std::shared_ptr<const native_charset> charset;
+        return charset;
+}
+
+//--------------------------------------
+
+static std::shared_ptr<const native_charset>
+examineNativeCharset()
+{
+        auto charset = std::make_shared<native_charset>();
+
+        charset->locale = std::locale("");
+        charset->utf8 = is_utf8(charset->locale);
+        charset->ascii_compatible = charset->utf8
+                || isAsciiCompatible(
+                        std::use_facet<std::codecvt<wchar_t, char,
+                                                    std::mbstate_t>>(
+                                charset->locale));
+        return charset;
+}
+
+//--------------------------------------
+/*
+ * Threads racing to examine the charset first all use the result stored
+ * by the winner
+ */
+WRUTIL_API std::shared_ptr<const native_charset>
+get_native_charset()
+{
+        auto charset = std::atomic_load(&nativeCharset());
+
+        if (!charset) {
+                std::shared_ptr<const native_charset> mine, none;
+
+                mine = examineNativeCharset();
+                charset = std::atomic_compare_exchange_strong(
+                                &nativeCharset(), &none, mine) ? mine : none;
+        }
+        return charset;
+}
+
+//--------------------------------------
+
+WRUTIL_API std::shared_ptr<const native_charset>
+refresh_native_charset()
+{
+        auto charset = examineNativeCharset();
+
+        std::atomic_store(&nativeCharset(), charset);
+        return charset;
+}
+
 //--------------------------------------
 // FIXME: these really belong elsewhere...
 
@@ -7,12 +7,125 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <wrutil/Config.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
 #include "utf8_ucs4.h"
 
 
 namespace wr {
 
 
+static inline unsigned
+__trailing_zeros(unsigned mask)  // mask != 0
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+    unsigned n = 0;
+    for (; !(mask & 1); mask >>= 1)
+        ++n;
+    return n;
+#endif
+}
+
+// Converts blocks of 8 characters while there is room for them to expand
+// to 3 bytes each, stopping before the first character outside the BMP or
+// surrogate; only used if Maxcode admits the whole BMP
+static void
+__ucs4_to_utf8_bulk(const uint32_t*& frm_nxt, const uint32_t* frm_end,
+                    uint8_t*& to_nxt, uint8_t* to_end)
+{
+    while (frm_end-frm_nxt >= 8 && to_end-to_nxt >= 24)
+    {
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i non_ascii = _mm_set1_epi32(~0x7F);
+        __m128i lo = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(frm_nxt));
+        __m128i hi = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(frm_nxt + 4));
+        __m128i high = _mm_or_si128(_mm_and_si128(lo, non_ascii),
+                                    _mm_and_si128(hi, non_ascii));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) == 0xFFFF)
+        {
+            __m128i units = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(to_nxt),
+                             _mm_packus_epi16(units, units));
+            frm_nxt += 8;
+            to_nxt += 8;
+            continue;
+        }
+#endif
+        for (const uint32_t* end = frm_nxt + 8; frm_nxt < end; ++frm_nxt)
+        {
+            uint32_t wc = *frm_nxt;
+            if (wc < 0x000080)
+            {
+                *to_nxt++ = static_cast<uint8_t>(wc);
+            }
+            else if (wc < 0x000800)
+            {
+                *to_nxt++ = static_cast<uint8_t>(0xC0 | (wc >> 6));
+                *to_nxt++ = static_cast<uint8_t>(0x80 | (wc & 0x03F));
+            }
+            else if (wc < 0x010000 && (wc & 0xFFFFF800) != 0x00D800)
+            {
+                *to_nxt++ = static_cast<uint8_t>(0xE0 |  (wc >> 12));
+                *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x0FC0) >> 6));
+                *to_nxt++ = static_cast<uint8_t>(0x80 |  (wc & 0x003F));
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+}
+
+// Converts the character at frm_nxt, advancing past it if successful
+static std::codecvt_base::result
+__ucs4_to_utf8_char(const uint32_t*& frm_nxt, uint8_t*& to_nxt,
+                    uint8_t* to_end, unsigned long Maxcode)
+{
+    uint32_t wc = *frm_nxt;
+    if ((wc & 0xFFFFF800) == 0x00D800 || wc > Maxcode)
+        return std::codecvt_base::error;
+    if (wc < 0x000080)
+    {
+        if (to_end-to_nxt < 1)
+            return std::codecvt_base::partial;
+        *to_nxt++ = static_cast<uint8_t>(wc);
+    }
+    else if (wc < 0x000800)
+    {
+        if (to_end-to_nxt < 2)
+            return std::codecvt_base::partial;
+        *to_nxt++ = static_cast<uint8_t>(0xC0 | (wc >> 6));
+        *to_nxt++ = static_cast<uint8_t>(0x80 | (wc & 0x03F));
+    }
+    else if (wc < 0x010000)
+    {
+        if (to_end-to_nxt < 3)
+            return std::codecvt_base::partial;
+        *to_nxt++ = static_cast<uint8_t>(0xE0 |  (wc >> 12));
+        *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x0FC0) >> 6));
+        *to_nxt++ = static_cast<uint8_t>(0x80 |  (wc & 0x003F));
+    }
+    else // if (wc < 0x110000)
+    {
+        if (to_end-to_nxt < 4)
+            return std::codecvt_base::partial;
+        *to_nxt++ = static_cast<uint8_t>(0xF0 |  (wc >> 18));
+        *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x03F000) >> 12));
+        *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x000FC0) >> 6));
+        *to_nxt++ = static_cast<uint8_t>(0x80 |  (wc & 0x00003F));
+    }
+    ++frm_nxt;
+    return std::codecvt_base::ok;
+}
+
 std::codecvt_base::result
 ucs4_to_utf8(const uint32_t* frm, const uint32_t* frm_end,
              const uint32_t*& frm_nxt, uint8_t* to, uint8_t* to_end,
@@ -28,42 +141,188 @@ ucs4_to_utf8(const uint32_t* frm, const uint32_t* frm_end,
         *to_nxt++ = static_cast<uint8_t>(0xBB);
         *to_nxt++ = static_cast<uint8_t>(0xBF);
     }
-    for (; frm_nxt < frm_end; ++frm_nxt)
+    const bool bulk = Maxcode >= 0xFFFF;
+    while (frm_nxt < frm_end)
     {
-        uint32_t wc = *frm_nxt;
-        if ((wc & 0xFFFFF800) == 0x00D800 || wc > Maxcode)
-            return std::codecvt_base::error;
-        if (wc < 0x000080)
+        if (bulk)
         {
-            if (to_end-to_nxt < 1)
-                return std::codecvt_base::partial;
-            *to_nxt++ = static_cast<uint8_t>(wc);
+            __ucs4_to_utf8_bulk(frm_nxt, frm_end, to_nxt, to_end);
+            if (frm_nxt == frm_end)
+                break;
         }
-        else if (wc < 0x000800)
+        std::codecvt_base::result r = __ucs4_to_utf8_char(frm_nxt, to_nxt,
+                                                          to_end, Maxcode);
+        if (r != std::codecvt_base::ok)
+            return r;
+    }
+    return std::codecvt_base::ok;
+}
+
+// Converts ASCII and two- and three-byte sequences while at least 16 bytes
+// of input and room for 16 characters of output remain, stopping at
+// anything else (four-byte sequences and invalid input); only used if
+// Maxcode admits the whole BMP
+static void
+__utf8_to_ucs4_bulk(const uint8_t*& frm_nxt, const uint8_t* frm_end,
+                    uint32_t*& to_nxt, uint32_t* to_end)
+{
+    if (frm_end-frm_nxt < 16 || to_end-to_nxt < 16)
+        return;
+    const uint8_t* frm_lim = frm_end - 16;
+    const uint32_t* to_lim = to_end - 16;
+    while (frm_nxt <= frm_lim && to_nxt <= to_lim)
+    {
+        if (*frm_nxt < 0x80)
         {
-            if (to_end-to_nxt < 2)
-                return std::codecvt_base::partial;
-            *to_nxt++ = static_cast<uint8_t>(0xC0 | (wc >> 6));
-            *to_nxt++ = static_cast<uint8_t>(0x80 | (wc & 0x03F));
+#ifdef __SSE2__
+            // widen all 16 bytes, keeping only the leading ASCII
+            const __m128i zero = _mm_setzero_si128();
+            __m128i bytes = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(frm_nxt));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero),
+                    hi = _mm_unpackhi_epi8(bytes, zero);
+            __m128i* out = reinterpret_cast<__m128i*>(to_nxt);
+            _mm_storeu_si128(out,     _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+            unsigned n = mask ? __trailing_zeros(mask) : 16;
+            frm_nxt += n;
+            to_nxt += n;
+#else
+            const uint8_t* end = frm_nxt + 16;
+            do
+                *to_nxt++ = *frm_nxt++;
+            while (frm_nxt < end && *frm_nxt < 0x80);
+#endif
+            continue;
         }
-        else if (wc < 0x010000)
+        uint8_t c1 = frm_nxt[0];
+        uint8_t c2 = frm_nxt[1];
+        if (c1 < 0xC2 || (c2 & 0xC0) != 0x80)
+            return;
+        if (c1 < 0xE0)
         {
-            if (to_end-to_nxt < 3)
-                return std::codecvt_base::partial;
-            *to_nxt++ = static_cast<uint8_t>(0xE0 |  (wc >> 12));
-            *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x0FC0) >> 6));
-            *to_nxt++ = static_cast<uint8_t>(0x80 |  (wc & 0x003F));
+            *to_nxt++ = static_cast<uint32_t>(((c1 & 0x1F) << 6)
+                                              | (c2 & 0x3F));
+            frm_nxt += 2;
+            continue;
         }
-        else // if (wc < 0x110000)
+        uint8_t c3 = frm_nxt[2];
+        if (c1 >= 0xF0 || (c3 & 0xC0) != 0x80)
+            return;
+        uint32_t t = static_cast<uint32_t>(((c1 & 0x0F) << 12)
+                                         | ((c2 & 0x3F) << 6)
+                                         |  (c3 & 0x3F));
+        if (t < 0x0800 || (t & 0xF800) == 0xD800)
+            return;  // overlong or surrogate
+        *to_nxt++ = t;
+        frm_nxt += 3;
+    }
+}
+
+// Converts the character at frm_nxt, advancing past it if successful;
+// there must be room for one character of output
+static std::codecvt_base::result
+__utf8_to_ucs4_char(const uint8_t*& frm_nxt, const uint8_t* frm_end,
+                    uint32_t*& to_nxt, unsigned long Maxcode)
+{
+    uint8_t c1 = static_cast<uint8_t>(*frm_nxt);
+    if (c1 < 0x80)
+    {
+        if (c1 > Maxcode)
+            return std::codecvt_base::error;
+        *to_nxt = static_cast<uint32_t>(c1);
+        ++frm_nxt;
+    }
+    else if (c1 < 0xC2)
+    {
+        return std::codecvt_base::error;
+    }
+    else if (c1 < 0xE0)
+    {
+        if (frm_end-frm_nxt < 2)
+            return std::codecvt_base::partial;
+        uint8_t c2 = frm_nxt[1];
+        if ((c2 & 0xC0) != 0x80)
+            return std::codecvt_base::error;
+        uint32_t t = static_cast<uint32_t>(((c1 & 0x1F) << 6)
+                                          | (c2 & 0x3F));
+        if (t > Maxcode)
+            return std::codecvt_base::error;
+        *to_nxt = t;
+        frm_nxt += 2;
+    }
+    else if (c1 < 0xF0)
+    {
+        if (frm_end-frm_nxt < 3)
+            return std::codecvt_base::partial;
+        uint8_t c2 = frm_nxt[1];
+        uint8_t c3 = frm_nxt[2];
+        switch (c1)
+        {
+        case 0xE0:
+            if ((c2 & 0xE0) != 0xA0)
+                return std::codecvt_base::error;
+             break;
+        case 0xED:
+            if ((c2 & 0xE0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        default:
+            if ((c2 & 0xC0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        }
+        if ((c3 & 0xC0) != 0x80)
+            return std::codecvt_base::error;
+        uint32_t t = static_cast<uint32_t>(((c1 & 0x0F) << 12)
+                                         | ((c2 & 0x3F) << 6)
+                                         |  (c3 & 0x3F));
+        if (t > Maxcode)
+            return std::codecvt_base::error;
+        *to_nxt = t;
+        frm_nxt += 3;
+    }
+    else if (c1 < 0xF5)
+    {
+        if (frm_end-frm_nxt < 4)
+            return std::codecvt_base::partial;
+        uint8_t c2 = frm_nxt[1];
+        uint8_t c3 = frm_nxt[2];
+        uint8_t c4 = frm_nxt[3];
+        switch (c1)
         {
-            if (to_end-to_nxt < 4)
-                return std::codecvt_base::partial;
-            *to_nxt++ = static_cast<uint8_t>(0xF0 |  (wc >> 18));
-            *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x03F000) >> 12));
-            *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc & 0x000FC0) >> 6));
-            *to_nxt++ = static_cast<uint8_t>(0x80 |  (wc & 0x00003F));
+        case 0xF0:
+            if (!(0x90 <= c2 && c2 <= 0xBF))
+                return std::codecvt_base::error;
+             break;
+        case 0xF4:
+            if ((c2 & 0xF0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        default:
+            if ((c2 & 0xC0) != 0x80)
+                return std::codecvt_base::error;
+             break;
         }
+        if ((c3 & 0xC0) != 0x80 || (c4 & 0xC0) != 0x80)
+            return std::codecvt_base::error;
+        uint32_t t = static_cast<uint32_t>(((c1 & 0x07) << 18)
+                                         | ((c2 & 0x3F) << 12)
+                                         | ((c3 & 0x3F) << 6)
+                                         |  (c4 & 0x3F));
+        if (t > Maxcode)
+            return std::codecvt_base::error;
+        *to_nxt = t;
+        frm_nxt += 4;
     }
+    else
+    {
+        return std::codecvt_base::error;
+    }
+    ++to_nxt;
     return std::codecvt_base::ok;
 }
 
@@ -80,102 +339,19 @@ utf8_to_ucs4(const uint8_t* frm, const uint8_t* frm_end,
                                                           frm_nxt[2] == 0xBF)
             frm_nxt += 3;
     }
-    for (; frm_nxt < frm_end && to_nxt < to_end; ++to_nxt)
+    const bool bulk = Maxcode >= 0xFFFF;
+    while (frm_nxt < frm_end && to_nxt < to_end)
     {
-        uint8_t c1 = static_cast<uint8_t>(*frm_nxt);
-        if (c1 < 0x80)
-        {
-            if (c1 > Maxcode)
-                return std::codecvt_base::error;
-            *to_nxt = static_cast<uint32_t>(c1);
-            ++frm_nxt;
-        }
-        else if (c1 < 0xC2)
-        {
-            return std::codecvt_base::error;
-        }
-        else if (c1 < 0xE0)
+        if (bulk)
         {
-            if (frm_end-frm_nxt < 2)
-                return std::codecvt_base::partial;
-            uint8_t c2 = frm_nxt[1];
-            if ((c2 & 0xC0) != 0x80)
-                return std::codecvt_base::error;
-            uint32_t t = static_cast<uint32_t>(((c1 & 0x1F) << 6)
-                                              | (c2 & 0x3F));
-            if (t > Maxcode)
-                return std::codecvt_base::error;
-            *to_nxt = t;
-            frm_nxt += 2;
-        }
-        else if (c1 < 0xF0)
-        {
-            if (frm_end-frm_nxt < 3)
-                return std::codecvt_base::partial;
-            uint8_t c2 = frm_nxt[1];
-            uint8_t c3 = frm_nxt[2];
-            switch (c1)
-            {
-            case 0xE0:
-                if ((c2 & 0xE0) != 0xA0)
-                    return std::codecvt_base::error;
-                 break;
-            case 0xED:
-                if ((c2 & 0xE0) != 0x80)
-                    return std::codecvt_base::error;
-                 break;
-            default:
-                if ((c2 & 0xC0) != 0x80)
-                    return std::codecvt_base::error;
-                 break;
-            }
-            if ((c3 & 0xC0) != 0x80)
-                return std::codecvt_base::error;
-            uint32_t t = static_cast<uint32_t>(((c1 & 0x0F) << 12)
-                                             | ((c2 & 0x3F) << 6)
-                                             |  (c3 & 0x3F));
-            if (t > Maxcode)
-                return std::codecvt_base::error;
-            *to_nxt = t;
-            frm_nxt += 3;
-        }
-        else if (c1 < 0xF5)
-        {
-            if (frm_end-frm_nxt < 4)
-                return std::codecvt_base::partial;
-            uint8_t c2 = frm_nxt[1];
-            uint8_t c3 = frm_nxt[2];
-            uint8_t c4 = frm_nxt[3];
-            switch (c1)
-            {
-            case 0xF0:
-                if (!(0x90 <= c2 && c2 <= 0xBF))
-                    return std::codecvt_base::error;
-                 break;
-            case 0xF4:
-                if ((c2 & 0xF0) != 0x80)
-                    return std::codecvt_base::error;
-                 break;
-            default:
-                if ((c2 & 0xC0) != 0x80)
-                    return std::codecvt_base::error;
-                 break;
-            }
-            if ((c3 & 0xC0) != 0x80 || (c4 & 0xC0) != 0x80)
-                return std::codecvt_base::error;
-            uint32_t t = static_cast<uint32_t>(((c1 & 0x07) << 18)
-                                             | ((c2 & 0x3F) << 12)
-                                             | ((c3 & 0x3F) << 6)
-                                             |  (c4 & 0x3F));
-            if (t > Maxcode)
-                return std::codecvt_base::error;
-            *to_nxt = t;
-            frm_nxt += 4;
-        }
-        else
-        {
-            return std::codecvt_base::error;
+            __utf8_to_ucs4_bulk(frm_nxt, frm_end, to_nxt, to_end);
+            if (frm_nxt == frm_end || to_nxt == to_end)
+                break;
         }
+        std::codecvt_base::result r = __utf8_to_ucs4_char(frm_nxt, frm_end,
+                                                          to_nxt, Maxcode);
+        if (r != std::codecvt_base::ok)
+            return r;
     }
     return frm_nxt < frm_end ? std::codecvt_base::partial : std::codecvt_base::ok;
 }
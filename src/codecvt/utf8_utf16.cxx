@@ -0,0 +1,419 @@
+//===----------- utf8_utf16.cxx (from libc++ original code) ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include <wrutil/Config.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+#include "utf8_utf16.h"
+
+
+namespace wr {
+
+
+static inline unsigned
+__trailing_zeros(unsigned mask)  // mask != 0
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+    unsigned n = 0;
+    for (; !(mask & 1); mask >>= 1)
+        ++n;
+    return n;
+#endif
+}
+
+// Encodes BMP characters that are not surrogates; no bounds checks
+static inline uint8_t*
+__encode_bmp(uint16_t wc, uint8_t* to)
+{
+    if (wc < 0x0080)
+    {
+        *to++ = static_cast<uint8_t>(wc);
+    }
+    else if (wc < 0x0800)
+    {
+        *to++ = static_cast<uint8_t>(0xC0 | (wc >> 6));
+        *to++ = static_cast<uint8_t>(0x80 | (wc & 0x03F));
+    }
+    else
+    {
+        *to++ = static_cast<uint8_t>(0xE0 |  (wc >> 12));
+        *to++ = static_cast<uint8_t>(0x80 | ((wc & 0x0FC0) >> 6));
+        *to++ = static_cast<uint8_t>(0x80 |  (wc & 0x003F));
+    }
+    return to;
+}
+
+// Converts whole blocks of 8 UTF-16 units while there is room for them to
+// expand to 3 bytes each, stopping before the first surrogate
+static void
+__utf16_to_utf8_bulk(const uint16_t*& frm_nxt, const uint16_t* frm_end,
+                     uint8_t*& to_nxt, uint8_t* to_end)
+{
+    while (frm_end-frm_nxt >= 8 && to_end-to_nxt >= 24)
+    {
+        unsigned n = 8;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        __m128i units = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(frm_nxt));
+        __m128i high = _mm_and_si128(units,
+                                _mm_set1_epi16(static_cast<short>(0xFF80)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) == 0xFFFF)
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(to_nxt),
+                             _mm_packus_epi16(units, units));
+            frm_nxt += 8;
+            to_nxt += 8;
+            continue;
+        }
+        __m128i surrogates = _mm_cmpeq_epi16(
+                _mm_and_si128(units,
+                              _mm_set1_epi16(static_cast<short>(0xF800))),
+                _mm_set1_epi16(static_cast<short>(0xD800)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(surrogates));
+        if (mask)
+            n = __trailing_zeros(mask) / 2;
+#else
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            if ((frm_nxt[i] & 0xF800) == 0xD800)
+            {
+                n = i;
+                break;
+            }
+        }
+#endif
+        for (unsigned i = 0; i < n; ++i)
+            to_nxt = __encode_bmp(frm_nxt[i], to_nxt);
+        frm_nxt += n;
+        if (n < 8)
+            return;
+    }
+}
+
+// Converts the character at frm_nxt, advancing past it if successful
+static std::codecvt_base::result
+__utf16_to_utf8_char(const uint16_t*& frm_nxt, const uint16_t* frm_end,
+                     uint8_t*& to_nxt, uint8_t* to_end)
+{
+    uint16_t wc1 = *frm_nxt;
+    if (wc1 < 0xD800 || wc1 >= 0xE000)
+    {
+        int n = wc1 < 0x0080 ? 1 : wc1 < 0x0800 ? 2 : 3;
+        if (to_end-to_nxt < n)
+            return std::codecvt_base::partial;
+        to_nxt = __encode_bmp(wc1, to_nxt);
+        ++frm_nxt;
+        return std::codecvt_base::ok;
+    }
+    if (wc1 >= 0xDC00)
+        return std::codecvt_base::error;
+    if (frm_end-frm_nxt < 2)
+        return std::codecvt_base::partial;
+    uint16_t wc2 = frm_nxt[1];
+    if ((wc2 & 0xFC00) != 0xDC00)
+        return std::codecvt_base::error;
+    if (to_end-to_nxt < 4)
+        return std::codecvt_base::partial;
+    uint8_t z = ((wc1 & 0x03C0) >> 6) + 1;
+    *to_nxt++ = static_cast<uint8_t>(0xF0 | (z >> 2));
+    *to_nxt++ = static_cast<uint8_t>(0x80 | ((z & 0x03) << 4)
+                                          | ((wc1 & 0x003C) >> 2));
+    *to_nxt++ = static_cast<uint8_t>(0x80 | ((wc1 & 0x0003) << 4)
+                                          | ((wc2 & 0x03C0) >> 6));
+    *to_nxt++ = static_cast<uint8_t>(0x80 |  (wc2 & 0x003F));
+    frm_nxt += 2;
+    return std::codecvt_base::ok;
+}
+
+std::codecvt_base::result
+utf16_to_utf8(const uint16_t* frm, const uint16_t* frm_end,
+              const uint16_t*& frm_nxt, uint8_t* to, uint8_t* to_end,
+              uint8_t*& to_nxt)
+{
+    frm_nxt = frm;
+    to_nxt = to;
+    while (frm_nxt < frm_end)
+    {
+        __utf16_to_utf8_bulk(frm_nxt, frm_end, to_nxt, to_end);
+        if (frm_nxt == frm_end)
+            break;
+        std::codecvt_base::result r = __utf16_to_utf8_char(frm_nxt, frm_end,
+                                                           to_nxt, to_end);
+        if (r != std::codecvt_base::ok)
+            return r;
+    }
+    return std::codecvt_base::ok;
+}
+
+// Converts ASCII and two- and three-byte sequences while at least 16 bytes
+// of input and room for 16 units of output remain, stopping at anything
+// else (four-byte sequences and invalid input)
+static void
+__utf8_to_utf16_bulk(const uint8_t*& frm_nxt, const uint8_t* frm_end,
+                     uint16_t*& to_nxt, uint16_t* to_end)
+{
+    if (frm_end-frm_nxt < 16 || to_end-to_nxt < 16)
+        return;
+    const uint8_t* frm_lim = frm_end - 16;
+    const uint16_t* to_lim = to_end - 16;
+    while (frm_nxt <= frm_lim && to_nxt <= to_lim)
+    {
+        if (*frm_nxt < 0x80)
+        {
+#ifdef __SSE2__
+            // widen all 16 bytes, keeping only the leading ASCII
+            const __m128i zero = _mm_setzero_si128();
+            __m128i bytes = _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(frm_nxt));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(to_nxt),
+                             _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(to_nxt + 8),
+                             _mm_unpackhi_epi8(bytes, zero));
+            unsigned n = mask ? __trailing_zeros(mask) : 16;
+            frm_nxt += n;
+            to_nxt += n;
+#else
+            const uint8_t* end = frm_nxt + 16;
+            do
+                *to_nxt++ = *frm_nxt++;
+            while (frm_nxt < end && *frm_nxt < 0x80);
+#endif
+            continue;
+        }
+        uint8_t c1 = frm_nxt[0];
+        uint8_t c2 = frm_nxt[1];
+        if (c1 < 0xC2 || (c2 & 0xC0) != 0x80)
+            return;
+        if (c1 < 0xE0)
+        {
+            *to_nxt++ = static_cast<uint16_t>(((c1 & 0x1F) << 6)
+                                              | (c2 & 0x3F));
+            frm_nxt += 2;
+            continue;
+        }
+        uint8_t c3 = frm_nxt[2];
+        if (c1 >= 0xF0 || (c3 & 0xC0) != 0x80)
+            return;
+        uint16_t t = static_cast<uint16_t>(((c1 & 0x0F) << 12)
+                                         | ((c2 & 0x3F) << 6)
+                                         |  (c3 & 0x3F));
+        if (t < 0x0800 || (t & 0xF800) == 0xD800)
+            return;  // overlong or surrogate
+        *to_nxt++ = t;
+        frm_nxt += 3;
+    }
+}
+
+// Converts the character at frm_nxt, advancing past it if successful;
+// there must be room for at least one unit of output
+static std::codecvt_base::result
+__utf8_to_utf16_char(const uint8_t*& frm_nxt, const uint8_t* frm_end,
+                     uint16_t*& to_nxt, uint16_t* to_end)
+{
+    uint8_t c1 = *frm_nxt;
+    if (c1 < 0x80)
+    {
+        *to_nxt++ = static_cast<uint16_t>(c1);
+        ++frm_nxt;
+    }
+    else if (c1 < 0xC2)
+    {
+        return std::codecvt_base::error;
+    }
+    else if (c1 < 0xE0)
+    {
+        if (frm_end-frm_nxt < 2)
+            return std::codecvt_base::partial;
+        uint8_t c2 = frm_nxt[1];
+        if ((c2 & 0xC0) != 0x80)
+            return std::codecvt_base::error;
+        *to_nxt++ = static_cast<uint16_t>(((c1 & 0x1F) << 6) | (c2 & 0x3F));
+        frm_nxt += 2;
+    }
+    else if (c1 < 0xF0)
+    {
+        if (frm_end-frm_nxt < 3)
+            return std::codecvt_base::partial;
+        uint8_t c2 = frm_nxt[1];
+        uint8_t c3 = frm_nxt[2];
+        switch (c1)
+        {
+        case 0xE0:
+            if ((c2 & 0xE0) != 0xA0)
+                return std::codecvt_base::error;
+             break;
+        case 0xED:
+            if ((c2 & 0xE0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        default:
+            if ((c2 & 0xC0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        }
+        if ((c3 & 0xC0) != 0x80)
+            return std::codecvt_base::error;
+        *to_nxt++ = static_cast<uint16_t>(((c1 & 0x0F) << 12)
+                                        | ((c2 & 0x3F) << 6)
+                                        |  (c3 & 0x3F));
+        frm_nxt += 3;
+    }
+    else if (c1 < 0xF5)
+    {
+        if (frm_end-frm_nxt < 4)
+            return std::codecvt_base::partial;
+        uint8_t c2 = frm_nxt[1];
+        uint8_t c3 = frm_nxt[2];
+        uint8_t c4 = frm_nxt[3];
+        switch (c1)
+        {
+        case 0xF0:
+            if (!(0x90 <= c2 && c2 <= 0xBF))
+                return std::codecvt_base::error;
+             break;
+        case 0xF4:
+            if ((c2 & 0xF0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        default:
+            if ((c2 & 0xC0) != 0x80)
+                return std::codecvt_base::error;
+             break;
+        }
+        if ((c3 & 0xC0) != 0x80 || (c4 & 0xC0) != 0x80)
+            return std::codecvt_base::error;
+        if (to_end-to_nxt < 2)
+            return std::codecvt_base::partial;
+        *to_nxt++ = static_cast<uint16_t>(
+                0xD800
+              | (((((c1 & 0x07) << 2) | ((c2 & 0x30) >> 4)) - 1) << 6)
+              | ((c2 & 0x0F) << 2)
+              | ((c3 & 0x30) >> 4));
+        *to_nxt++ = static_cast<uint16_t>(
+                0xDC00
+              | ((c3 & 0x0F) << 6)
+              |  (c4 & 0x3F));
+        frm_nxt += 4;
+    }
+    else
+    {
+        return std::codecvt_base::error;
+    }
+    return std::codecvt_base::ok;
+}
+
+std::codecvt_base::result
+utf8_to_utf16(const uint8_t* frm, const uint8_t* frm_end,
+              const uint8_t*& frm_nxt, uint16_t* to, uint16_t* to_end,
+              uint16_t*& to_nxt)
+{
+    frm_nxt = frm;
+    to_nxt = to;
+    while (frm_nxt < frm_end && to_nxt < to_end)
+    {
+        __utf8_to_utf16_bulk(frm_nxt, frm_end, to_nxt, to_end);
+        if (frm_nxt == frm_end || to_nxt == to_end)
+            break;
+        std::codecvt_base::result r = __utf8_to_utf16_char(frm_nxt, frm_end,
+                                                           to_nxt, to_end);
+        if (r != std::codecvt_base::ok)
+            return r;
+    }
+    return frm_nxt < frm_end ? std::codecvt_base::partial
+                             : std::codecvt_base::ok;
+}
+
+int
+utf8_to_utf16_length(const uint8_t* frm, const uint8_t* frm_end, size_t mx)
+{
+    const uint8_t* frm_nxt = frm;
+    for (size_t nchar16_t = 0; frm_nxt < frm_end && nchar16_t < mx; ++nchar16_t)
+    {
+        uint8_t c1 = *frm_nxt;
+        if (c1 < 0x80)
+        {
+            ++frm_nxt;
+        }
+        else if (c1 < 0xC2)
+        {
+            break;
+        }
+        else if (c1 < 0xE0)
+        {
+            if ((frm_end-frm_nxt < 2) || (frm_nxt[1] & 0xC0) != 0x80)
+                break;
+            frm_nxt += 2;
+        }
+        else if (c1 < 0xF0)
+        {
+            if (frm_end-frm_nxt < 3)
+                break;
+            uint8_t c2 = frm_nxt[1];
+            uint8_t c3 = frm_nxt[2];
+            switch (c1)
+            {
+            case 0xE0:
+                if ((c2 & 0xE0) != 0xA0)
+                    return static_cast<int>(frm_nxt - frm);
+                break;
+            case 0xED:
+                if ((c2 & 0xE0) != 0x80)
+                    return static_cast<int>(frm_nxt - frm);
+                 break;
+            default:
+                if ((c2 & 0xC0) != 0x80)
+                    return static_cast<int>(frm_nxt - frm);
+                 break;
+            }
+            if ((c3 & 0xC0) != 0x80)
+                break;
+            frm_nxt += 3;
+        }
+        else if (c1 < 0xF5)
+        {
+            if (frm_end-frm_nxt < 4 || mx-nchar16_t < 2)
+                break;
+            uint8_t c2 = frm_nxt[1];
+            uint8_t c3 = frm_nxt[2];
+            uint8_t c4 = frm_nxt[3];
+            switch (c1)
+            {
+            case 0xF0:
+                if (!(0x90 <= c2 && c2 <= 0xBF))
+                    return static_cast<int>(frm_nxt - frm);
+                 break;
+            case 0xF4:
+                if ((c2 & 0xF0) != 0x80)
+                    return static_cast<int>(frm_nxt - frm);
+                 break;
+            default:
+                if ((c2 & 0xC0) != 0x80)
+                    return static_cast<int>(frm_nxt - frm);
+                 break;
+            }
+            if ((c3 & 0xC0) != 0x80 || (c4 & 0xC0) != 0x80)
+                break;
+            ++nchar16_t;
+            frm_nxt += 4;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return static_cast<int>(frm_nxt - frm);
+}
+
+
+} // namespace wr
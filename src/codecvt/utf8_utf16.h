@@ -0,0 +1,61 @@
+/**
+ * \file utf8_utf16.h
+ *
+ * \brief Shared declarations for internal UTF-8 to UTF-16 transcoding
+ *        functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRUTIL_CODECVT_UTF8_UTF16_H
+#define WRUTIL_CODECVT_UTF8_UTF16_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <locale>
+
+
+namespace wr {
+
+
+/*
+ * Both functions convert runs of ASCII and other BMP characters in bulk,
+ * falling back to one character at a time for surrogate pairs, invalid
+ * input and the last few characters before the end of either buffer.
+ * partial is returned if the input ends part way through a character or
+ * the output has no room for the next one.
+ */
+std::codecvt_base::result
+utf16_to_utf8(const uint16_t *frm, const uint16_t *frm_end,
+              const uint16_t *&frm_nxt, uint8_t *to, uint8_t *to_end,
+              uint8_t *&to_nxt);
+
+std::codecvt_base::result
+utf8_to_utf16(const uint8_t *frm, const uint8_t *frm_end,
+              const uint8_t *&frm_nxt, uint16_t *to, uint16_t *to_end,
+              uint16_t *&to_nxt);
+
+int
+utf8_to_utf16_length(const uint8_t *frm, const uint8_t *frm_end, size_t mx);
+
+
+} // namespace wr
+
+
+#endif // !WRUTIL_CODECVT_UTF8_UTF16_H
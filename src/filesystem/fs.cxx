@@ -29,6 +29,7 @@
 #       include <unistd.h>
 #endif
 #include <errno.h>
+#include <algorithm>
 
 #include <wrutil/string_view.h>
 
@@ -47,6 +48,154 @@ using boost::system_category;
 
 const path DOT("."), DOTDOT("..");
 
+
+namespace {
+
+using Char = path::value_type;
+using traits = path::string_type::traits_type;
+
+inline bool
+is_sep(
+        Char c
+)
+{
+        return (c == '/') || (c == path::preferred_separator);
+}
+
+//--------------------------------------
+
+inline const Char *
+find_sep(
+        const Char *s,
+        const Char *end
+)
+{
+#if WR_WINDOWS && !WR_CYGWIN
+        while ((s != end) && !is_sep(*s)) {
+                ++s;
+        }
+        return s;
+#else
+        const Char *sep = traits::find(s, size_t(end - s), '/');
+        return sep ? sep : end;
+#endif
+}
+
+//--------------------------------------
+
+/*
+ * Splits a native path string into the parts its sort key is made of: the
+ * root name, whether there is a root directory, and the filenames other
+ * than "." (skipping repeated and trailing separators)
+ */
+class KeyParts
+{
+public:
+        explicit KeyParts(const path::string_type &s);
+
+        bool next(const Char *&name, size_t &len);
+
+        const Char *s_,
+                   *end_;
+        size_t      root_name_len_;
+        bool        root_dir_;
+};
+
+//--------------------------------------
+
+KeyParts::KeyParts(
+        const path::string_type &s
+) :
+        s_            (s.data()),
+        end_          (s_ + s.size()),
+        root_name_len_(root_name_length(s_, end_)),
+        root_dir_     ((root_name_len_ < s.size())
+                                && is_sep(s_[root_name_len_]))
+{
+}
+
+//--------------------------------------
+
+bool
+KeyParts::next(
+        const Char *&name,
+        size_t      &len
+)
+{
+        const Char *s = s_ + root_name_len_;
+
+        root_name_len_ = 0;
+        while (s != end_) {
+                if (is_sep(*s)) {
+                        ++s;
+                        continue;
+                }
+                const Char *e = find_sep(s + 1, end_);
+                if ((e - s == 1) && (*s == '.')) {
+                        s = e;
+                        continue;
+                }
+                name = s;
+                len = size_t(e - s);
+                s_ = e;
+                return true;
+        }
+        s_ = end_;
+        return false;
+}
+
+//--------------------------------------
+
+/*
+ * Compares strings as if each were followed by a NUL, which sorts below
+ * every character that can appear in a path
+ */
+inline int
+compare_parts(
+        const Char *a,
+        size_t      len_a,
+        const Char *b,
+        size_t      len_b
+)
+{
+        int cmp = traits::compare(a, b, std::min(len_a, len_b));
+        if (cmp || (len_a == len_b)) {
+                return cmp;
+        }
+        return (len_a < len_b) ? -1 : 1;
+}
+
+//--------------------------------------
+
+/*
+ * The root part of a sort key is the root name, then '/' if there is a
+ * root directory, then NUL
+ */
+int
+compare_roots(
+        const KeyParts &a,
+        const KeyParts &b
+)
+{
+        size_t len = std::min(a.root_name_len_, b.root_name_len_);
+        int    cmp = traits::compare(a.s_, b.s_, len);
+
+        if (cmp) {
+                return cmp;
+        } else if (a.root_name_len_ == b.root_name_len_) {
+                return int(a.root_dir_) - int(b.root_dir_);
+        }
+
+        Char c_a = (len < a.root_name_len_) ? a.s_[len]
+                                            : Char(a.root_dir_ ? '/' : 0),
+             c_b = (len < b.root_name_len_) ? b.s_[len]
+                                            : Char(b.root_dir_ ? '/' : 0);
+        return traits::lt(c_a, c_b) ? -1 : 1;
+}
+
+
+} // anonymous namespace
+
 //--------------------------------------
 
 WRUTIL_API bool
@@ -55,18 +204,111 @@ path_has_prefix(
         const path &prefix
 )
 {
-        path::const_iterator i_p        = p.begin(),
-                             end_p      = p.end(),
-                             i_prefix   = prefix.begin(),
-                             end_prefix = prefix.end();
+        if (prefix.empty()) {
+                return true;
+        } else if (p.empty()) {
+                return false;
+        }
+
+        const path::string_type &s_p = p.native(),
+                                &s_prefix = prefix.native();
+        size_t                   n = s_prefix.size();
+        KeyParts                 parts_p(s_p), parts_prefix(s_prefix);
+        const Char              *name_p, *name_prefix;
+        size_t                   len_p, len_prefix;
+
+        // usually p simply begins with the characters of prefix
+        if ((n <= s_p.size()) && (s_p.compare(0, n, s_prefix) == 0)
+                        && ((n == s_p.size()) || is_sep(s_p[n])
+                                              || is_sep(s_prefix[n - 1]))
+                        && (parts_p.root_name_len_
+                                        == parts_prefix.root_name_len_)) {
+                return true;
+        }
 
-        for (; (i_p != end_p) && (i_prefix != end_prefix); ++i_p, ++i_prefix) {
-                if (*i_p != *i_prefix) {
+        if ((parts_p.root_dir_ != parts_prefix.root_dir_)
+                        || (parts_p.root_name_len_
+                                        != parts_prefix.root_name_len_)
+                        || traits::compare(parts_p.s_, parts_prefix.s_,
+                                           parts_p.root_name_len_)) {
+                return false;
+        }
+
+        while (parts_prefix.next(name_prefix, len_prefix)) {
+                if (!parts_p.next(name_p, len_p) || (len_p != len_prefix)
+                                || traits::compare(name_p, name_prefix,
+                                                   len_p)) {
                         return false;
                 }
         }
 
-        return (i_prefix == end_prefix);
+        return true;
+}
+
+//--------------------------------------
+
+WRUTIL_API int
+path_compare(
+        const path &a,
+        const path &b
+)
+{
+        if (a.empty() || b.empty()) {
+                return int(!a.empty()) - int(!b.empty());
+        }
+
+        KeyParts    parts_a(a.native()), parts_b(b.native());
+        const Char *name_a, *name_b;
+        size_t      len_a, len_b;
+        int         cmp = compare_roots(parts_a, parts_b);
+
+        while (!cmp) {
+                bool more_a = parts_a.next(name_a, len_a),
+                     more_b = parts_b.next(name_b, len_b);
+
+                if (!more_a || !more_b) {
+                        return int(more_a) - int(more_b);
+                }
+                cmp = compare_parts(name_a, len_a, name_b, len_b);
+        }
+
+        return cmp;
+}
+
+//--------------------------------------
+
+/*
+ * The key is the root name, '/' if there is a root directory and a NUL,
+ * followed by each filename and a NUL; an empty path has an empty key
+ */
+WRUTIL_API path::string_type
+path_sort_key(
+        const path &p
+)
+{
+        path::string_type result;
+
+        if (p.empty()) {
+                return result;
+        }
+
+        KeyParts    parts(p.native());
+        const Char *name;
+        size_t      len;
+
+        result.reserve(p.native().size() + 2);
+        result.assign(parts.s_, parts.root_name_len_);
+        if (parts.root_dir_) {
+                result += Char('/');
+        }
+        result += Char(0);
+
+        while (parts.next(name, len)) {
+                result.append(name, len);
+                result += Char(0);
+        }
+
+        return result;
 }
 
 //--------------------------------------
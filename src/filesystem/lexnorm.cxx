@@ -1,16 +1,18 @@
 /**
  * \file lexnorm.cxx
  *
- * \brief Implementation of wr::lexically_normal() filesystem function
+ * \brief Implementation of the wr::lexically_normal() filesystem functions
  *
- * \note This file is used only when the underlying filesystem library
- *       (boost::filesystem or C++ standard library) does not provide
- *       path::lexically_normal()
+ * Normalization follows the rules given for path::lexically_normal() by
+ * the C++17 standard but works directly on the bytes of the path string
+ * in a single pass, so it neither allocates memory for each component nor
+ * depends on which of those rules the underlying filesystem library
+ * implements.
  *
  * \copyright
  * \parblock
  *
- *   Copyright 2013-2016 James S. Waller
+ *   Copyright 2013-2017 James S. Waller
  *
  *   Licensed under the Apache License, Version 2.0 (the "License");
  *   you may not use this file except in compliance with the License.
@@ -26,20 +28,140 @@
  *
  * \endparblock
  */
+#include <string>
+
 #include "private.h"
 
 
 namespace wr {
 
 
+//--------------------------------------
+/*
+ * Writes the normal form of the path [src, src + n) to dst, which may be
+ * the same as src since the result is never longer than its input;
+ * returns the length of the result.
+ *
+ * Each filename is copied to the end of the output as it is reached,
+ * followed by a single separator if any follow it in the input. The
+ * output is then its own stack of components: a ".." filename removes
+ * the one before it by moving back to the preceding separator. `floor`
+ * marks the end of any leading ".." filenames, which cannot be removed.
+ */
+template <typename Char> static size_t
+normalize(
+        const Char *src,
+        size_t      n,
+        Char       *dst
+)
+{
+        if (n == 0) {
+                return 0;
+        }
+
+        const Char sep = static_cast<Char>(path::preferred_separator);
+        size_t     r = root_name_length(src, src + n), w;
+
+        for (w = 0; w < r; ++w) {
+                dst[w] = is_separator(src[w]) ? sep : src[w];
+        }
+
+        bool root_dir = (r < n) && is_separator(src[r]);
+
+        if (root_dir) {
+                dst[w++] = sep;
+                while ((r < n) && is_separator(src[r])) {
+                        ++r;
+                }
+        }
+
+        size_t base = w, floor = w;
+
+        while (r < n) {
+                size_t start = r;
+                while ((r < n) && !is_separator(src[r])) {
+                        ++r;
+                }
+
+                size_t len = r - start;
+                bool   sep_follows = (r < n);
+
+                while ((r < n) && is_separator(src[r])) {
+                        ++r;
+                }
+
+                bool dotdot = false;
+
+                if (src[start] == '.') {
+                        if (len == 1) {
+                                continue;  // omit "./"
+                        } else if ((len == 2) && (src[start + 1] == '.')) {
+                                if (w > floor) {
+                                        // omit "../" and the filename before
+                                        for (--w; (w > floor)
+                                                  && !is_separator(dst[w - 1]);
+                                             --w) { }
+                                        continue;
+                                } else if (root_dir) {
+                                        continue;  // "/.." == "/"
+                                }
+                                dotdot = true;
+                        }
+                }
+
+                std::char_traits<Char>::move(dst + w, src + start, len);
+                w += len;
+                if (sep_follows) {
+                        dst[w++] = sep;
+                }
+                if (dotdot) {
+                        floor = w;
+                }
+        }
+
+        if ((w > base) && (w == floor) && is_separator(dst[w - 1])) {
+                --w;  // "../" becomes ".."
+        }
+        if (w == 0) {
+                dst[w++] = '.';
+        }
+
+        return w;
+}
+
+//--------------------------------------
+
+WRUTIL_API path::string_type &
+lexically_normalize(
+        path::string_type &s
+)
+{
+        if (!s.empty()) {
+                s.resize(normalize(&s[0], s.size(), &s[0]));
+        }
+        return s;
+}
+
+//--------------------------------------
+
 WRUTIL_API path
 lexically_normal(
         const path &p
 )
 {
-        path result;
-        make_lexically_normal(result, p, p.begin(), p.end());
-        return result;
+        path::string_type s = p.native();
+        return path(std::move(lexically_normalize(s)));
+}
+
+//--------------------------------------
+
+WRUTIL_API u8string_view
+lexically_normal(
+        const u8string_view &p,
+        char                *buf
+)
+{
+        return u8string_view(buf, normalize(p.char_data(), p.bytes(), buf));
 }
 
 
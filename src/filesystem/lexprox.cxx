@@ -4,9 +4,8 @@
  * \brief Implementation of lexically_proximate() function of filesystem
  *        module
  *
- * \note This file is used only when the underlying filesystem library
- *       (boost::filesystem or C++ standard library) does not provide
- *       path::lexically_proximate()
+ * Built on wr::lexically_relative(), so that it follows the same rules
+ * whichever filesystem library is in use
  *
  * \copyright
  * \parblock
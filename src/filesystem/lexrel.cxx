@@ -4,14 +4,14 @@
  * \brief Implementation of lexically_relative() function of filesystem
  *        module
  *
- * \note This file is used only when the underlying filesystem library
- *       (boost::filesystem or C++ standard library) does not provide
- *       path::lexically_relative()
+ * Follows the C++17 rules for path::lexically_relative(), comparing the
+ * filenames of the two paths in place within their native strings rather
+ * than through path::iterator, which creates a path for each of them.
  *
  * \copyright
  * \parblock
  *
- *   Copyright 2013-2016 James S. Waller
+ *   Copyright 2013-2017 James S. Waller
  *
  *   Licensed under the Apache License, Version 2.0 (the "License");
  *   you may not use this file except in compliance with the License.
@@ -27,41 +27,206 @@
  *
  * \endparblock
  */
+#include <algorithm>
+#include <string>
+
 #include "private.h"
 
 
 namespace wr {
 
 
+namespace {
+
+
+typedef path::value_type Char;
+
+//--------------------------------------
+/*
+ * Steps through the filenames of a native path string, including the
+ * empty filename that path::iterator yields for a trailing separator
+ */
+class Filenames
+{
+public:
+        Filenames(const path::string_type &s);
+
+        const Char *begin() const { return begin_; }
+        const Char *end() const { return end_; }
+
+        bool done() const { return !begin_; }
+        bool empty() const { return begin_ == end_; }
+
+        bool is(const char *name) const;
+        bool operator==(const Filenames &other) const;
+
+        void next();
+
+        const Char *root_name_end;
+        bool        root_dir;
+
+private:
+        void scan(const Char *p);
+
+        const Char *begin_, *end_, *limit_;
+};
+
+//--------------------------------------
+
+Filenames::Filenames(
+        const path::string_type &s
+) :
+        limit_(s.data() + s.size())
+{
+        const Char *p = s.data();
+
+        root_name_end = p + root_name_length(p, limit_);
+        root_dir = (root_name_end != limit_) && is_separator(*root_name_end);
+
+        for (p = root_name_end; (p != limit_) && is_separator(*p); ++p) { }
+        if (p == limit_) {
+                begin_ = end_ = nullptr;
+        } else {
+                scan(p);
+        }
+}
+
+//--------------------------------------
+
+bool
+Filenames::is(
+        const char *name
+) const
+{
+        const Char *p = begin_;
+
+        for (; *name; ++name, ++p) {
+                if ((p == end_) || (*p != Char(*name))) {
+                        return false;
+                }
+        }
+        return p == end_;
+}
+
+//--------------------------------------
+
+bool
+Filenames::operator==(
+        const Filenames &other
+) const
+{
+        return (end_ - begin_ == other.end_ - other.begin_)
+                && std::equal(begin_, end_, other.begin_);
+}
+
+//--------------------------------------
+
+void
+Filenames::next()
+{
+        const Char *p = end_;
+
+        if (p == limit_) {
+                begin_ = end_ = nullptr;
+                return;
+        }
+
+        while ((p != limit_) && is_separator(*p)) {
+                ++p;
+        }
+        if (p == limit_) {
+                begin_ = end_ = limit_;  // trailing separator
+        } else {
+                scan(p);
+        }
+}
+
+//--------------------------------------
+
+void
+Filenames::scan(
+        const Char *p
+)
+{
+        begin_ = p;
+        while ((p != limit_) && !is_separator(*p)) {
+                ++p;
+        }
+        end_ = p;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
 WRUTIL_API path
 lexically_relative(
         const path &p,
         const path &base
 )
 {
-        path::const_iterator i_p      = p.begin(),
-                             i_base   = base.begin(),
-                             end_p    = p.end(),
-                             end_base = base.end();
-        path                 result;
-
-        while ((i_p != end_p) && (i_base != end_base) && (*i_p == *i_base)) {
-                ++i_p;
-                ++i_base;
+        Filenames i_p(p.native()), i_base(base.native());
+
+        size_t root_name_len = size_t(i_p.root_name_end - p.native().data());
+        bool   absolute = i_p.root_dir,
+               base_absolute = i_base.root_dir;
+#if WR_WINDOWS && !WR_CYGWIN
+        absolute = absolute && (root_name_len > 0);
+        base_absolute = base_absolute
+                && (i_base.root_name_end != base.native().data());
+#endif
+
+        if ((size_t(i_base.root_name_end - base.native().data())
+                                                        != root_name_len)
+                        || (p.native().compare(0, root_name_len,
+                                        base.native(), 0, root_name_len) != 0)
+                        || (absolute != base_absolute)
+                        || (!i_p.root_dir && i_base.root_dir)) {
+                return path();
+        }
+
+        while (!i_p.done() && !i_base.done() && (i_p == i_base)) {
+                i_p.next();
+                i_base.next();
+        }
+
+        if (i_p.done() && i_base.done()) {
+                return DOT;
         }
 
-        if ((i_p == end_p) && (i_base == end_base)) {
-                result = DOT;
-        } else if ((i_p != p.begin()) && (i_base != base.begin())) {
-                for (; i_base != end_base; ++i_base) {
-                        result /= DOTDOT;
+        long dotdots = 0;
+
+        for (; !i_base.done(); i_base.next()) {
+                if (i_base.is("..")) {
+                        --dotdots;
+                } else if (!i_base.empty() && !i_base.is(".")) {
+                        ++dotdots;
+                }
+        }
+
+        if (dotdots < 0) {
+                return path();
+        } else if ((dotdots == 0) && (i_p.done() || i_p.empty())) {
+                return DOT;
+        }
+
+        path::string_type result;
+
+        for (; dotdots > 0; --dotdots) {
+                if (!result.empty()) {
+                        result += path::preferred_separator;
                 }
-                for (; i_p != end_p; ++i_p) {
-                        result /= *i_p;
+                result += DOTDOT.native();
+        }
+        for (; !i_p.done(); i_p.next()) {
+                if (!result.empty()) {
+                        result += path::preferred_separator;
                 }
+                result.append(i_p.begin(), i_p.end());
         }
 
-        return result;
+        return path(std::move(result));
 }
 
 
@@ -3,9 +3,8 @@
  *
  * \brief Internal function wr::make_lexically_normal()
  *
- * make_lexically_normal() is used to implement the functions
- * wr::lexically_normal() and wr::weakly_canonical() when either of
- * those are not provided by the underlying filesystem library.
+ * make_lexically_normal() is used to implement wr::weakly_canonical()
+ * on systems without openat().
  *
  * \copyright
  * \parblock
@@ -34,39 +33,23 @@
 namespace wr {
 
 
+/*
+ * Appends the elements [src_i, src_end) to dst and normalizes the result
+ * in place
+ */
 path &
 make_lexically_normal(
         path                 &dst,
-        const path           &src,
         path::const_iterator  src_i,
         path::const_iterator  src_end
 )
 {
-        path::const_iterator src_next;
-        path                 root = src.root_path();
-
-        for (; src_i != src_end; src_i = src_next) {
-                src_next = std::next(src_i);
-                if ((*src_i == DOT) && (src_next != src_end)) {
-                        continue;  // omit "/./" component
-                } else if ((*src_i == DOTDOT) && !dst.empty()) {
-                        if (dst == root) {  // "/.." == "/"
-                                continue;
-                        } else if (*std::prev(dst.end()) != DOTDOT) {
-                                // omit "/../" component and strip previous one
-                                dst.remove_filename();
-                                continue;
-                        }
-                        }
+        for (; src_i != src_end; ++src_i) {
                 dst /= *src_i;
         }
 
-        auto &s = dst.native();
-
-        if (!s.empty() && is_separator(s.back())) {
-                dst /= ".";
-        }
-
+        path::string_type s = dst.native();
+        dst = std::move(lexically_normalize(s));
         return dst;
 }
 
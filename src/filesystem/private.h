@@ -37,14 +37,38 @@
 namespace wr {
 
 
-#if !WR_HAVE_FS_PATH_LEXICALLY_NORMAL || !WR_HAVE_FSIMPL_WEAKLY_CANONICAL
+/*
+ * Returns the length of the root name at the start of the native path
+ * string [s, end), e.g. "C:" or "\\server"; only Windows has them
+ */
+template <typename Char> inline size_t
+root_name_length(
+        const Char *s,
+        const Char *end
+)
+{
+#if WR_WINDOWS && !WR_CYGWIN
+        if ((end - s >= 2) && (s[1] == ':') && !is_separator(s[0])) {
+                return 2;
+        } else if ((end - s >= 3) && is_separator(s[0])
+                                  && is_separator(s[1])
+                                  && !is_separator(s[2])) {
+                const Char *p = s + 3;
+                while ((p != end) && !is_separator(*p)) {
+                        ++p;
+                }
+                return size_t(p - s);
+        }
+#else
+        (void) s;
+        (void) end;
+#endif
+        return 0;
+}
 
-path &make_lexically_normal(path &dst, const path &src,
-                            path::const_iterator src_i,
+path &make_lexically_normal(path &dst, path::const_iterator src_i,
                             path::const_iterator src_end);
 
-#endif
-
 
 } // namespace wr
 
@@ -67,11 +67,11 @@ proximate(
         fs_error_code &ec
 )
 {
-        path p_canon = weakly_canonical(p, ec),
+        path p_canon = wr::weakly_canonical(p, ec),
              result;
 
         if (!ec) {
-                path base_canon = weakly_canonical(base, ec);
+                path base_canon = wr::weakly_canonical(base, ec);
 
                 if (!ec) {
                         result = lexically_proximate(p_canon, base_canon);
@@ -0,0 +1,704 @@
+/**
+ * \file scantree.cxx
+ *
+ * \brief Implementation of wr::scan_tree()
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <wrutil/Config.h>
+
+#if WR_POSIX
+#       include <dirent.h>
+#       include <fcntl.h>
+#       include <sys/stat.h>
+#       include <sys/types.h>
+#       include <unistd.h>
+#else
+#       include <chrono>
+#endif
+#if WR_LINUX
+#       include <sys/syscall.h>
+#       include <sys/sysmacros.h>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <wrutil/scan_tree.h>
+
+#if WR_HAVE_STD_FILESYSTEM
+#       include <system_error>
+#else
+#       include <boost/system/error_code.hpp>
+#endif
+
+
+namespace wr {
+
+
+#if WR_HAVE_STD_FILESYSTEM
+using std::system_category;
+#else
+using boost::system_category;
+#endif
+
+
+namespace {
+
+
+enum
+{
+        READ_BUFFER_SIZE = 128 * 1024  // per worker
+};
+
+#ifdef O_CLOEXEC
+constexpr int CLOEXEC_FLAG = O_CLOEXEC;
+#else
+constexpr int CLOEXEC_FLAG = 0;
+#endif
+
+struct Dir
+{
+        std::string path;  // native
+        unsigned    depth;
+};
+
+//--------------------------------------
+#if WR_POSIX
+
+/*
+ * Closes a directory's descriptor, or the DIR stream that has taken it
+ * over, however the scan of the directory ends
+ */
+class DirCloser
+{
+public:
+        explicit DirCloser(int fd) : fd_(fd), dir_(nullptr) {}
+
+        DirCloser(const DirCloser &) = delete;
+
+        ~DirCloser()
+        {
+                if (dir_) {
+                        ::closedir(dir_);
+                } else {
+                        ::close(fd_);
+                }
+        }
+
+        DirCloser &operator=(const DirCloser &) = delete;
+
+        void adopt(DIR *dir) { dir_ = dir; }
+
+private:
+        int  fd_;
+        DIR *dir_;
+};
+
+//--------------------------------------
+
+file_type
+typeFromMode(
+        mode_t mode
+)
+{
+        switch (mode & S_IFMT) {
+        case S_IFREG:
+                return file_type::regular;
+        case S_IFDIR:
+                return file_type::directory;
+        case S_IFLNK:
+                return file_type::symlink;
+        case S_IFBLK:
+                return file_type::block;
+        case S_IFCHR:
+                return file_type::character;
+        case S_IFIFO:
+                return file_type::fifo;
+        case S_IFSOCK:
+                return file_type::socket;
+        default:
+                return file_type::unknown;
+        }
+}
+
+//--------------------------------------
+
+file_type
+typeFromDirent(
+        unsigned char d_type
+)
+{
+#ifdef DT_UNKNOWN
+        switch (d_type) {
+        case DT_REG:
+                return file_type::regular;
+        case DT_DIR:
+                return file_type::directory;
+        case DT_LNK:
+                return file_type::symlink;
+        case DT_BLK:
+                return file_type::block;
+        case DT_CHR:
+                return file_type::character;
+        case DT_FIFO:
+                return file_type::fifo;
+        case DT_SOCK:
+                return file_type::socket;
+        default:
+                break;
+        }
+#else
+        (void) d_type;
+#endif
+        return file_type::unknown;
+}
+
+//--------------------------------------
+/*
+ * Fills in the type and metadata of `entry`, whose name is relative to the
+ * directory open as `dir_fd`; statx() is asked only for the fields wanted
+ */
+bool
+statEntry(
+        int            dir_fd,
+        const char    *name,
+        bool           want_stat,
+        scan_entry    &entry,
+        fs_error_code &ec
+)
+{
+#if WR_LINUX && defined(STATX_BASIC_STATS)
+        struct statx stx;
+        unsigned     mask = want_stat ? (STATX_TYPE | STATX_MODE | STATX_INO
+                                         | STATX_SIZE | STATX_MTIME)
+                                      : STATX_TYPE;
+
+        if (::statx(dir_fd, name, AT_SYMLINK_NOFOLLOW, mask, &stx) != 0) {
+                ec.assign(errno, system_category());
+                return false;
+        }
+
+        entry.type = typeFromMode(stx.stx_mode);
+        if (want_stat) {
+                entry.dev = uint64_t(makedev(stx.stx_dev_major,
+                                             stx.stx_dev_minor));
+                entry.ino = stx.stx_ino;
+                entry.size = stx.stx_size;
+                entry.mtime_ns = int64_t(stx.stx_mtime.tv_sec) * 1000000000
+                                 + stx.stx_mtime.tv_nsec;
+                entry.mode = stx.stx_mode;
+        }
+#else
+        struct stat st;
+
+        if (::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                ec.assign(errno, system_category());
+                return false;
+        }
+
+        entry.type = typeFromMode(st.st_mode);
+        if (want_stat) {
+                entry.dev = uint64_t(st.st_dev);
+                entry.ino = uint64_t(st.st_ino);
+                entry.size = uint64_t(st.st_size);
+#if WR_MACOS
+                entry.mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000
+                                 + st.st_mtimespec.tv_nsec;
+#else
+                entry.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000
+                                 + st.st_mtim.tv_nsec;
+#endif
+                entry.mode = uint32_t(st.st_mode);
+        }
+#endif
+        return true;
+}
+
+#endif // WR_POSIX
+//--------------------------------------
+/*
+ * Each worker takes directories from the back of its own queue, so that
+ * it works depth first through the directories it has found, and when
+ * that is empty takes the oldest, and so probably largest, unscanned
+ * subtree from the front of another worker's queue
+ */
+class Scan
+{
+public:
+        Scan(const scan_options  &options,
+             const scan_callback &callback,
+             unsigned             threads);
+
+        void push(unsigned worker, Dir &&dir);
+
+        void work(unsigned self);
+
+        void fail(const fs_error_code &ec, std::exception_ptr exc);
+
+        bool failed(fs_error_code &ec, std::exception_ptr &exc) const
+                { ec = ec_; exc = exc_; return failed_; }
+
+private:
+        struct Queue
+        {
+                std::mutex      mutex;
+                std::deque<Dir> dirs;
+        };
+
+        bool take(unsigned self, Dir &dir);
+        void scanDirectory(const Dir &dir, char *buf,
+                           std::vector<Dir> &subdirs);
+        bool report(const Dir &dir, scan_entry &entry,
+                    std::vector<Dir> &subdirs);
+        void finish(unsigned self, std::vector<Dir> &subdirs);
+
+        const scan_options       &options_;
+        const scan_callback      &callback_;
+        unsigned                  threads_;
+        std::unique_ptr<Queue[]>  queues_;
+        std::atomic<size_t>       queued_,
+                                  outstanding_;  // queued or being scanned
+        std::atomic<unsigned>     sleepers_;
+        std::atomic<bool>         failed_;
+        std::mutex                mutex_;        // for sleeping and failure
+        std::condition_variable   cond_;
+        fs_error_code             ec_;
+        std::exception_ptr        exc_;
+};
+
+//--------------------------------------
+
+Scan::Scan(
+        const scan_options  &options,
+        const scan_callback &callback,
+        unsigned             threads
+) :
+        options_    (options),
+        callback_   (callback),
+        threads_    (threads),
+        queues_     (new Queue[threads]),
+        queued_     (0),
+        outstanding_(0),
+        sleepers_   (0),
+        failed_     (false)
+{
+}
+
+//--------------------------------------
+
+void
+Scan::push(
+        unsigned   worker,
+        Dir      &&dir
+)
+{
+        ++outstanding_;
+        {
+                std::lock_guard<std::mutex> lock(queues_[worker].mutex);
+                queues_[worker].dirs.push_back(std::move(dir));
+        }
+        ++queued_;
+}
+
+//--------------------------------------
+/*
+ * Worker thread body; returns once every directory has been scanned or
+ * the scan has failed
+ */
+void
+Scan::work(
+        unsigned self
+)
+{
+        std::unique_ptr<char[]> buf(new char[READ_BUFFER_SIZE]);
+        std::vector<Dir>        subdirs;
+        Dir                     dir;
+
+        while (take(self, dir)) {
+                try {
+                        scanDirectory(dir, buf.get(), subdirs);
+                } catch (...) {
+                        fail(fs_error_code(), std::current_exception());
+                }
+                finish(self, subdirs);
+        }
+}
+
+//--------------------------------------
+
+bool
+Scan::take(
+        unsigned  self,
+        Dir      &dir
+)
+{
+        while (!failed_) {
+                for (unsigned i = 0; i < threads_; ++i) {
+                        Queue &queue = queues_[(self + i) % threads_];
+                        std::lock_guard<std::mutex> lock(queue.mutex);
+
+                        if (queue.dirs.empty()) {
+                                continue;
+                        } else if (i == 0) {
+                                dir = std::move(queue.dirs.back());
+                                queue.dirs.pop_back();
+                        } else {
+                                dir = std::move(queue.dirs.front());
+                                queue.dirs.pop_front();
+                        }
+                        --queued_;
+                        return true;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex_);
+                ++sleepers_;
+                cond_.wait(lock, [this] {
+                        return (queued_ > 0) || (outstanding_ == 0)
+                                             || failed_;
+                });
+                --sleepers_;
+                if (outstanding_ == 0) {
+                        return false;
+                }
+        }
+
+        return false;
+}
+
+//--------------------------------------
+/*
+ * Queues the subdirectories found in a directory, then marks it done;
+ * the count of outstanding directories only reaches zero once there is
+ * nothing more to find
+ */
+void
+Scan::finish(
+        unsigned          self,
+        std::vector<Dir> &subdirs
+)
+{
+        bool pushed = !subdirs.empty() && !failed_;
+
+        if (pushed) {
+                outstanding_ += subdirs.size();
+                {
+                        std::lock_guard<std::mutex> lock(queues_[self].mutex);
+                        for (auto &subdir: subdirs) {
+                                queues_[self].dirs.push_back(
+                                                        std::move(subdir));
+                        }
+                }
+                queued_ += subdirs.size();
+        }
+        subdirs.clear();
+
+        if ((--outstanding_ == 0) || (pushed && (sleepers_ > 0))) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cond_.notify_all();
+        }
+}
+
+//--------------------------------------
+
+void
+Scan::scanDirectory(
+        const Dir        &dir,
+        char             *buf,
+        std::vector<Dir> &subdirs
+)
+{
+        scan_entry entry = scan_entry();
+
+        entry.dir = u8string_view(dir.path);
+        entry.depth = dir.depth + 1;
+
+#if WR_POSIX
+        fs_error_code ec;
+        int           flags = O_RDONLY | O_DIRECTORY | CLOEXEC_FLAG;
+
+        if (dir.depth > 0) {
+                flags |= O_NOFOLLOW;  // in case it became a link since
+        }
+
+        int fd = ::open(dir.path.c_str(), flags);
+        if (fd < 0) {
+                fail(fs_error_code(errno, system_category()),
+                     std::exception_ptr());
+                return;
+        }
+        DirCloser closer(fd);  // the callback may throw
+
+        auto visit = [&](const char *name, unsigned char d_type) {
+                if ((name[0] == '.') && (!name[1] || ((name[1] == '.')
+                                                      && !name[2]))) {
+                        return true;
+                }
+
+                entry.name = u8string_view(name, strlen(name));
+                entry.type = typeFromDirent(d_type);
+
+                if (options_.want_stat
+                                || (entry.type == file_type::unknown)) {
+                        if (!statEntry(fd, name, options_.want_stat, entry,
+                                       ec)) {
+                                if (ec.value() != ENOENT) {
+                                        return false;
+                                }
+                                ec.clear();  // removed since it was read
+                                return true;
+                        }
+                }
+
+                return report(dir, entry, subdirs);
+        };
+
+#if WR_LINUX
+        struct Dirent64
+        {
+                uint64_t       d_ino;
+                int64_t        d_off;
+                unsigned short d_reclen;
+                unsigned char  d_type;
+                char           d_name[1];
+        };
+
+        for (bool more = true; more; ) {
+                long n = ::syscall(SYS_getdents64, fd, buf, READ_BUFFER_SIZE);
+                if (n < 0) {
+                        if (errno != EINTR) {
+                                ec.assign(errno, system_category());
+                                break;
+                        }
+                        continue;
+                } else if (n == 0) {
+                        break;
+                }
+
+                for (long offset = 0; more && (offset < n); ) {
+                        auto d = reinterpret_cast<const Dirent64 *>(
+                                                                buf + offset);
+                        offset += d->d_reclen;
+                        more = visit(d->d_name, d->d_type);
+                }
+        }
+#else // !WR_LINUX
+        (void) buf;
+
+        DIR *d = ::fdopendir(fd);
+        if (!d) {
+                ec.assign(errno, system_category());
+        } else {
+                struct dirent *de;
+
+                closer.adopt(d);
+
+                while (true) {
+                        errno = 0;
+                        if (!(de = ::readdir(d))) {
+                                if (errno) {
+                                        ec.assign(errno, system_category());
+                                }
+                                break;
+                        }
+#ifdef DT_UNKNOWN
+                        if (!visit(de->d_name, de->d_type)) {
+#else
+                        if (!visit(de->d_name, 0)) {
+#endif
+                                break;
+                        }
+                }
+        }
+#endif // !WR_LINUX
+
+        if (ec) {
+                fail(ec, std::exception_ptr());
+        }
+#else // !WR_POSIX
+        (void) buf;
+
+        fs_error_code ec;
+        std::string   name;
+
+        for (directory_iterator i(u8path(dir.path), ec), end;
+                                        !ec && (i != end); i.increment(ec)) {
+                file_status st = i->symlink_status(ec);
+                if (ec) {
+                        break;
+                }
+
+                name = to_u8string(i->path().filename());
+                entry.name = u8string_view(name);
+                entry.type = st.type();
+                if (options_.want_stat) {
+                        entry.size = (st.type() == file_type::regular)
+                                        ? uint64_t(file_size(i->path()))
+                                        : 0;
+                        entry.mtime_ns = std::chrono::duration_cast<
+                                        std::chrono::nanoseconds>(
+                                                last_write_time(i->path())
+                                                .time_since_epoch()).count();
+                        entry.mode = uint32_t(st.permissions());
+                }
+                if (!report(dir, entry, subdirs)) {
+                        break;
+                }
+        }
+
+        if (ec) {
+                fail(ec, std::exception_ptr());
+        }
+#endif // !WR_POSIX
+}
+
+//--------------------------------------
+/*
+ * Passes `entry` to the callback and, if it is a directory the callback
+ * wants descended into, adds it to `subdirs`; returns false once the scan
+ * has failed
+ */
+bool
+Scan::report(
+        const Dir        &dir,
+        scan_entry       &entry,
+        std::vector<Dir> &subdirs
+)
+{
+        if (failed_) {
+                return false;
+        }
+
+        if (callback_(entry) && (entry.type == file_type::directory)) {
+                std::string subdir;
+
+                subdir.reserve(dir.path.size() + entry.name.bytes() + 1);
+                subdir = dir.path;
+                if (!subdir.empty() && !is_separator(subdir.back())) {
+                        subdir += char(path::preferred_separator);
+                }
+                subdir.append(entry.name.char_data(), entry.name.bytes());
+                subdirs.push_back(Dir { std::move(subdir), entry.depth });
+        }
+
+        return true;
+}
+
+//--------------------------------------
+
+void
+Scan::fail(
+        const fs_error_code &ec,
+        std::exception_ptr   exc
+)
+{
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!failed_) {
+                failed_ = true;
+                ec_ = ec;
+                exc_ = exc;
+        }
+        cond_.notify_all();
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+WRUTIL_API void
+scan_tree(
+        const path          &root,
+        const scan_options  &options,
+        const scan_callback &callback
+)
+{
+        fs_error_code ec;
+        scan_tree(root, options, callback, ec);
+        if (ec) {
+                throw filesystem_error("error scanning directory tree",
+                                       root, ec);
+        }
+}
+
+//--------------------------------------
+
+WRUTIL_API void
+scan_tree(
+        const path          &root,
+        const scan_options  &options,
+        const scan_callback &callback,
+        fs_error_code       &ec
+)
+{
+        ec.clear();
+
+        unsigned threads = options.threads
+                                ? options.threads
+                                : std::thread::hardware_concurrency();
+        if (threads == 0) {
+                threads = 1;
+        }
+
+        Scan                     scan(options, callback, threads);
+        std::vector<std::thread> workers;
+
+#if WR_POSIX
+        scan.push(0, Dir { root.native(), 0 });
+#else
+        scan.push(0, Dir { to_u8string(root), 0 });
+#endif
+
+        try {
+                for (unsigned i = 1; i < threads; ++i) {
+                        workers.emplace_back(&Scan::work, &scan, i);
+                }
+        } catch (...) {
+                // destroying a joinable std::thread calls std::terminate(),
+                // so stop and join the workers already started first
+                scan.fail(fs_error_code(), std::exception_ptr());
+                for (auto &worker: workers) {
+                        worker.join();
+                }
+                throw;
+        }
+        scan.work(0);
+        for (auto &worker: workers) {
+                worker.join();
+        }
+
+        std::exception_ptr exc;
+
+        if (scan.failed(ec, exc) && exc) {
+                std::rethrow_exception(exc);
+        }
+}
+
+
+} // namespace wr
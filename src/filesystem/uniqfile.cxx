@@ -0,0 +1,110 @@
+/**
+ * \file uniqfile.cxx
+ *
+ * \brief Implementation of the wr::create_unique_file() functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <wrutil/Config.h>
+#include <errno.h>
+#include <fcntl.h>
+#if WR_POSIX
+#       include <unistd.h>
+#elif WR_WINAPI
+#       include <io.h>
+#       include <sys/stat.h>
+#endif
+#include "private.h"
+
+
+namespace wr {
+
+
+#if WR_HAVE_STD_FILESYSTEM
+using std::system_category;
+#else
+using boost::system_category;
+#endif
+
+
+namespace {
+
+enum { MAX_ATTEMPTS = 100 };
+
+} // anonymous namespace
+
+//--------------------------------------
+
+WRUTIL_API int
+create_unique_file(
+        const path &pattern,
+        path       &result
+)
+{
+        fs_error_code ec;
+        int fd = create_unique_file(pattern, result, ec);
+        if (ec) {
+                throw filesystem_error("error creating unique file",
+                                       pattern, ec);
+        }
+        return fd;
+}
+
+//--------------------------------------
+
+WRUTIL_API int
+create_unique_file(
+        const path    &pattern,
+        path          &result,
+        fs_error_code &ec
+)
+{
+        // without a '%' to fill in there is only one name to try
+        int attempts = (pattern.native().find('%') == path::string_type::npos)
+                     ? 1 : MAX_ATTEMPTS;
+
+        while (attempts--) {
+                result = unique_path(pattern, ec);
+                if (ec) {
+                        return -1;
+                }
+#if WR_POSIX
+                int fd = open(result.c_str(),
+                              O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+#elif WR_WINAPI
+                int fd = _wopen(result.c_str(),
+                                _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY
+                                        | _O_NOINHERIT,
+                                _S_IREAD | _S_IWRITE);
+#endif
+                if (fd >= 0) {
+                        return fd;
+                }
+                ec.assign(errno, system_category());
+                if (errno != EEXIST) {
+                        break;
+                }
+        }
+
+        return -1;
+}
+
+
+} // namespace wr
@@ -27,25 +27,149 @@
  * \endparblock
  */
 #include <wrutil/Config.h>
+#if WR_WINAPI
+#       define _CRT_RAND_S  // for rand_s()
+#endif
+#include <stdlib.h>
 #if WR_POSIX
+#       include <errno.h>
+#       include <fcntl.h>
 #       include <unistd.h>
-#elif WR_WINAPI
-#       include <windows.h>
+#       if WR_HAVE_GETRANDOM
+#               include <sys/random.h>
+#       endif
 #endif
-#include <stdio.h>
-#include <wchar.h>
-#include <chrono>
-#include <fstream>
-#include <memory>
-#include <string>
-#include <thread>
-#include <wrutil/SHA256.h>
+#include <string.h>
 #include "private.h"
 
 
 namespace wr {
 
 
+#if WR_HAVE_STD_FILESYSTEM
+using std::generic_category;
+using std::system_category;
+#else
+using boost::system::generic_category;
+using boost::system_category;
+#endif
+
+
+namespace {
+
+/*
+ * Random bytes for unique_path(), drawn from the system's CSPRNG a pool
+ * at a time; one pool is kept per thread, so no locking is needed, and on
+ * POSIX systems it is discarded in a child process after fork() so that
+ * parent and child never fill in the same names
+ */
+class RandomPool
+{
+public:
+        void check_fork();
+        bool get(unsigned &byte, fs_error_code &ec);
+
+private:
+        bool refill(fs_error_code &ec);
+
+        unsigned char bytes_[256];
+        size_t        avail_ = 0;
+#if WR_POSIX
+        pid_t         pid_ = 0;
+#endif
+};
+
+//--------------------------------------
+
+void
+RandomPool::check_fork()
+{
+#if WR_POSIX
+        pid_t pid = getpid();
+        if (pid != pid_) {
+                avail_ = 0;
+                pid_ = pid;
+        }
+#endif
+}
+
+//--------------------------------------
+
+bool
+RandomPool::get(
+        unsigned      &byte,
+        fs_error_code &ec
+)
+{
+        if (!avail_ && !refill(ec)) {
+                return false;
+        }
+        byte = bytes_[--avail_];
+        return true;
+}
+
+//--------------------------------------
+
+bool
+RandomPool::refill(
+        fs_error_code &ec
+)
+{
+#if WR_POSIX
+        size_t got = 0;
+#if WR_HAVE_GETRANDOM
+        while (got < sizeof(bytes_)) {
+                ssize_t n = getrandom(bytes_ + got, sizeof(bytes_) - got, 0);
+                if (n >= 0) {
+                        got += size_t(n);
+                } else if (errno == ENOSYS) {
+                        break;  // kernel too old; use /dev/urandom
+                } else if (errno != EINTR) {
+                        ec.assign(errno, system_category());
+                        return false;
+                }
+        }
+#endif
+        if (got < sizeof(bytes_)) {
+                int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                        ec.assign(errno, system_category());
+                        return false;
+                }
+                while (got < sizeof(bytes_)) {
+                        ssize_t n = read(fd, bytes_ + got,
+                                         sizeof(bytes_) - got);
+                        if (n > 0) {
+                                got += size_t(n);
+                        } else if ((n == 0) || (errno != EINTR)) {
+                                ec.assign(n ? errno : EIO,
+                                          system_category());
+                                close(fd);
+                                return false;
+                        }
+                }
+                close(fd);
+        }
+#elif WR_WINAPI
+        for (size_t i = 0; i < sizeof(bytes_); i += sizeof(unsigned)) {
+                unsigned r;
+                errno_t  err = rand_s(&r);
+                if (err) {
+                        ec.assign(err, generic_category());
+                        return false;
+                }
+                memcpy(bytes_ + i, &r, sizeof(r));
+        }
+#endif
+        avail_ = sizeof(bytes_);
+        return true;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
 WRUTIL_API path
 unique_path(
         const path &pattern
@@ -62,87 +186,39 @@ unique_path(
 
 //--------------------------------------
 
+/*
+ * Each '%' in the pattern is replaced by a lowercase hexadecimal digit
+ * taken from four random bits, working directly on the native string
+ */
 WRUTIL_API path
 unique_path(
         const path    &pattern,
         fs_error_code &ec
 )
 {
-        SHA256       hasher;
-        std::wstring result = pattern.wstring(), hash_str(64, 0);
+        static const char              HEX_DIGITS[] = "0123456789abcdef";
+        static thread_local RandomPool pool;
 
-        std::thread::id this_thread_id = std::this_thread::get_id();
-        hasher.append(&this_thread_id, sizeof(this_thread_id));
-
-        auto pid =
-#if WR_POSIX
-                getpid()
-#elif WR_WINAPI
-                GetCurrentProcessId()
-#endif
-                ;
-        hasher.append(&pid, sizeof(pid));
-
-        const void *some_addr = &hasher;  // mix in a stack address
-        hasher.append(&some_addr, sizeof(some_addr));
-
-        // mix in a code address (take advantage of any address randomization)
-        some_addr = reinterpret_cast<void *>(&path_has_prefix);
-        hasher.append(&some_addr, sizeof(some_addr));
-
-        // mix in address of hash_str's data (probably heap)
-        some_addr = hash_str.data();
-        hasher.append(&some_addr, sizeof(some_addr));
-
-        for (auto i = result.begin(), j = result.end(); i < j; ) {
-                auto time = std::chrono::high_resolution_clock::now()
-                                                        .time_since_epoch();
-                hasher.append(&time, sizeof(time));
-                std::this_thread::yield();  // introduce some scheduler delay
-
-                {
-                        // mix in a heap address
-                        std::unique_ptr<char> addr(new char);
-                        some_addr = addr.get();
-                        hasher.append(&some_addr, sizeof(some_addr));
-                }
+        path::string_type result = pattern.native();
+        unsigned          bits = 0;
+        bool              have_nibble = false;
 
-                time = std::chrono::high_resolution_clock::now()
-                                                        .time_since_epoch();
-                hasher.append(&time, sizeof(time));
-#if WR_POSIX
-                {
-                        std::ifstream random("/dev/urandom");
-                        char          bytes[16];
-                        if (random.is_open()) {
-                                random.read(bytes, sizeof(bytes));
-                                hasher.append(bytes, sizeof(bytes));
-                        }
-                }
-#endif
-                time = std::chrono::high_resolution_clock::now()
-                                                        .time_since_epoch();
-                hasher.append(&time, sizeof(time));
-
-                const SHA256::Hash &h = hasher.hash();
-                swprintf(&hash_str[0], hash_str.size(),
-                         L"%.08x%.08x%.08x%.08x%.08x%.08x%.08x%.08x",
-                         h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
-
-                for (auto x = hash_str.begin(), y = hash_str.end();
-                                                (i < j) && (x < y); ++i) {
-                        if (*i == '%') {
-                                *i = *x++;
-                        }
+        pool.check_fork();
+        for (auto &c: result) {
+                if (c != '%') {
+                        continue;
                 }
-
-                if (i < j) {
-                        hasher.append(hash_str.data(),
-                                      sizeof(wchar_t) * hash_str.size());
+                if (have_nibble) {
+                        bits >>= 4;
+                } else if (!pool.get(bits, ec)) {
+                        return path();
                 }
+                c = path::value_type(HEX_DIGITS[bits & 0xf]);
+                have_nibble = !have_nibble;
         }
 
-        return result;
+        ec.clear();
+        return path(std::move(result));
 }
 
 
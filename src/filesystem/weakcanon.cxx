@@ -3,14 +3,16 @@
  *
  * \brief Implementation of the wr::weakly_canonical() filesystem functions
  *
- * \note This file is used only when the underlying filesystem library
- *       (boost::filesystem or C++ standard library) does not provide
- *       its own version of weakly_canonical()
+ * On POSIX systems the path is resolved one filename at a time relative
+ * to a file descriptor for the directory reached so far, so that each
+ * lookup costs one system call instead of one per filename leading to it.
+ * Elsewhere the longest existing prefix of the path is found by testing
+ * each in turn and passed to canonical().
  *
  * \copyright
  * \parblock
  *
- *   Copyright 2013-2016 James S. Waller
+ *   Copyright 2013-2017 James S. Waller
  *
  *   Licensed under the Apache License, Version 2.0 (the "License");
  *   you may not use this file except in compliance with the License.
@@ -26,19 +28,426 @@
  *
  * \endparblock
  */
+#include <wrutil/Config.h>
+
+#if WR_POSIX
+#       include <fcntl.h>
+#       include <limits.h>
+#       include <unistd.h>
+#endif
+#include <errno.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include "private.h"
 
 
 namespace wr {
 
 
+#if WR_HAVE_STD_FILESYSTEM
+using std::system_category;
+#else
+using boost::system_category;
+#endif
+
+
+namespace {
+
+
+enum class EntryType
+{
+        DIRECTORY,
+        SYMLINK,
+        OTHER,    // exists but is neither a directory nor a symbolic link
+        MISSING
+};
+
+struct Entry
+{
+        EntryType   type;
+        std::string target;  // of a symbolic link
+};
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+struct canonical_cache::Impl
+{
+        std::mutex                             mutex;
+        std::unordered_map<std::string, Entry> entries;  // by canonical path
+};
+
+//--------------------------------------
+
+WRUTIL_API
+canonical_cache::canonical_cache() :
+        impl_(new Impl)
+{
+}
+
+//--------------------------------------
+
+WRUTIL_API
+canonical_cache::~canonical_cache() = default;
+
+//--------------------------------------
+
+WRUTIL_API void
+canonical_cache::clear()
+{
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->entries.clear();
+}
+
+//--------------------------------------
+#if WR_POSIX
+
+namespace {
+
+
+#ifdef O_PATH
+constexpr int SEARCH_FLAGS = O_PATH;
+#elif defined(O_SEARCH)
+constexpr int SEARCH_FLAGS = O_SEARCH;
+#else
+constexpr int SEARCH_FLAGS = O_RDONLY;
+#endif
+
+#ifdef O_CLOEXEC
+constexpr int CLOEXEC_FLAG = O_CLOEXEC;
+#else
+constexpr int CLOEXEC_FLAG = 0;
+#endif
+
+enum
+{
+        MAX_SYMLINKS = 40  // as Linux allows when resolving a path
+};
+
+
+} // anonymous namespace
+
+//--------------------------------------
+/*
+ * resolved_ holds the canonical path of the directory reached so far and
+ * dir_fd_ refers to it, but is only opened when a filename in it has to
+ * be looked up; filenames known to the cache need no file descriptor
+ */
+class CanonicalWalk
+{
+public:
+        explicit CanonicalWalk(canonical_cache *cache) :
+                cache_ (cache ? cache->impl_.get() : nullptr),
+                dir_fd_(-1)
+        {
+        }
+
+        CanonicalWalk(const CanonicalWalk &other) = delete;
+
+        ~CanonicalWalk() { closeDir(); }
+
+        CanonicalWalk &operator=(const CanonicalWalk &other) = delete;
+
+        path run(const path &p, fs_error_code &ec);
+
+private:
+        bool lookup(const std::string &child, size_t name_len, Entry &entry,
+                    int &fd, fs_error_code &ec);
+        bool openDir(fs_error_code &ec);
+        void closeDir();
+        void toParent();
+
+        canonical_cache::Impl *cache_;
+        std::string            resolved_;
+        int                    dir_fd_;
+};
+
+//--------------------------------------
+
+path
+CanonicalWalk::run(
+        const path    &p,
+        fs_error_code &ec
+)
+{
+        ec.clear();
+
+        std::string rest = p.native(),  // the filenames still to resolve
+                    saved_resolved, saved_rest;
+        size_t      pos = 0, tail = std::string::npos,
+                    orig_left = rest.size();  // chars of rest from p
+        bool        absolute = !rest.empty() && is_separator(rest[0]),
+                    any_exist = absolute, saved_any_exist = false;
+        unsigned    links = 0;
+
+        if (rest.empty()) {
+                return path();
+        } else if (absolute) {
+                resolved_ = "/";
+        } else {
+                resolved_ = current_path(ec).native();
+                if (ec) {
+                        return path();
+                }
+        }
+
+        /*
+         * Following a symbolic link replaces the filename naming it with
+         * the link's target. If the target turns out not to exist, neither
+         * does that filename, so everything is put back as it was before.
+         */
+        auto unresolvable_link = [&] {
+                closeDir();
+                resolved_.swap(saved_resolved);
+                rest.swap(saved_rest);
+                any_exist = saved_any_exist;
+                tail = 0;
+        };
+
+        while (true) {
+                while ((pos < rest.size()) && is_separator(rest[pos])) {
+                        ++pos;
+                }
+                if (pos == rest.size()) {
+                        break;
+                }
+
+                size_t start = pos;
+                while ((pos < rest.size()) && !is_separator(rest[pos])) {
+                        ++pos;
+                }
+
+                size_t len = pos - start;
+
+                if ((len == 1) && (rest[start] == '.')) {
+                        any_exist = true;
+                        continue;
+                } else if ((len == 2) && (rest[start] == '.')
+                                      && (rest[start + 1] == '.')) {
+                        any_exist = true;
+                        toParent();
+                        continue;
+                }
+
+                std::string child = resolved_;
+                if (child.back() != '/') {
+                        child += '/';
+                }
+                child.append(rest, start, len);
+
+                Entry entry;
+                int   fd = -1;
+
+                if (!lookup(child, len, entry, fd, ec)) {
+                        return path();
+                }
+
+                bool from_link = (start < rest.size() - orig_left);
+
+                if (entry.type == EntryType::MISSING) {
+                        tail = start;
+                        if (from_link) {
+                                unresolvable_link();
+                        }
+                        break;
+                }
+
+                if (entry.type == EntryType::SYMLINK) {
+                        if (++links > MAX_SYMLINKS) {
+                                ec.assign(ELOOP, system_category());
+                                return path();
+                        }
+                        if (!from_link) {
+                                saved_any_exist = any_exist;
+                                saved_resolved = resolved_;
+                                saved_rest.assign(rest, start,
+                                                  std::string::npos);
+                        }
+                        orig_left = std::min(orig_left, rest.size() - pos);
+                        if (pos < rest.size()) {
+                                entry.target.append(rest, pos,
+                                                    std::string::npos);
+                        }
+                        rest.swap(entry.target);
+                        pos = 0;
+                        if (is_separator(rest[0])) {
+                                closeDir();
+                                resolved_ = "/";
+                                any_exist = true;
+                        }
+                        continue;
+                }
+
+                any_exist = true;
+                closeDir();
+                resolved_.swap(child);
+                dir_fd_ = fd;
+
+                if ((entry.type == EntryType::OTHER) && (pos < rest.size())) {
+                        // nothing below a non-directory exists
+                        tail = pos;
+                        if (pos < rest.size() - orig_left) {
+                                unresolvable_link();
+                        }
+                        break;
+                }
+        }
+
+        if (!any_exist) {
+                return lexically_normal(p);
+        }
+
+        std::string result;
+        result.swap(resolved_);
+        if (tail != std::string::npos) {
+                result += '/';
+                result.append(rest, tail, std::string::npos);
+        }
+
+        return path(std::move(lexically_normalize(result)));
+}
+
+//--------------------------------------
+/*
+ * Finds out what `child`, a filename of name_len chars appended to
+ * resolved_, refers to. If it is a directory, fd is set to a descriptor
+ * for it unless the answer came from the cache.
+ */
+bool
+CanonicalWalk::lookup(
+        const std::string &child,
+        size_t             name_len,
+        Entry             &entry,
+        int               &fd,
+        fs_error_code     &ec
+)
+{
+        if (cache_) {
+                std::lock_guard<std::mutex> lock(cache_->mutex);
+                auto i = cache_->entries.find(child);
+                if (i != cache_->entries.end()) {
+                        entry = i->second;
+                        return true;
+                }
+        }
+
+        if (!openDir(ec)) {
+                return false;
+        }
+
+        const char *name = child.c_str() + (child.size() - name_len);
+
+        fd = ::openat(dir_fd_, name, SEARCH_FLAGS | O_DIRECTORY | O_NOFOLLOW
+                                     | CLOEXEC_FLAG);
+        if (fd >= 0) {
+                entry.type = EntryType::DIRECTORY;
+        } else if (errno == ENOENT) {
+                entry.type = EntryType::MISSING;
+        } else if ((errno == ENOTDIR) || (errno == ELOOP)) {
+                char    buf[PATH_MAX];
+                ssize_t n = ::readlinkat(dir_fd_, name, buf, sizeof(buf));
+
+                if ((n > 0) && (size_t(n) < sizeof(buf))) {
+                        entry.type = EntryType::SYMLINK;
+                        entry.target.assign(buf, size_t(n));
+                } else if (n >= 0) {
+                        ec.assign(ENAMETOOLONG, system_category());
+                        return false;
+                } else if (errno == EINVAL) {
+                        entry.type = EntryType::OTHER;
+                } else {
+                        ec.assign(errno, system_category());
+                        return false;
+                }
+        } else {
+                ec.assign(errno, system_category());
+                return false;
+        }
+
+        if (cache_) {
+                std::lock_guard<std::mutex> lock(cache_->mutex);
+                cache_->entries.emplace(child, entry);
+        }
+
+        return true;
+}
+
+//--------------------------------------
+
+bool
+CanonicalWalk::openDir(
+        fs_error_code &ec
+)
+{
+        if (dir_fd_ < 0) {
+                dir_fd_ = ::open(resolved_.c_str(),
+                                 SEARCH_FLAGS | O_DIRECTORY | CLOEXEC_FLAG);
+                if (dir_fd_ < 0) {
+                        ec.assign(errno, system_category());
+                        return false;
+                }
+        }
+        return true;
+}
+
+//--------------------------------------
+
+void
+CanonicalWalk::closeDir()
+{
+        if (dir_fd_ >= 0) {
+                ::close(dir_fd_);
+                dir_fd_ = -1;
+        }
+}
+
+//--------------------------------------
+/*
+ * resolved_ contains no symbolic links, so its lexical parent is also
+ * its parent in the filesystem
+ */
+void
+CanonicalWalk::toParent()
+{
+        closeDir();
+
+        auto i = resolved_.rfind('/');
+        resolved_.erase((i == 0) ? 1 : i);
+}
+
+#endif // WR_POSIX
+//--------------------------------------
+#if !WR_HAVE_FSIMPL_WEAKLY_CANONICAL
+
 WRUTIL_API path
 weakly_canonical(
         const path &p
 )
 {
         fs_error_code ec;
-        path result = weakly_canonical(p, ec);
+        path result = wr::weakly_canonical(p, ec);
+        if (ec) {
+                throw filesystem_error("error obtaining canonical path", p, ec);
+        }
+        return result;
+}
+
+#endif // !WR_HAVE_FSIMPL_WEAKLY_CANONICAL
+//--------------------------------------
+
+WRUTIL_API path
+weakly_canonical(
+        const path      &p,
+        canonical_cache &cache
+)
+{
+        fs_error_code ec;
+        path result = wr::weakly_canonical(p, cache, ec);
         if (ec) {
                 throw filesystem_error("error obtaining canonical path", p, ec);
         }
@@ -46,6 +455,35 @@ weakly_canonical(
 }
 
 //--------------------------------------
+#if WR_POSIX
+#if !WR_HAVE_FSIMPL_WEAKLY_CANONICAL
+
+WRUTIL_API path
+weakly_canonical(
+        const path    &p,
+        fs_error_code &ec
+)
+{
+        return CanonicalWalk(nullptr).run(p, ec);
+}
+
+#endif
+
+//--------------------------------------
+
+WRUTIL_API path
+weakly_canonical(
+        const path      &p,
+        canonical_cache &cache,
+        fs_error_code   &ec
+)
+{
+        return CanonicalWalk(&cache).run(p, ec);
+}
+
+//--------------------------------------
+#else // !WR_POSIX
+#if !WR_HAVE_FSIMPL_WEAKLY_CANONICAL
 
 WRUTIL_API path
 weakly_canonical(
@@ -73,7 +511,7 @@ weakly_canonical(
                              an empty path! Result should be "/". */
                 error = !error && static_cast<bool>(ec);
                 if (!error) {
-                        make_lexically_normal(result, p, i, j);
+                        make_lexically_normal(result, i, j);
                 }
         }
 
@@ -86,5 +524,21 @@ weakly_canonical(
         return result;
 }
 
+#endif // !WR_HAVE_FSIMPL_WEAKLY_CANONICAL
+//--------------------------------------
+
+WRUTIL_API path
+weakly_canonical(
+        const path      &p,
+        canonical_cache &cache,
+        fs_error_code   &ec
+)
+{
+        (void) cache;
+        return wr::weakly_canonical(p, ec);
+}
+
+#endif // !WR_POSIX
+
 
 } // namespace wr
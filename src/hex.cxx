@@ -0,0 +1,242 @@
+/**
+ * \file hex.cxx
+ *
+ * \brief Implementation of hexadecimal encoding and decoding functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdint.h>
+#include <wrutil/Config.h>
+#ifdef __SSE2__
+#       include <emmintrin.h>
+#endif
+#include <wrutil/hex.h>
+
+
+namespace wr {
+
+
+static const char LOWER_DIGITS[] = "0123456789abcdef",
+                  UPPER_DIGITS[] = "0123456789ABCDEF";
+
+/*
+ * Maps each char to its hex digit value, or to 0xff if it is not a hex
+ * digit; written out rather than computed so that it is initialized
+ * before any code runs, as hex_decode() may be called by other static
+ * initializers
+ */
+static constexpr uint8_t HEX_VALUES[256] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+//--------------------------------------
+#ifdef __SSE2__
+/*
+ * Converts sixteen nibble values (0-15) to hex digit chars
+ */
+static inline __m128i
+nibblesToHex(
+        __m128i nibbles,
+        __m128i alpha_adjust
+)
+{
+        __m128i alpha = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+
+        return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+                            _mm_and_si128(alpha, alpha_adjust));
+}
+
+//--------------------------------------
+/*
+ * Converts sixteen hex digit chars to their values, clearing `valid` if
+ * any of them is not a hex digit
+ */
+static inline __m128i
+hexToNibbles(
+        __m128i  chars,
+        bool    &valid
+)
+{
+        __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20)),
+                digit = _mm_and_si128(
+                                _mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1))),
+                alpha = _mm_and_si128(
+                                _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+        if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff) {
+                valid = false;
+        }
+
+        return _mm_or_si128(
+                _mm_and_si128(digit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                _mm_and_si128(alpha, _mm_sub_epi8(lower,
+                                                  _mm_set1_epi8('a' - 10))));
+}
+
+#endif // __SSE2__
+//--------------------------------------
+
+WRUTIL_API char *
+hex_encode(
+        const void *src,
+        size_t      size,
+        char       *dst,
+        bool        upper_case
+)
+{
+        auto        in = static_cast<const uint8_t *>(src),
+                    end = in + size;
+        const char *digits = upper_case ? UPPER_DIGITS : LOWER_DIGITS;
+
+#ifdef __SSE2__
+        __m128i alpha_adjust = _mm_set1_epi8(upper_case ? 'A' - '0' - 10
+                                                        : 'a' - '0' - 10),
+                low_mask = _mm_set1_epi8(0x0f);
+
+        for (; end - in >= 16; in += 16, dst += 32) {
+                __m128i bytes = _mm_loadu_si128(
+                                        reinterpret_cast<const __m128i *>(in)),
+                        hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask),
+                        lo = _mm_and_si128(bytes, low_mask);
+
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                                 nibblesToHex(_mm_unpacklo_epi8(hi, lo),
+                                              alpha_adjust));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16),
+                                 nibblesToHex(_mm_unpackhi_epi8(hi, lo),
+                                              alpha_adjust));
+        }
+#endif
+
+        for (; in != end; ++in) {
+                *(dst++) = digits[*in >> 4];
+                *(dst++) = digits[*in & 0x0f];
+        }
+
+        return dst;
+}
+
+//--------------------------------------
+
+WRUTIL_API std::string
+hex_encode(
+        const void *src,
+        size_t      size,
+        bool        upper_case
+)
+{
+        std::string result(hex_encoded_size(size), '\0');
+
+        if (size) {
+                hex_encode(src, size, &result[0], upper_case);
+        }
+        return result;
+}
+
+//--------------------------------------
+
+WRUTIL_API bool
+hex_decode(
+        const string_view &src,
+        void              *dst
+)
+{
+        if (src.size() & 1) {
+                return false;
+        }
+
+        auto in = reinterpret_cast<const uint8_t *>(src.data()),
+             end = in + src.size();
+        auto out = static_cast<uint8_t *>(dst);
+
+#ifdef __SSE2__
+        __m128i low_byte = _mm_set1_epi16(0x00ff);
+        bool    valid = true;
+
+        for (; end - in >= 32; in += 32, out += 16) {
+                // each 16-bit lane holds a high nibble then a low nibble
+                __m128i n0 = hexToNibbles(_mm_loadu_si128(
+                                reinterpret_cast<const __m128i *>(in)), valid),
+                        n1 = hexToNibbles(_mm_loadu_si128(
+                                reinterpret_cast<const __m128i *>(in + 16)),
+                                valid);
+
+                n0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n0, low_byte), 4),
+                                  _mm_srli_epi16(n0, 8));
+                n1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n1, low_byte), 4),
+                                  _mm_srli_epi16(n1, 8));
+
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                                 _mm_packus_epi16(n0, n1));
+        }
+
+        if (!valid) {
+                return false;
+        }
+#endif
+
+        for (; in != end; in += 2) {
+                uint8_t hi = HEX_VALUES[in[0]],
+                        lo = HEX_VALUES[in[1]];
+
+                if ((hi | lo) & 0xf0) {
+                        return false;
+                }
+                *(out++) = uint8_t((hi << 4) | lo);
+        }
+
+        return true;
+}
+
+
+} // namespace wr
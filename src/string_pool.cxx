@@ -0,0 +1,404 @@
+/**
+ * \file string_pool.cxx
+ *
+ * \brief Implementation of string interning pools
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <wrutil/string_pool.h>
+
+
+namespace wr {
+
+
+enum : size_t
+{
+        BLOCK_SIZE = 64 * 1024,
+
+        // strings larger than this get a block to themselves, so that
+        // little of the current block is wasted
+        MAX_PACKED_SIZE = BLOCK_SIZE / 8,
+
+        MAX_SHARD_BITS = 8
+};
+
+constexpr string_pool::id_type string_pool::npos;
+constexpr concurrent_string_pool::id_type concurrent_string_pool::npos;
+
+//--------------------------------------
+
+WRUTIL_API
+string_pool::string_pool() :
+        next_(nullptr),
+        left_(0),
+        arena_size_(0)
+{
+}
+
+//--------------------------------------
+
+WRUTIL_API
+string_pool::string_pool(
+        string_pool &&other
+) :
+        blocks_(std::move(other.blocks_)),
+        next_(other.next_),
+        left_(other.left_),
+        arena_size_(other.arena_size_),
+        strings_(std::move(other.strings_)),
+        index_(std::move(other.index_))
+{
+        other.clear();
+}
+
+//--------------------------------------
+
+WRUTIL_API string_pool &
+string_pool::operator=(
+        string_pool &&other
+)
+{
+        if (this != &other) {
+                blocks_ = std::move(other.blocks_);
+                next_ = other.next_;
+                left_ = other.left_;
+                arena_size_ = other.arena_size_;
+                strings_ = std::move(other.strings_);
+                index_ = std::move(other.index_);
+                other.clear();
+        }
+        return *this;
+}
+
+//--------------------------------------
+
+WRUTIL_API
+string_pool::~string_pool() = default;
+
+//--------------------------------------
+
+WRUTIL_API u8string_view
+string_pool::intern(
+        const u8string_view &s
+)
+{
+        auto result = intern(string_view(s.char_data(), s.bytes()));
+        return u8string_view(result.data(), result.size());
+}
+
+//--------------------------------------
+
+WRUTIL_API string_view
+string_pool::find(
+        const string_view &s
+) const
+{
+        auto entry = lookup(s, stdHash(s.data(), s.size()));
+        return entry ? entry->str : string_view();
+}
+
+//--------------------------------------
+
+WRUTIL_API string_pool::id_type
+string_pool::find_id(
+        const string_view &s
+) const
+{
+        auto entry = lookup(s, stdHash(s.data(), s.size()));
+        return entry ? entry->id : npos;
+}
+
+//--------------------------------------
+
+WRUTIL_API void
+string_pool::clear()
+{
+        index_.clear();
+        strings_.clear();
+        blocks_.clear();
+        next_ = nullptr;
+        left_ = 0;
+        arena_size_ = 0;
+}
+
+//--------------------------------------
+
+std::pair<string_view, string_pool::id_type>
+string_pool::insert(
+        const string_view &s,
+        size_t             hash
+)
+{
+        auto entry = lookup(s, hash);
+
+        if (entry) {
+                return { entry->str, entry->id };
+        }
+
+        if (strings_.size() >= npos) {
+                throw std::length_error("wr::string_pool: too many strings");
+        }
+
+        string_view copy(store(s), s.size());
+        id_type     id = id_type(strings_.size());
+
+        strings_.push_back(copy);
+        try {
+                index_.insert(Entry { copy, hash, id });
+        } catch (...) {
+                strings_.pop_back();
+                throw;
+        }
+        return { copy, id };
+}
+
+//--------------------------------------
+
+const string_pool::Entry *
+string_pool::lookup(
+        const string_view &s,
+        size_t             hash
+) const
+{
+        auto i = index_.find(Probe { s, hash });
+        return (i == index_.end()) ? nullptr : &*i;
+}
+
+//--------------------------------------
+
+const char *
+string_pool::store(
+        const string_view &s
+)
+{
+        size_t n = s.size() + 1;
+        char  *dst;
+
+        if (n > MAX_PACKED_SIZE) {
+                blocks_.emplace_back(new char[n]);
+                arena_size_ += n;
+                dst = blocks_.back().get();
+        } else {
+                if (n > left_) {
+                        blocks_.emplace_back(new char[BLOCK_SIZE]);
+                        arena_size_ += BLOCK_SIZE;
+                        next_ = blocks_.back().get();
+                        left_ = BLOCK_SIZE;
+                }
+                dst = next_;
+                next_ += n;
+                left_ -= n;
+        }
+
+        memcpy(dst, s.data(), s.size());
+        dst[s.size()] = '\0';
+        return dst;
+}
+
+//--------------------------------------
+
+struct concurrent_string_pool::Shard
+{
+        std::mutex  mutex;
+        string_pool pool;
+        char        padding[64];  // keep shards on separate cache lines
+};
+
+//--------------------------------------
+
+WRUTIL_API
+concurrent_string_pool::concurrent_string_pool(
+        unsigned shards
+) :
+        shard_bits_(0)
+{
+        if (!shards) {
+                shards = std::max(std::thread::hardware_concurrency(), 1u) * 4;
+        }
+        while ((shard_bits_ < MAX_SHARD_BITS)
+                        && ((1u << shard_bits_) < shards)) {
+                ++shard_bits_;
+        }
+        shards_.reset(new Shard[size_t(1) << shard_bits_]);
+}
+
+//--------------------------------------
+
+WRUTIL_API
+concurrent_string_pool::~concurrent_string_pool() = default;
+
+//--------------------------------------
+/*
+ * A shard is selected by the top bits of a hash, which the shard's own
+ * index does not rely on alone (see flat_hash_table.h)
+ */
+concurrent_string_pool::Shard &
+concurrent_string_pool::shard(
+        size_t hash
+) const
+{
+        return shards_[(hash >> (sizeof(size_t) * 8 - MAX_SHARD_BITS))
+                       & ((size_t(1) << shard_bits_) - 1)];
+}
+
+//--------------------------------------
+
+WRUTIL_API string_view
+concurrent_string_pool::intern(
+        const string_view &s
+)
+{
+        size_t hash = stdHash(s.data(), s.size());
+        auto  &sh = shard(hash);
+
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        return sh.pool.insert(s, hash).first;
+}
+
+//--------------------------------------
+
+WRUTIL_API u8string_view
+concurrent_string_pool::intern(
+        const u8string_view &s
+)
+{
+        auto result = intern(string_view(s.char_data(), s.bytes()));
+        return u8string_view(result.data(), result.size());
+}
+
+//--------------------------------------
+/*
+ * The shard index occupies the low bits of an ID, leaving 32 - shard_bits_
+ * bits for the string's ID within its shard
+ */
+WRUTIL_API concurrent_string_pool::id_type
+concurrent_string_pool::id(
+        const string_view &s
+)
+{
+        size_t hash = stdHash(s.data(), s.size());
+        auto  &sh = shard(hash);
+        id_type shard_index = id_type(&sh - shards_.get());
+
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        auto    entry = sh.pool.lookup(s, hash);
+        id_type local_id = entry ? entry->id : id_type(sh.pool.size());
+
+        // checked before inserting so that a failed call interns nothing
+        if (uint64_t(local_id) + 1 >= (uint64_t(1) << (32 - shard_bits_))) {
+                throw std::length_error(
+                        "wr::concurrent_string_pool: too many strings");
+        }
+        if (!entry) {
+                local_id = sh.pool.insert(s, hash).second;
+        }
+        return (local_id << shard_bits_) | shard_index;
+}
+
+//--------------------------------------
+
+WRUTIL_API string_view
+concurrent_string_pool::find(
+        const string_view &s
+) const
+{
+        size_t hash = stdHash(s.data(), s.size());
+        auto  &sh = shard(hash);
+
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        auto entry = sh.pool.lookup(s, hash);
+        return entry ? entry->str : string_view();
+}
+
+//--------------------------------------
+
+WRUTIL_API concurrent_string_pool::id_type
+concurrent_string_pool::find_id(
+        const string_view &s
+) const
+{
+        size_t hash = stdHash(s.data(), s.size());
+        auto  &sh = shard(hash);
+        id_type shard_index = id_type(&sh - shards_.get());
+
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        auto entry = sh.pool.lookup(s, hash);
+        return entry ? (entry->id << shard_bits_) | shard_index : npos;
+}
+
+//--------------------------------------
+
+WRUTIL_API string_view
+concurrent_string_pool::str(
+        id_type id
+) const
+{
+        auto &sh = shards_[id & ((id_type(1) << shard_bits_) - 1)];
+
+        std::lock_guard<std::mutex> lock(sh.mutex);
+        return sh.pool.str(id >> shard_bits_);
+}
+
+//--------------------------------------
+
+WRUTIL_API size_t
+concurrent_string_pool::size() const
+{
+        size_t total = 0;
+
+        for (size_t i = 0, n = size_t(1) << shard_bits_; i < n; ++i) {
+                std::lock_guard<std::mutex> lock(shards_[i].mutex);
+                total += shards_[i].pool.size();
+        }
+        return total;
+}
+
+//--------------------------------------
+
+WRUTIL_API size_t
+concurrent_string_pool::arena_size() const
+{
+        size_t total = 0;
+
+        for (size_t i = 0, n = size_t(1) << shard_bits_; i < n; ++i) {
+                std::lock_guard<std::mutex> lock(shards_[i].mutex);
+                total += shards_[i].pool.arena_size();
+        }
+        return total;
+}
+
+//--------------------------------------
+
+WRUTIL_API void
+concurrent_string_pool::clear()
+{
+        for (size_t i = 0, n = size_t(1) << shard_bits_; i < n; ++i) {
+                std::lock_guard<std::mutex> lock(shards_[i].mutex);
+                shards_[i].pool.clear();
+        }
+}
+
+
+} // namespace wr
@@ -35,6 +35,7 @@
 #include <wrutil/ctype.h>
 #include <wrutil/u8string_view.h>
 #include <wrutil/utf16.h>
+#include "codecvt/utf8_utf16.h"
 
 
 namespace wr {
@@ -235,17 +236,38 @@ u8string_view::trim() -> this_t &
 
 //--------------------------------------
 
-template <typename Traits, typename Alloc>
-std::basic_string<char16_t, Traits, Alloc>
-u8string_view::to_u16string(
-        const Alloc &a
+/*
+ * Converts in bulk; anything the converter rejects is decoded leniently
+ * by utf8_char(), with surrogates and out-of-range values becoming U+FFFD.
+ * The output must have room for bytes() code units.
+ */
+WRUTIL_API char16_t *
+u8string_view::copy_utf16(
+        char16_t *out
 ) const
 {
-        std::basic_string<char16_t, Traits, Alloc> result;
-        for (char32_t c: *this) {
-                append(result, c);
+        const uint8_t *p = begin_;
+        uint16_t      *to = reinterpret_cast<uint16_t *>(out),
+                      *to_end = to + bytes();
+
+        while (utf8_to_utf16(p, end_, p, to, to_end, to)
+                                        != std::codecvt_base::ok) {
+                const uint8_t *next;
+                char32_t       c = utf8_char(p, end_, &next);
+
+                if ((c > 0x10ffff) || ((c & 0xfffff800) == 0xd800)) {
+                        c = INVALID_CHAR;
+                }
+                if (c > 0xffff) {
+                        c -= 0x10000;
+                        *to++ = static_cast<uint16_t>(0xd800 | (c >> 10));
+                        *to++ = static_cast<uint16_t>(0xdc00 | (c & 0x3ff));
+                } else {
+                        *to++ = static_cast<uint16_t>(c);
+                }
+                p = next;
         }
-        return result;
+        return reinterpret_cast<char16_t *>(to);
 }
 
 //--------------------------------------
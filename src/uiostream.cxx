@@ -25,8 +25,12 @@
  */
 #include <wrutil/Config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <atomic>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <new>
 #include <wrutil/uiostream.h>
 
@@ -66,6 +70,12 @@ std::streambuf *getUStreamBuf(std::streambuf *underlying_streambuf,
                               std::streambuf *&overlying_streambuf);
         // platform-dependent, refer to ustreambuf_<platform>.cxx
 
+bool setUStreamBufLineBuffered(std::streambuf *buf, bool line_buffered);
+        // platform-dependent, returns false if buf is not buffered by wrutil
+
+std::recursive_mutex *getUStreamBufMutex(std::streambuf *buf);
+        // platform-dependent, returns nullptr if buf is not locked by wrutil
+
 //--------------------------------------
 
 WRUTIL_API
@@ -122,5 +132,256 @@ uiostream_init::~uiostream_init()
         }
 }
 
+//--------------------------------------
+/*
+ * Buffer behind the per-thread proxies, passing complete lines to the
+ * target stream's buffer under that buffer's own lock where it has one,
+ * or else under a lock shared by all proxies.  The put area
+ * ends at the last character written so that single characters, which
+ * may be newlines, go through overflow().
+ */
+class ulocalbuf :
+        public std::streambuf
+{
+        enum
+        {
+                INITIAL_SIZE = 256,
+                MAX_PENDING  = 65536  // longest line held back
+        };
+
+public:
+        using this_t = ulocalbuf;
+
+        explicit
+        ulocalbuf(
+                std::ostream &target
+        ) :
+                target_(target),
+                size_  (INITIAL_SIZE),
+                buf_   (new char[INITIAL_SIZE])
+        {
+                setPut(0);
+        }
+
+        ulocalbuf(const this_t &other) = delete;
+
+        ~ulocalbuf() override
+        {
+                sync();
+        }
+
+        this_t &operator=(const this_t &other) = delete;
+
+protected:
+        int_type
+        overflow(
+                int_type c
+        ) override
+        {
+                if (traits_type::eq_int_type(c, traits_type::eof())) {
+                        return traits_type::not_eof(c);
+                }
+
+                size_t used = pending();
+
+                reserve(1);
+                buf_[used++] = traits_type::to_char_type(c);
+                setPut(used);
+
+                if ((c == '\n') || (used >= MAX_PENDING)) {
+                        commit(used, false);
+                }
+                return c;
+        }
+
+        std::streamsize
+        xsputn(
+                const char_type *s,
+                std::streamsize  n
+        ) override
+        {
+                auto   len = static_cast<size_t>(n);
+                size_t used = pending();
+
+                reserve(len);
+                memcpy(buf_.get() + used, s, len);
+                setPut(used + len);
+
+                // pass on everything up to the last newline
+                auto i = std::find(std::reverse_iterator<const char *>(s + n),
+                                   std::reverse_iterator<const char *>(s),
+                                   '\n');
+                if (i.base() != s) {
+                        commit(used + size_t(i.base() - s), false);
+                } else if (used + len >= MAX_PENDING) {
+                        commit(used + len, false);
+                }
+                return n;
+        }
+
+        int
+        sync() override
+        {
+                return commit(pending(), true) ? 0 : -1;
+        }
+
+private:
+        size_t pending() const { return size_t(pptr() - pbase()); }
+
+        void
+        setPut(
+                size_t used
+        )
+        {
+                setp(buf_.get(), buf_.get() + used);
+                pbump(static_cast<int>(used));
+        }
+
+        void reserve(size_t n);
+        bool commit(size_t n, bool flush);
+
+        static std::recursive_mutex &
+        lock()
+        {
+                static std::recursive_mutex mutex;
+                return mutex;
+        }
+
+        std::ostream            &target_;
+        size_t                   size_;
+        std::unique_ptr<char []> buf_;
+};
+
+//--------------------------------------
+
+void
+ulocalbuf::reserve(
+        size_t n
+)
+{
+        size_t used = pending();
+
+        if (size_ - used >= n) {
+                return;
+        }
+
+        size_t new_size = std::max(size_ * 2, used + n);
+        std::unique_ptr<char []> new_buf(new char[new_size]);
+
+        memcpy(new_buf.get(), buf_.get(), used);
+        buf_ = std::move(new_buf);
+        size_ = new_size;
+        setPut(used);
+}
+
+//--------------------------------------
+/*
+ * Passes the first `n` pending characters to the target, flushing the
+ * target if requested or if it is unit-buffered
+ */
+bool
+ulocalbuf::commit(
+        size_t n,
+        bool   flush
+)
+{
+        size_t used = pending();
+        bool   ok = true;
+
+        if (n || flush) {
+                std::streambuf       *target_buf = target_.rdbuf();
+                std::recursive_mutex *mutex = getUStreamBufMutex(target_buf);
+                std::lock_guard<std::recursive_mutex> guard(mutex ? *mutex
+                                                                  : lock());
+
+                if (target_.tie()) {
+                        target_.tie()->flush();
+                }
+                if (target_buf) {
+                        ok = (target_buf->sputn(buf_.get(), std::streamsize(n))
+                                                        == std::streamsize(n));
+                        if (flush || (target_.flags()
+                                        & std::ios_base::unitbuf)) {
+                                ok = (target_buf->pubsync() == 0) && ok;
+                        }
+                }
+        }
+
+        memmove(buf_.get(), buf_.get() + n, used - n);
+        setPut(used - n);
+        return ok;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+struct ulocalstream
+{
+        explicit
+        ulocalstream(
+                std::ostream &target
+        ) :
+                buf   (target),
+                stream(&buf)
+        {
+                stream.imbue(target.getloc());
+        }
+
+        ulocalbuf    buf;
+        std::ostream stream;  // destroyed before buf, which then flushes
+};
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+WRUTIL_API std::ostream &
+uout_local()
+{
+        static thread_local ulocalstream local(uout);
+        return local.stream;
+}
+
+//--------------------------------------
+
+WRUTIL_API std::ostream &
+uerr_local()
+{
+        static thread_local ulocalstream local(uerr);
+        return local.stream;
+}
+
+//--------------------------------------
+
+WRUTIL_API std::ostream &
+ulog_local()
+{
+        static thread_local ulocalstream local(ulog);
+        return local.stream;
+}
+
+//--------------------------------------
+
+WRUTIL_API void
+set_ubuffering(
+        std::ostream &stream,
+        ubuffering    mode
+)
+{
+        if (mode == ubuffering::unbuffered) {
+                stream.setf(std::ios_base::unitbuf);
+                stream.flush();
+        } else {
+                stream.unsetf(std::ios_base::unitbuf);
+                if (stream.rdbuf()) {
+                        setUStreamBufLineBuffered(stream.rdbuf(),
+                                                  mode == ubuffering::line);
+                }
+        }
+}
+
 
 } // namespace wr
@@ -23,8 +23,13 @@
  *
  * \endparblock
  */
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <memory>
+#include <mutex>
 #include <streambuf>
 #include <wrutil/codecvt.h>  // for u8buffer_convert and codecvt_utf8_narrow
 #include <wrutil/uiostream.h>
@@ -33,6 +38,187 @@
 namespace wr {
 
 
+/*
+ * Output buffer writing directly to a file descriptor, bypassing stdio.
+ * Sequences too large for the remaining buffer space are written in the
+ * same writev() call as the buffer contents rather than copied.
+ *
+ * The put area is kept empty so that every write goes through overflow()
+ * or xsputn(), which hold the buffer's lock; uout, uerr and ulog may be
+ * written by several threads at once, as the std streams may. The lock is
+ * recursive since the proxies and u8outbuf hold it while writing through.
+ */
+class fdoutbuf :
+        public std::streambuf
+{
+        enum
+        {
+                BUF_SIZE = 65536
+        };
+
+public:
+        using this_t = fdoutbuf;
+
+        fdoutbuf(
+                FILE *c_stream,
+                bool  line_buffered
+        ) :
+                c_stream_     (c_stream),
+                fd_           (fileno(c_stream)),
+                line_buffered_(line_buffered),
+                used_         (0),
+                buf_          (new char[BUF_SIZE])
+        {
+        }
+
+        fdoutbuf(const this_t &other) = delete;
+
+        ~fdoutbuf() override
+        {
+                sync();
+        }
+
+        this_t &operator=(const this_t &other) = delete;
+
+        std::recursive_mutex &mutex() { return mutex_; }
+
+        bool lineBuffered() const { return line_buffered_; }
+
+        void
+        setLineBuffered(
+                bool line_buffered
+        )
+        {
+                std::lock_guard<std::recursive_mutex> guard(mutex_);
+                line_buffered_ = line_buffered;
+        }
+
+protected:
+        int_type
+        overflow(
+                int_type c
+        ) override
+        {
+                std::lock_guard<std::recursive_mutex> guard(mutex_);
+
+                if (traits_type::eq_int_type(c, traits_type::eof())) {
+                        return flush(nullptr, 0) ? traits_type::not_eof(c)
+                                                 : c;
+                }
+
+                if ((used_ == size_t(BUF_SIZE)) && !flush(nullptr, 0)) {
+                        return traits_type::eof();
+                }
+
+                buf_[used_++] = traits_type::to_char_type(c);
+
+                if (line_buffered_ && (c == '\n') && !flush(nullptr, 0)) {
+                        return traits_type::eof();
+                }
+                return c;
+        }
+
+        std::streamsize
+        xsputn(
+                const char_type *s,
+                std::streamsize  n
+        ) override
+        {
+                std::lock_guard<std::recursive_mutex> guard(mutex_);
+                auto len = static_cast<size_t>(n);
+
+                if (len > size_t(BUF_SIZE) - used_) {
+                        return flush(s, len) ? n : 0;
+                }
+
+                memcpy(buf_.get() + used_, s, len);
+                used_ += len;
+
+                if (line_buffered_ && memchr(s, '\n', len)
+                                   && !flush(nullptr, 0)) {
+                        return 0;
+                }
+                return n;
+        }
+
+        int
+        sync() override
+        {
+                std::lock_guard<std::recursive_mutex> guard(mutex_);
+                return flush(nullptr, 0) ? 0 : -1;
+        }
+
+private:
+        bool flush(const char *extra, size_t extra_len);
+
+        std::recursive_mutex     mutex_;
+        FILE                    *c_stream_;
+        int                      fd_;
+        bool                     line_buffered_;
+        size_t                   used_;
+        std::unique_ptr<char []> buf_;
+};
+
+//--------------------------------------
+/*
+ * Writes the buffer contents followed by `extra`, first flushing the C
+ * stream so that output already written through stdio keeps its place;
+ * the caller holds the lock
+ */
+bool
+fdoutbuf::flush(
+        const char *extra,
+        size_t      extra_len
+)
+{
+        struct iovec iov[2] = {
+                { buf_.get(), used_ },
+                { const_cast<char *>(extra), extra_len }
+        };
+        struct iovec *next = iov, *end = iov + 2;
+        bool          ok = true;
+
+        if (!iov[0].iov_len) {
+                ++next;
+        }
+        if (!extra_len) {
+                --end;
+        }
+        if (next < end) {
+                fflush(c_stream_);
+        }
+
+        while (next < end) {
+                ssize_t written = writev(fd_, next, int(end - next));
+
+                if (written < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        ok = false;  // output is lost, as with stdio
+                        break;
+                }
+
+                auto n = size_t(written);
+                while ((next < end) && (n >= next->iov_len)) {
+                        n -= next->iov_len;
+                        ++next;
+                }
+                if (next < end) {
+                        next->iov_base = static_cast<char *>(next->iov_base)
+                                                                        + n;
+                        next->iov_len -= n;
+                }
+        }
+
+        used_ = 0;
+        return ok;
+}
+
+//--------------------------------------
+/*
+ * Transcodes input from a terminal whose character set is not UTF-8
+ */
 class u8streambuf :
         public u8buffer_convert
 {
@@ -40,56 +226,188 @@ public:
         using this_t = u8streambuf;
         using base_t = u8buffer_convert;
 
-        explicit
         u8streambuf(
                 std::streambuf *bytebuf,
                 std::locale     loc
         ) :
                 u8buffer_convert(bytebuf, new codecvt_utf8_narrow(loc), {})
         {
-                overflow(EOF);    // ready base class
         }
 };
 
+//--------------------------------------
+/*
+ * Transcodes output to a terminal whose character set is not UTF-8. Like
+ * fdoutbuf it keeps no put area of its own, holding the byte buffer's lock
+ * while the converting buffer is written, and flushes converted output at
+ * the end of each line where the byte buffer is line-buffered.
+ */
+class u8outbuf :
+        public std::streambuf
+{
+public:
+        using this_t = u8outbuf;
+
+        u8outbuf(
+                fdoutbuf    *bytebuf,
+                std::locale  loc
+        ) :
+                bytebuf_(bytebuf),
+                convbuf_(bytebuf, new codecvt_utf8_narrow(loc), {})
+        {
+        }
+
+        fdoutbuf *bytebuf() const { return bytebuf_.get(); }
+
+protected:
+        int_type
+        overflow(
+                int_type c
+        ) override
+        {
+                std::lock_guard<std::recursive_mutex> guard(
+                                                        bytebuf_->mutex());
+
+                if (traits_type::eq_int_type(c, traits_type::eof())) {
+                        return (convbuf_.pubsync() == 0)
+                                ? traits_type::not_eof(c) : c;
+                }
+                auto ch = traits_type::to_char_type(c);
+
+                if (traits_type::eq_int_type(convbuf_.sputc(ch),
+                                             traits_type::eof())) {
+                        return traits_type::eof();
+                }
+                if (bytebuf_->lineBuffered() && (ch == '\n')
+                                             && (convbuf_.pubsync() != 0)) {
+                        return traits_type::eof();
+                }
+                return c;
+        }
+
+        std::streamsize
+        xsputn(
+                const char_type *s,
+                std::streamsize  n
+        ) override
+        {
+                std::lock_guard<std::recursive_mutex> guard(
+                                                        bytebuf_->mutex());
+                std::streamsize written = convbuf_.sputn(s, n);
+
+                if (bytebuf_->lineBuffered()
+                                && memchr(s, '\n', size_t(written))
+                                && (convbuf_.pubsync() != 0)) {
+                        return 0;
+                }
+                return written;
+        }
+
+        int
+        sync() override
+        {
+                std::lock_guard<std::recursive_mutex> guard(
+                                                        bytebuf_->mutex());
+                return convbuf_.pubsync();
+        }
+
+private:
+        // convbuf_ is destroyed first, flushing into bytebuf_
+        std::unique_ptr<fdoutbuf> bytebuf_;
+        u8buffer_convert          convbuf_;
+};
+
 //--------------------------------------
 
 std::streambuf *
 getUStreamBuf(
         std::streambuf           *underlying_streambuf,
         FILE                     *c_stream,
-        std::ios_base::openmode   /* mode */,
+        std::ios_base::openmode   mode,
         std::streambuf          *&overlying_streambuf
 )
 {
-        int fd = fileno(c_stream);
+        int  fd = fileno(c_stream);
+        bool out = (mode & std::ios_base::out) != 0;
 
         if ((fd < 0) || !isatty(fd)) {
-                /* underlying medium probably redirected file
-                   so simply exchange raw UTF-8 */
-                return underlying_streambuf;
+                if (fd < 0 || !out) {
+                        return underlying_streambuf;
+                }
+                /* underlying medium probably redirected file so simply
+                   exchange raw UTF-8, in large blocks */
+                return overlying_streambuf = new fdoutbuf(c_stream, false);
         }
 
         // underlying medium is a terminal, arrange transcoding where necessary
-        std::locale loc("");
+        auto        native = get_native_charset();
+        std::locale loc    = native->locale;
+        bool        utf8   = native->utf8;
 
         if (underlying_streambuf) {
-                loc = underlying_streambuf->getloc();
+                std::locale buf_loc = underlying_streambuf->getloc();
 
-                std::string name = loc.name();
+                if (buf_loc.name() != "C") {
+                        loc = buf_loc;
+                        utf8 = is_utf8(loc);
+                }
+        }
 
-                if (name == "C") {
-                        loc = std::locale("");
+        if (!out) {
+                if (utf8) {  // no transcoding necessary
+                        return underlying_streambuf;
                 }
+                return overlying_streambuf = new u8streambuf(
+                        underlying_streambuf, loc);
+        } else if (utf8) {
+                return overlying_streambuf = new fdoutbuf(c_stream, true);
         } else {
-                loc = std::locale("");
+                return overlying_streambuf = new u8outbuf(
+                        new fdoutbuf(c_stream, true), loc);
         }
+}
 
-        if (is_utf8(loc)) {  // terminal uses UTF-8 so no transcoding necessary
-                return underlying_streambuf;
-        } else {
-                return overlying_streambuf
-                        = new u8streambuf(underlying_streambuf, loc);
+//--------------------------------------
+
+static fdoutbuf *
+getFdOutBuf(
+        std::streambuf *buf
+)
+{
+        if (auto u8buf = dynamic_cast<u8outbuf *>(buf)) {
+                return u8buf->bytebuf();
         }
+        return dynamic_cast<fdoutbuf *>(buf);
+}
+
+//--------------------------------------
+
+bool
+setUStreamBufLineBuffered(
+        std::streambuf *buf,
+        bool            line_buffered
+)
+{
+        fdoutbuf *fdbuf = getFdOutBuf(buf);
+
+        if (!fdbuf) {
+                return false;
+        }
+
+        buf->pubsync();
+        fdbuf->setLineBuffered(line_buffered);
+        return true;
+}
+
+//--------------------------------------
+
+std::recursive_mutex *
+getUStreamBufMutex(
+        std::streambuf *buf
+)
+{
+        fdoutbuf *fdbuf = getFdOutBuf(buf);
+        return fdbuf ? &fdbuf->mutex() : nullptr;
 }
 
 
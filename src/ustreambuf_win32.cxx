@@ -30,6 +30,7 @@
 #include <windows.h>
 #include <io.h>
 #include <stdio.h>
+#include <mutex>
 #include <stdexcept>
 #include <streambuf>
 #include <wrutil/numeric_cast.h>
@@ -297,5 +298,27 @@ getUStreamBuf(
         return underlying_streambuf;  // file redirection, exchange raw UTF-8
 }
 
+//--------------------------------------
+
+bool
+setUStreamBufLineBuffered(
+        std::streambuf * /* buf */,
+        bool             /* line_buffered */
+)
+{
+        return false;  // console output is written as it is converted
+}
+
+
+//--------------------------------------
+
+std::recursive_mutex *
+getUStreamBufMutex(
+        std::streambuf * /* buf */
+)
+{
+        return nullptr;  // console output is not buffered across calls
+}
+
 
 } // namespace wr
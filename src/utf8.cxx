@@ -305,13 +305,14 @@ u8strerror(
 )
 {
 #if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600) && !_GNU_SOURCE
-        std::string text(256, '\0');
+        static thread_local std::string buf(256, '\0');
+        std::string text;
         while (true) {
-                if (strerror_r(errnum, &text[0], text.size()) == 0) {
-                        text = utf8_narrow_cvt().to_utf8(text.data());
+                if (strerror_r(errnum, &buf[0], buf.size()) == 0) {
+                        utf8_narrow_cvt().to_utf8(buf.data(), text);
                         break;
                 } else if (errno == ERANGE) {
-                        text.resize(text.size() * 2);
+                        buf.resize(buf.size() * 2);
                 } else {  // EINVAL
                         text = "Unknown system error code "
                                 + std::to_string(errnum);
@@ -320,22 +321,20 @@ u8strerror(
         }
         return text;
 #elif _GNU_SOURCE
-        std::string text(512, '\0');
-        char *msg = strerror_r(errnum, &text[0], text.size());
-        if (msg == &text[0]) {
-                text = utf8_narrow_cvt().to_utf8(text.data());
-        } else {
-                text = utf8_narrow_cvt().to_utf8(msg);
-        }
+        char        buf[512];
+        std::string text;
+        utf8_narrow_cvt().to_utf8(strerror_r(errnum, buf, sizeof(buf)), text);
         return text;
 #elif WR_WINDOWS && defined(_UCRT)
-        std::string text(512, '\0');
-        if (strerror_s(&text[0], text.size(), errnum) == 0) {
-                size_t pos = text.find('\n');
-                if (pos != text.npos) {
-                        text.resize(pos);
+        char        buf[512];
+        std::string text;
+        if (strerror_s(buf, sizeof(buf), errnum) == 0) {
+                string_view msg(buf);
+                size_t pos = msg.find('\n');
+                if (pos != msg.npos) {
+                        msg = msg.substr(0, pos);
                 }
-                text = utf8_narrow_cvt().to_utf8(text);
+                utf8_narrow_cvt().to_utf8(msg, text);
         } else {
                 text = "Unknown system error code " + std::to_string(errnum);
         }
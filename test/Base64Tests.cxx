@@ -0,0 +1,118 @@
+/**
+ * \file Base64Tests.cxx
+ *
+ * \brief Unit tests for base64 encoding functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <string>
+#include <wrutil/base64.h>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/TestManager.h>
+
+
+using wr::TestFailure;
+
+
+static std::string
+decode(
+        const std::string &encoded,
+        bool              &ok
+)
+{
+        std::string result(wr::base64_decoded_size(encoded.size()), '\0');
+        size_t      size = 0;
+
+        ok = wr::base64_decode(encoded, &result[0], size);
+        result.resize(size);
+        return result;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("Base64", argc, argv);
+
+        static const char *const VECTORS[][2] = {  // from RFC 4648
+                { "",       ""         },
+                { "f",      "Zg=="     },
+                { "fo",     "Zm8="     },
+                { "foo",    "Zm9v"     },
+                { "foob",   "Zm9vYg==" },
+                { "fooba",  "Zm9vYmE=" },
+                { "foobar", "Zm9vYmFy" }
+        };
+
+        tester.run("encode", 1, [] {
+                for (auto &v: VECTORS) {
+                        auto result = wr::base64_encode(v[0]);
+                        if (result != v[1]) {
+                                throw TestFailure("encoding of \"%s\" returned \"%s\", expected \"%s\"",
+                                                  v[0], result, v[1]);
+                        }
+                }
+        });
+
+        tester.run("decode", 1, [] {
+                for (auto &v: VECTORS) {
+                        std::string padded(v[1]),
+                                    unpadded(padded, 0, padded.find('='));
+
+                        for (auto &encoded: { padded, unpadded }) {
+                                bool ok;
+                                auto result = decode(encoded, ok);
+                                if (!ok || (result != v[0])) {
+                                        throw TestFailure("decoding of \"%s\" did not return \"%s\"",
+                                                          encoded, v[0]);
+                                }
+                        }
+                }
+        });
+
+        tester.run("decode", 2, [] {
+                std::string bytes;
+                for (int i = 0; i < 256; ++i) {
+                        bytes += static_cast<char>(i);
+                }
+
+                bool ok;
+                if ((decode(wr::base64_encode(bytes), ok) != bytes) || !ok) {
+                        throw TestFailure("decoding does not reverse encoding of all byte values");
+                }
+        });
+
+        tester.run("decode", 3, [] {
+                for (auto bad: { "Zm9vY", "Zm9v!mFy", "Zm=vYmFy", "Zg===", "=" }) {
+                        bool ok;
+                        decode(bad, ok);
+                        if (ok) {
+                                throw TestFailure("decoding of \"%s\" succeeded", bad);
+                        }
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
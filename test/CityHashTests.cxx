@@ -0,0 +1,260 @@
+/**
+ * \file CityHashTests.cxx
+ *
+ * \brief Unit tests for CityHash functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <wrutil/CityHash.h>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/TestManager.h>
+#include "../src/CityHash_private.h"  // long-input variants, via wrutil_static
+
+
+using wr::TestFailure;
+
+
+static std::string
+testInput()
+{
+        std::string input;
+        for (int i = 0; i < 4096; ++i) {
+                input += static_cast<char>(i * 7 + 1);
+        }
+        return input;
+}
+
+//--------------------------------------
+
+// expected values from the original SSE4.2-only code, and for lengths
+// that are not multiples of 8 from the SSE4.2 variant, so that the
+// portable variant is checked against the CRC32 instruction
+static const struct
+{
+        size_t      len;
+        wr::uint64  hash[4];
+} CRC256_VECTORS[] = {
+        { 0,    { 0x95162f24e6a5f930ULL, 0x6808bdf4f1eb06e0ULL,
+                  0xb3b1f3a67b624d82ULL, 0xc9a62f12bd4cd80bULL } },
+        { 100,  { 0x599034ef6589dcd9ULL, 0x2fbc4c0cac02448fULL,
+                  0xc66113d5b935c8feULL, 0x1fc836d87f77b18bULL } },
+        { 239,  { 0xe95799dcaf21be62ULL, 0x2557b1ddb159748eULL,
+                  0xe47f06a59eff7ab6ULL, 0xa24429b081e6cd3bULL } },
+        { 240,  { 0x36e3fb5e0a32ecbdULL, 0x6393566439844b89ULL,
+                  0x058112f44b4b9c59ULL, 0x0cd1e2a36c9011e8ULL } },
+        { 243,  { 0x2520dce5bdb7c1faULL, 0xba472794f85ddc80ULL,
+                  0x4aec79bbbd5fb9a0ULL, 0x3d1f281f786b5bffULL } },
+        { 1000, { 0x49fd72dc77c0abebULL, 0x315f1e11413726c4ULL,
+                  0x9ea4440572375a11ULL, 0xe47ba89dd868df1aULL } },
+        { 1001, { 0x7031c625d0ac37eaULL, 0x421ec24ab3b756f3ULL,
+                  0x3c96326fa74c0aa8ULL, 0xd156894b8dc9df1dULL } },
+        { 2047, { 0x3a421bed894fe9a7ULL, 0x92511ee64068c349ULL,
+                  0x8bd7e85fcf3ff9b1ULL, 0x43a38c1c2a14ce7bULL } },
+        { 4095, { 0x81e1ae2369474046ULL, 0xef4e44959deafd68ULL,
+                  0xa3517fc2dcbc0009ULL, 0x78691e13c2a299beULL } },
+        { 4096, { 0xb9af3e793b3c6809ULL, 0x2b68bd8304f2f7f7ULL,
+                  0xfd37d1ad223ee63aULL, 0xaa7458327dc882f4ULL } }
+};
+
+//--------------------------------------
+/*
+ * Checks a CityHashCrc256() long-input function against CRC256_VECTORS,
+ * padding short inputs as CityHashCrc256() does, and against the
+ * CityHashCrc128() value derived from it
+ */
+static void
+checkCrc256LongFn(
+        const char               *name,
+        wr::CityHashCrc256LongFn  fn
+)
+{
+        auto input = testInput();
+
+        for (auto &v: CRC256_VECTORS) {
+                wr::uint64 result[4];
+                if (v.len >= 240) {
+                        fn(input.data(), v.len, 0, result);
+                } else {
+                        char buf[240] = {};
+                        std::copy_n(input.data(), v.len, buf);
+                        fn(buf, 240, ~static_cast<wr::uint32>(v.len), result);
+                }
+                for (int i = 0; i < 4; ++i) {
+                        if (result[i] != v.hash[i]) {
+                                throw TestFailure("%s of %u bytes: word %d is %x, expected %x",
+                                                  name, v.len, i, result[i], v.hash[i]);
+                        }
+                }
+                if ((v.len > 900) && (wr::uint128(result[2], result[3])
+                                != wr::CityHashCrc128(input.data(), v.len))) {
+                        throw TestFailure("%s of %u bytes differs from CityHashCrc128()",
+                                          name, v.len);
+                }
+        }
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("CityHash", argc, argv);
+
+        tester.run("Crc256", 1, [] {
+                auto input = testInput();
+
+                for (auto &v: CRC256_VECTORS) {
+                        wr::uint64 result[4];
+                        wr::CityHashCrc256(input.data(), v.len, result);
+                        for (int i = 0; i < 4; ++i) {
+                                if (result[i] != v.hash[i]) {
+                                        throw TestFailure("CityHashCrc256() of %u bytes: word %d is %x, expected %x",
+                                                          v.len, i, result[i], v.hash[i]);
+                                }
+                        }
+                }
+        });
+
+        tester.run("Crc256", 2, [] {
+                // each variant compiled in that this CPU supports
+                checkCrc256LongFn("CityHashCrc256LongSoft()",
+                                  &wr::CityHashCrc256LongSoft);
+#if WR_HAVE_X86_CRC32_INTRINSICS
+                if (__builtin_cpu_supports("sse4.2")) {
+                        checkCrc256LongFn("CityHashCrc256LongSse42()",
+                                          &wr::CityHashCrc256LongSse42);
+                }
+#endif
+        });
+
+        tester.run("Crc128", 1, [] {
+                auto input = testInput();
+
+                // same as CityHash128() up to 900 bytes
+                for (size_t len: { 0, 1, 16, 240, 900 }) {
+                        if (wr::CityHashCrc128(input.data(), len)
+                                        != wr::CityHash128(input.data(), len)) {
+                                throw TestFailure("CityHashCrc128() of %u bytes differs from CityHash128()",
+                                                  len);
+                        }
+                }
+
+                auto result = wr::CityHashCrc128(input.data(), input.size());
+                if (result != wr::uint128(0xfd37d1ad223ee63aULL,
+                                          0xaa7458327dc882f4ULL)) {
+                        throw TestFailure("CityHashCrc128() of %u bytes returned wrong hash",
+                                          input.size());
+                }
+        });
+
+        tester.run("Stream", 1, [] {
+                // identical to CityHash64() for short messages
+                auto input = testInput();
+
+                for (size_t len = 0; len <= 64; ++len) {
+                        wr::CityHash64Stream hasher;
+                        hasher.update(input.data(), len / 3);
+                        hasher.update(input.data() + len / 3, len - len / 3);
+
+                        if (hasher.finish() != wr::CityHash64(input.data(), len)) {
+                                throw TestFailure("CityHash64Stream of %u bytes differs from CityHash64()",
+                                                  len);
+                        }
+
+                        wr::CityHash64Stream seeded(12345);
+                        seeded.update(input.data(), len);
+
+                        if (seeded.finish() != wr::CityHash64WithSeed(input.data(), len, 12345)) {
+                                throw TestFailure("seeded CityHash64Stream of %u bytes differs from CityHash64WithSeed()",
+                                                  len);
+                        }
+                }
+        });
+
+        tester.run("Stream", 2, [] {
+                // result does not depend on how the message is split
+                auto input = testInput();
+
+                for (size_t len: { 65, 127, 128, 129, 1000, 4000 }) {
+                        wr::CityHash64Stream whole;
+                        auto expect = whole.update(input.data(), len).finish();
+
+                        for (size_t chunk: { 1, 7, 63, 64, 65, 200 }) {
+                                wr::CityHash64Stream pieces;
+                                for (size_t i = 0; i < len; i += chunk) {
+                                        pieces.update(input.data() + i,
+                                                      std::min(chunk, len - i));
+                                }
+                                if (pieces.finish() != expect) {
+                                        throw TestFailure("CityHash64Stream of %u bytes in %u-byte pieces differs from hash of whole",
+                                                          len, chunk);
+                                }
+                        }
+
+                        wr::CityHash64Stream longer;
+                        if (longer.update(input.data(), len + 1).finish() == expect) {
+                                throw TestFailure("CityHash64Stream of %u and %u bytes are equal",
+                                                  len, len + 1);
+                        }
+                }
+        });
+
+        tester.run("Many", 1, [] {
+                // identical to CityHash64() of each key, for all lengths
+                // and for batches shorter than the prefetch distance
+                auto input = testInput();
+
+                for (size_t n: { 0, 1, 5, 300 }) {
+                        std::vector<const char *>      keys;
+                        std::vector<size_t>            lens;
+                        std::vector<wr::string_view>   views;
+                        std::vector<wr::uint64>        hashes(n), view_hashes(n);
+
+                        for (size_t i = 0; i < n; ++i) {
+                                keys.push_back(input.data() + i);
+                                lens.push_back(i);
+                                views.emplace_back(keys.back(), lens.back());
+                        }
+
+                        wr::CityHash64Many(keys.data(), lens.data(), n,
+                                           hashes.data());
+                        wr::CityHash64Many(views.data(), n,
+                                           view_hashes.data());
+
+                        for (size_t i = 0; i < n; ++i) {
+                                auto expect = wr::CityHash64(keys[i], lens[i]);
+                                if ((hashes[i] != expect)
+                                                || (view_hashes[i] != expect)) {
+                                        throw TestFailure("CityHash64Many() of %u-byte key differs from CityHash64()",
+                                                          lens[i]);
+                                }
+                        }
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,953 @@
+/**
+ * \file CodecvtTests.cxx
+ *
+ * \brief Unit tests for wrutil codecvt facets
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <wrutil/codecvt.h>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/TestManager.h>
+#include "../src/codecvt/utf8_ucs4.h"  // built into this test, see CMake
+
+
+using wr::TestFailure;
+
+
+/*
+ * Converts all of `in` using an output buffer of `buf_size` chars at a
+ * time, as a stream buffer would; returns the result of the last call
+ */
+static std::codecvt_base::result
+convert(
+        const std::codecvt<char, char, std::mbstate_t> &cvt,
+        bool                                            to_narrow,
+        const std::string                              &in,
+        size_t                                          buf_size,
+        std::string                                    &out,
+        size_t                                         &consumed
+)
+{
+        std::mbstate_t  state = {};
+        const char     *from = in.data(), *from_end = from + in.size(),
+                       *from_next;
+        char            buf[4096], *to_next;
+        std::codecvt_base::result res;
+
+        out.clear();
+
+        do {
+                res = to_narrow ? cvt.out(state, from, from_end, from_next,
+                                          buf, buf + buf_size, to_next)
+                                : cvt.in(state, from, from_end, from_next,
+                                         buf, buf + buf_size, to_next);
+                out.append(buf, to_next);
+                if ((from_next == from) && (to_next == buf)) {
+                        break;  // no progress
+                }
+                from = from_next;
+        } while ((res == std::codecvt_base::partial) && (from < from_end));
+
+        consumed = size_t(from - in.data());
+        return res;
+}
+
+//--------------------------------------
+
+using Ucs4Codecvt = std::codecvt<char32_t, char, std::mbstate_t>;
+
+/*
+ * Facet calling utf8_ucs4.cxx directly, as wr::codecvt_utf8<char32_t> does
+ * where the standard library has no std::codecvt_utf8
+ */
+template <unsigned long Maxcode, wr::codecvt_mode Mode>
+class DirectUcs4Codecvt :
+        public Ucs4Codecvt
+{
+public:
+        DirectUcs4Codecvt() : Ucs4Codecvt(1) {}
+        ~DirectUcs4Codecvt() override {}
+
+protected:
+        result
+        do_out(
+                state_type &,
+                const char32_t  *from,
+                const char32_t  *from_end,
+                const char32_t *&from_next,
+                char            *to,
+                char            *to_end,
+                char           *&to_next
+        ) const override
+        {
+                auto frm = reinterpret_cast<const uint32_t *>(from),
+                     frm_nxt = frm;
+                auto t = reinterpret_cast<uint8_t *>(to), t_nxt = t;
+                auto r = wr::ucs4_to_utf8(
+                                frm, reinterpret_cast<const uint32_t *>(
+                                                                from_end),
+                                frm_nxt, t, reinterpret_cast<uint8_t *>(
+                                                                to_end),
+                                t_nxt, Maxcode, Mode);
+                from_next = from + (frm_nxt - frm);
+                to_next = to + (t_nxt - t);
+                return r;
+        }
+
+        result
+        do_in(
+                state_type &,
+                const char      *from,
+                const char      *from_end,
+                const char     *&from_next,
+                char32_t        *to,
+                char32_t        *to_end,
+                char32_t       *&to_next
+        ) const override
+        {
+                auto frm = reinterpret_cast<const uint8_t *>(from),
+                     frm_nxt = frm;
+                auto t = reinterpret_cast<uint32_t *>(to), t_nxt = t;
+                auto r = wr::utf8_to_ucs4(
+                                frm, reinterpret_cast<const uint8_t *>(
+                                                                from_end),
+                                frm_nxt, t, reinterpret_cast<uint32_t *>(
+                                                                to_end),
+                                t_nxt, Maxcode, Mode);
+                from_next = from + (frm_nxt - frm);
+                to_next = to + (t_nxt - t);
+                return r;
+        }
+
+        int
+        do_length(
+                state_type &,
+                const char *from,
+                const char *from_end,
+                size_t      max
+        ) const override
+        {
+                return wr::utf8_to_ucs4_length(
+                                reinterpret_cast<const uint8_t *>(from),
+                                reinterpret_cast<const uint8_t *>(from_end),
+                                max, Maxcode, Mode);
+        }
+
+        bool do_always_noconv() const noexcept override { return false; }
+        int do_encoding() const noexcept override { return 0; }
+        int do_max_length() const noexcept override { return 4; }
+};
+
+//--------------------------------------
+/*
+ * Runs `check` on wr::codecvt_utf8<char32_t, Maxcode, Mode> and on
+ * utf8_ucs4.cxx directly, which may be one and the same
+ */
+template <unsigned long Maxcode,
+          wr::codecvt_mode Mode = static_cast<wr::codecvt_mode>(0),
+          typename Check>
+static void
+checkUcs4Codecvts(
+        Check check
+)
+{
+        wr::codecvt_utf8<char32_t, Maxcode, Mode> library_cvt(1);
+        DirectUcs4Codecvt<Maxcode, Mode>          direct_cvt;
+
+        check(library_cvt, "wr::codecvt_utf8<char32_t>");
+        check(direct_cvt, "utf8_ucs4.cxx");
+}
+
+//--------------------------------------
+/*
+ * Encodes `chars` as UTF-8, recording the offset at which each character
+ * starts and the total length in `starts`
+ */
+static std::string
+encodeUtf8(
+        const std::u32string &chars,
+        std::vector<size_t>  &starts
+)
+{
+        std::string out;
+
+        starts.clear();
+        for (char32_t c: chars) {
+                starts.push_back(out.size());
+                if (c < 0x80) {
+                        out += char(c);
+                } else if (c < 0x800) {
+                        out += char(0xc0 | (c >> 6));
+                        out += char(0x80 | (c & 0x3f));
+                } else if (c < 0x10000) {
+                        out += char(0xe0 | (c >> 12));
+                        out += char(0x80 | ((c >> 6) & 0x3f));
+                        out += char(0x80 | (c & 0x3f));
+                } else {
+                        out += char(0xf0 | (c >> 18));
+                        out += char(0x80 | ((c >> 12) & 0x3f));
+                        out += char(0x80 | ((c >> 6) & 0x3f));
+                        out += char(0x80 | (c & 0x3f));
+                }
+        }
+        starts.push_back(out.size());
+        return out;
+}
+
+//--------------------------------------
+/*
+ * Calls cvt.in() once on all of `in`, returning the result and storing
+ * the output and the number of bytes consumed
+ */
+static std::codecvt_base::result
+ucs4In(
+        const Ucs4Codecvt &cvt,
+        const std::string &in,
+        size_t             out_size,
+        std::u32string    &out,
+        size_t            &consumed
+)
+{
+        std::mbstate_t         state = {};
+        const char            *from_next;
+        std::vector<char32_t>  buf(out_size + 1);
+        char32_t              *to_next;
+
+        auto res = cvt.in(state, in.data(), in.data() + in.size(), from_next,
+                          buf.data(), buf.data() + out_size, to_next);
+        out.assign(buf.data(), to_next);
+        consumed = size_t(from_next - in.data());
+        return res;
+}
+
+//--------------------------------------
+/*
+ * Calls cvt.out() once on all of `in`, returning the result and storing
+ * the output and the number of characters consumed
+ */
+static std::codecvt_base::result
+ucs4Out(
+        const Ucs4Codecvt    &cvt,
+        const std::u32string &in,
+        size_t                out_size,
+        std::string          &out,
+        size_t               &consumed
+)
+{
+        std::mbstate_t     state = {};
+        const char32_t    *from_next;
+        std::vector<char>  buf(out_size + 1);
+        char              *to_next;
+
+        auto res = cvt.out(state, in.data(), in.data() + in.size(), from_next,
+                           buf.data(), buf.data() + out_size, to_next);
+        out.assign(buf.data(), to_next);
+        consumed = size_t(from_next - in.data());
+        return res;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("Codecvt", argc, argv);
+
+        // the "C" locale's ASCII encoding exercises the wchar_t pivot
+        wr::codecvt_utf8_narrow cvt(std::locale::classic(), 1);
+
+        tester.run("UTF8Narrow", 1, [&] {
+                std::string in = std::string(1000, 'a') + "caf\xc3\xa9 "
+                                 + std::string(600, 'b') + "\xe2\x82\xac.";
+
+                for (size_t buf_size: { 1, 2, 3, 7, 256, 4096 }) {
+                        std::string out, back;
+                        size_t      consumed;
+
+                        auto res = convert(cvt, true, in, buf_size, out,
+                                           consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (consumed != in.size())
+                                        || (out != std::string(1000, 'a')
+                                                   + "caf? "
+                                                   + std::string(600, 'b')
+                                                   + "?.")) {
+                                throw TestFailure("UTF-8 to narrow with %u-char buffer gave result %d, %u chars consumed",
+                                                  buf_size, int(res), consumed);
+                        }
+
+                        res = convert(cvt, false, out, buf_size, back,
+                                      consumed);
+                        if ((res != std::codecvt_base::ok) || (back != out)) {
+                                throw TestFailure("narrow to UTF-8 with %u-char buffer gave result %d",
+                                                  buf_size, int(res));
+                        }
+                }
+        });
+
+        tester.run("UTF8Narrow", 2, [&] {
+                // invalid and incomplete input
+                for (size_t buf_size: { 1, 5, 4096 }) {
+                        std::string out;
+                        size_t      consumed;
+
+                        auto res = convert(cvt, true, "bad\xff seq", buf_size,
+                                           out, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != 3) || (out != "bad")) {
+                                throw TestFailure("invalid UTF-8 with %u-char buffer gave result %d, %u chars consumed",
+                                                  buf_size, int(res), consumed);
+                        }
+
+                        res = convert(cvt, true, "trunc\xe2\x82", buf_size,
+                                      out, consumed);
+                        if ((res != std::codecvt_base::partial)
+                                        || (consumed != 5)
+                                        || (out != "trunc")) {
+                                throw TestFailure("incomplete UTF-8 with %u-char buffer gave result %d, %u chars consumed",
+                                                  buf_size, int(res), consumed);
+                        }
+                }
+        });
+
+        tester.run("UTF8Narrow", 3, [&] {
+                // ASCII runs broken by shift codes and non-ASCII characters
+                std::string in = "\x1b[1mbold\x1b[0m \x0e\x0fx\xc3\xa9y"
+                                 + std::string(40, 'z') + "\xc3\xa9";
+
+                for (size_t buf_size: { 1, 3, 16, 4096 }) {
+                        std::string out, back;
+                        size_t      consumed;
+
+                        auto res = convert(cvt, true, in, buf_size, out,
+                                           consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (out != "\x1b[1mbold\x1b[0m \x0e\x0fx?y"
+                                                   + std::string(40, 'z')
+                                                   + "?")) {
+                                throw TestFailure("UTF-8 to narrow with %u-char buffer gave result %d",
+                                                  buf_size, int(res));
+                        }
+
+                        res = convert(cvt, false, out, buf_size, back,
+                                      consumed);
+                        if ((res != std::codecvt_base::ok) || (back != out)) {
+                                throw TestFailure("narrow to UTF-8 with %u-char buffer gave result %d",
+                                                  buf_size, int(res));
+                        }
+                }
+        });
+
+        tester.run("U8StringConvert", 1, [] {
+                wr::u8string_convert<> conv(new wr::codecvt_utf8_narrow(
+                                                std::locale::classic()));
+                std::string in = std::string(300, 'a') + "caf\xc3\xa9";
+                std::string out = "prefix:";
+
+                conv.from_utf8(in, out);
+                if (out != "prefix:" + std::string(300, 'a') + "caf?") {
+                        throw TestFailure("from_utf8() did not append to string");
+                }
+                if (conv.converted() != in.size()) {
+                        throw TestFailure("converted() returned %u, expected %u",
+                                          conv.converted(), in.size());
+                }
+
+                conv.to_utf8("narrow", out);
+                if (out.compare(out.size() - 10, 10, "caf?narrow") != 0) {
+                        throw TestFailure("to_utf8() did not append to string");
+                }
+
+                // u8string_view trims invalid UTF-8, but a range may hold it
+                for (std::string bad: { "bad\xff", "trunc\xe2\x82" }) {
+                        try {
+                                conv.from_utf8(bad.data(),
+                                               bad.data() + bad.size());
+                                throw TestFailure("no exception for invalid UTF-8");
+                        } catch (std::range_error &) {
+                        }
+                }
+        });
+
+        tester.run("U8StringConvert", 2, [] {
+                wr::u8string_convert<> conv(new wr::codecvt_utf8_narrow(
+                                                std::locale::classic()));
+                char buf[16];
+
+                if (conv.max_narrow_size(5) < 4) {
+                        throw TestFailure("max_narrow_size(5) returned %u",
+                                          conv.max_narrow_size(5));
+                }
+
+                char *end = conv.from_utf8("caf\xc3\xa9", buf, buf + 16);
+                if (!end || (std::string(buf, end) != "caf?")) {
+                        throw TestFailure("conversion into buffer failed");
+                }
+                if (conv.from_utf8("caf\xc3\xa9", buf, buf + 3)) {
+                        throw TestFailure("conversion into short buffer succeeded");
+                }
+
+                end = conv.to_utf8("text", buf, buf + conv.max_utf8_size(4));
+                if (!end || (std::string(buf, end) != "text")) {
+                        throw TestFailure("to_utf8() into buffer failed");
+                }
+        });
+
+        tester.run("UTF8UCS4", 1, [] {
+                // ASCII runs long enough for the bulk conversion, broken
+                // up by characters of every length
+                std::u32string chars;
+                for (int i = 0; i < 12; ++i) {
+                        chars += U"twenty ASCII chars. \u00e9\u0416\u20ac"
+                                 U"\uffff\U00010348\U0010ffff\u07ff\u0800";
+                        chars.append(size_t(i), U'\u4e2d');
+                }
+
+                std::vector<size_t> starts;
+                std::string         bytes = encodeUtf8(chars, starts);
+
+                checkUcs4Codecvts<0x10ffff>([&](const Ucs4Codecvt &cvt,
+                                                const char *name) {
+                        std::u32string out;
+                        size_t         consumed, n = 0;
+
+                        // input ending at every byte offset
+                        for (size_t len = 0; len <= bytes.size(); ++len) {
+                                while ((n < chars.size())
+                                                && (starts[n + 1] <= len)) {
+                                        ++n;
+                                }
+                                auto res = ucs4In(cvt, bytes.substr(0, len),
+                                                  chars.size(), out,
+                                                  consumed);
+                                auto expect = (starts[n] == len)
+                                                ? std::codecvt_base::ok
+                                                : std::codecvt_base::partial;
+                                if ((res != expect) || (consumed != starts[n])
+                                        || (out != chars.substr(0, n))) {
+                                        throw TestFailure("%s: in() of %u bytes returned %d, consuming %u, expected %d, consuming %u",
+                                                          name, len, int(res),
+                                                          consumed, int(expect),
+                                                          starts[n]);
+                                }
+                        }
+
+                        // output buffer filling up after every character
+                        for (size_t size = 0; size < chars.size(); ++size) {
+                                auto res = ucs4In(cvt, bytes, size, out,
+                                                  consumed);
+                                if ((res != std::codecvt_base::partial)
+                                        || (consumed != starts[size])
+                                        || (out != chars.substr(0, size))) {
+                                        throw TestFailure("%s: in() into %u chars returned %d, consuming %u, expected %u",
+                                                          name, size, int(res),
+                                                          consumed,
+                                                          starts[size]);
+                                }
+                        }
+
+                        // length() stopping after every character
+                        for (size_t max = 0; max <= chars.size(); ++max) {
+                                std::mbstate_t state = {};
+                                int len = cvt.length(state, bytes.data(),
+                                                     bytes.data()
+                                                        + bytes.size(), max);
+                                if (size_t(len) != starts[max]) {
+                                        throw TestFailure("%s: length() of %u chars returned %d, expected %u",
+                                                          name, max, len,
+                                                          starts[max]);
+                                }
+                        }
+                });
+        });
+
+        tester.run("UTF8UCS4", 2, [] {
+                // as UTF8UCS4.1, from UCS-4
+                std::u32string chars;
+                for (int i = 0; i < 12; ++i) {
+                        chars += U"twenty ASCII chars. \u00e9\u0416\u20ac"
+                                 U"\uffff\U00010348\U0010ffff\u07ff\u0800";
+                        chars.append(size_t(i), U'\u4e2d');
+                }
+
+                std::vector<size_t> starts;
+                std::string         bytes = encodeUtf8(chars, starts);
+
+                checkUcs4Codecvts<0x10ffff>([&](const Ucs4Codecvt &cvt,
+                                                const char *name) {
+                        std::string out;
+                        size_t      consumed, n = 0;
+
+                        for (size_t size = 0; size <= bytes.size(); ++size) {
+                                while ((n < chars.size())
+                                                && (starts[n + 1] <= size)) {
+                                        ++n;
+                                }
+                                auto res = ucs4Out(cvt, chars, size, out,
+                                                   consumed);
+                                auto expect = (n == chars.size())
+                                                ? std::codecvt_base::ok
+                                                : std::codecvt_base::partial;
+                                if ((res != expect) || (consumed != n)
+                                        || (out != bytes.substr(0,
+                                                                starts[n]))) {
+                                        throw TestFailure("%s: out() into %u bytes returned %d, consuming %u, expected %d, consuming %u",
+                                                          name, size, int(res),
+                                                          consumed, int(expect), n);
+                                }
+                        }
+                });
+        });
+
+        tester.run("UTF8UCS4", 3, [] {
+                // byte order marks
+                const std::string bom = "\xef\xbb\xbf";
+                std::u32string    chars;
+                std::string       bytes;
+                size_t            consumed;
+
+                checkUcs4Codecvts<0x10ffff, wr::consume_header>(
+                                [&](const Ucs4Codecvt &cvt,
+                                    const char *name) {
+                        auto res = ucs4In(cvt, bom + "abc", 8, chars,
+                                          consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (chars != U"abc")) {
+                                throw TestFailure("%s: byte order mark not consumed",
+                                                  name);
+                        }
+                });
+
+                checkUcs4Codecvts<0x10ffff>([&](const Ucs4Codecvt &cvt,
+                                                const char *name) {
+                        auto res = ucs4In(cvt, bom + "abc", 8, chars,
+                                          consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (chars != U"\ufeffabc")) {
+                                throw TestFailure("%s: byte order mark consumed",
+                                                  name);
+                        }
+                });
+
+                checkUcs4Codecvts<0x10ffff, wr::generate_header>(
+                                [&](const Ucs4Codecvt &cvt,
+                                    const char *name) {
+                        auto res = ucs4Out(cvt, U"abc", 8, bytes, consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (bytes != bom + "abc")) {
+                                throw TestFailure("%s: byte order mark not generated",
+                                                  name);
+                        }
+                        res = ucs4Out(cvt, U"abc", 2, bytes, consumed);
+                        if ((res != std::codecvt_base::partial)
+                                        || consumed || !bytes.empty()) {
+                                throw TestFailure("%s: partial byte order mark generated",
+                                                  name);
+                        }
+                });
+        });
+
+        tester.run("UTF8UCS4", 4, [] {
+                // Maxcode below 0xffff, which disables the bulk conversion
+                std::string    ascii(40, 'a');
+                std::u32string chars;
+                std::string    bytes;
+                size_t         consumed;
+
+                checkUcs4Codecvts<0xfffe>([&](const Ucs4Codecvt &cvt,
+                                              const char *name) {
+                        auto res = ucs4In(cvt, ascii + "\xe2\x82\xac"
+                                                     + "\xef\xbf\xbf", 64,
+                                          chars, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != ascii.size() + 3)
+                                        || (chars.size() != ascii.size() + 1)) {
+                                throw TestFailure("%s: in() of U+FFFF returned %d, consuming %u",
+                                                  name, int(res), consumed);
+                        }
+                        res = ucs4Out(cvt, std::u32string(40, U'a')
+                                                        + U"\u20ac\uffff",
+                                      64, bytes, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != 41)
+                                        || (bytes != ascii
+                                                     + "\xe2\x82\xac")) {
+                                throw TestFailure("%s: out() of U+FFFF returned %d, consuming %u",
+                                                  name, int(res), consumed);
+                        }
+                });
+
+                checkUcs4Codecvts<0x7f>([&](const Ucs4Codecvt &cvt,
+                                            const char *name) {
+                        auto res = ucs4In(cvt, ascii + "\xc3\xa9", 64,
+                                          chars, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != ascii.size())) {
+                                throw TestFailure("%s: in() of U+00E9 returned %d, consuming %u",
+                                                  name, int(res), consumed);
+                        }
+                });
+
+                checkUcs4Codecvts<0xffff>([&](const Ucs4Codecvt &cvt,
+                                              const char *name) {
+                        auto res = ucs4In(cvt, ascii + "\xef\xbf\xbf"
+                                                     + "\xf0\x90\x80\x80",
+                                          64, chars, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != ascii.size() + 3)) {
+                                throw TestFailure("%s: in() of U+10000 returned %d, consuming %u",
+                                                  name, int(res), consumed);
+                        }
+                });
+        });
+
+        tester.run("UTF8UCS4", 5, [] {
+                // overlong forms, values past U+10FFFF and stray or
+                // missing continuation bytes, alone and following enough
+                // input for the bulk conversion
+                std::u32string chars;
+                std::string    bytes;
+                size_t         consumed;
+
+                checkUcs4Codecvts<0x10ffff>([&](const Ucs4Codecvt &cvt,
+                                                const char *name) {
+                        for (std::string prefix: { std::string(),
+                                                   std::string(40, 'a'),
+                                                   std::string(20, 'a')
+                                                   + "\xe2\x82\xac\xc3\xa9"
+                                                   + std::string(20, 'a') }) {
+                                for (auto bad: { "\xc0\x80", "\xc1\xbf",
+                                                 "\xe0\x80\x80",
+                                                 "\xe0\x9f\xbf",
+                                                 "\xf0\x80\x80\x80",
+                                                 "\xf4\x90\x80\x80",
+                                                 "\xf5\x80\x80\x80",
+                                                 "\x80", "\xe2\x28\xa1" }) {
+                                        std::string in = prefix + bad
+                                                + std::string(20, 'b');
+                                        auto res = ucs4In(cvt, in, 128, chars,
+                                                          consumed);
+                                        if ((res != std::codecvt_base::error)
+                                                || (consumed != prefix.size())) {
+                                                throw TestFailure("%s: in() of invalid sequence after %u bytes returned %d, consuming %u",
+                                                                  name,
+                                                                  prefix.size(),
+                                                                  int(res),
+                                                                  consumed);
+                                        }
+                                }
+                        }
+
+                        std::u32string in(20, U'a');
+                        in += char32_t(0x110000);
+                        auto res = ucs4Out(cvt, in, 128, bytes, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != 20)
+                                        || (bytes != std::string(20, 'a'))) {
+                                throw TestFailure("%s: out() of 0x110000 returned %d, consuming %u",
+                                                  name, int(res), consumed);
+                        }
+                });
+        });
+
+        tester.run("UTF8UCS4", 6, [] {
+                // surrogates, which libstdc++'s std::codecvt_utf8 accepts
+                DirectUcs4Codecvt<0x10ffff, wr::codecvt_mode(0)> cvt;
+                std::u32string chars;
+                std::string    bytes;
+                size_t         consumed;
+
+                for (std::string prefix: { std::string(),
+                                           std::string(40, 'a'),
+                                           std::string(20, 'a')
+                                           + "\xe2\x82\xac\xc3\xa9"
+                                           + std::string(20, 'a') }) {
+                        for (auto bad: { "\xed\xa0\x80", "\xed\xbf\xbf" }) {
+                                std::string in = prefix + bad
+                                                 + std::string(20, 'b');
+                                auto res = ucs4In(cvt, in, 128, chars,
+                                                  consumed);
+                                if ((res != std::codecvt_base::error)
+                                        || (consumed != prefix.size())) {
+                                        throw TestFailure("in() of surrogate after %u bytes returned %d, consuming %u",
+                                                          prefix.size(),
+                                                          int(res), consumed);
+                                }
+                        }
+                }
+
+                for (char32_t bad: { char32_t(0xd800), char32_t(0xdfff) }) {
+                        std::u32string in(20, U'a');
+                        in += bad;
+                        in += U"\u20ac";
+                        auto res = ucs4Out(cvt, in, 128, bytes, consumed);
+                        if ((res != std::codecvt_base::error)
+                                        || (consumed != 20)
+                                        || (bytes != std::string(20, 'a'))) {
+                                throw TestFailure("out() of U+%X returned %d, consuming %u",
+                                                  unsigned(bad), int(res),
+                                                  consumed);
+                        }
+                }
+        });
+
+        tester.run("NativeCharset", 1, [] {
+                auto charset = wr::get_native_charset();
+
+                if (!charset || (wr::get_native_charset() != charset)) {
+                        throw TestFailure("native charset not cached");
+                }
+                if (charset->utf8 != wr::is_utf8(std::locale(""))) {
+                        throw TestFailure("utf8 is %d, expected %d",
+                                          int(charset->utf8),
+                                          int(!charset->utf8));
+                }
+
+                const char *saved = getenv("LC_ALL");
+                std::string saved_value = saved ? saved : "";
+
+                setenv("LC_ALL", "C", 1);
+                charset = wr::refresh_native_charset();
+                if (charset->utf8 || !charset->ascii_compatible
+                                  || (wr::get_native_charset() != charset)) {
+                        throw TestFailure("bad native charset for \"C\" locale");
+                }
+
+                wr::codecvt_utf8_narrow native_cvt(1);
+                std::string             out;
+                size_t                  consumed;
+
+                if ((convert(native_cvt, true, "caf\xc3\xa9", 64, out,
+                             consumed) != std::codecvt_base::ok)
+                                || (out != "caf?")) {
+                        throw TestFailure("default facet ignores refreshed charset");
+                }
+
+                bool have_utf8_locale = true;
+                try {
+                        std::locale("C.UTF-8");
+                } catch (std::runtime_error &) {
+                        have_utf8_locale = false;
+                }
+                if (have_utf8_locale) {
+                        setenv("LC_ALL", "C.UTF-8", 1);
+                        charset = wr::refresh_native_charset();
+                        wr::codecvt_utf8_narrow utf8_cvt(1);
+                        if (!charset->utf8 || !utf8_cvt.always_noconv()) {
+                                throw TestFailure("bad native charset for \"C.UTF-8\" locale");
+                        }
+                }
+
+                if (saved) {
+                        setenv("LC_ALL", saved_value.c_str(), 1);
+                } else {
+                        unsetenv("LC_ALL");
+                }
+                wr::refresh_native_charset();
+        });
+
+        tester.run("BufferConvert", 1, [] {
+                // writes of assorted sizes, splitting characters between them
+                std::string in = "ab", expected = "ab";
+                for (int i = 0; i < 3000; ++i) {
+                        in += (i % 5) ? "\xc3\xa9" : "z";
+                        expected += (i % 5) ? "?" : "z";
+                }
+
+                for (std::streamsize buf_size: { 16, 64, 16384 }) {
+                        std::stringbuf bytes;
+                        {
+                                wr::u8buffer_convert buf(&bytes,
+                                        new wr::codecvt_utf8_narrow(
+                                                std::locale::classic()),
+                                        {}, buf_size);
+                                std::ostream out(&buf);
+                                size_t       pos = 0, i = 0;
+
+                                while (pos < in.size()) {
+                                        static const size_t sizes[] =
+                                                { 1, 3, 7, 64, 65, 200, 1001 };
+                                        size_t n = std::min(sizes[i++ % 7],
+                                                            in.size() - pos);
+                                        out.write(&in[pos], n);
+                                        pos += n;
+                                }
+                                out.flush();
+                                if (!out) {
+                                        throw TestFailure("write failed with buffer size %d",
+                                                          int(buf_size));
+                                }
+                        }
+                        if (bytes.str() != expected) {
+                                throw TestFailure("bad output with buffer size %d",
+                                                  int(buf_size));
+                        }
+                }
+        });
+
+        tester.run("BufferConvert", 2, [] {
+                std::string text;
+                for (int i = 0; i < 20000; ++i) {
+                        text += char('a' + i % 26);
+                }
+
+                for (const char *name: { "C", "C.UTF-8" }) {
+                        std::locale loc;
+                        try {
+                                loc = std::locale(name);
+                        } catch (std::runtime_error &) {
+                                continue;  // locale not installed
+                        }
+
+                        std::stringbuf bytes(text);
+                        wr::u8buffer_convert buf(&bytes,
+                                new wr::codecvt_utf8_narrow(loc), {}, 256);
+                        std::istream in(&buf);
+                        std::string  got;
+                        char         chunk[5000];
+                        size_t       i = 0;
+
+                        while (in) {
+                                static const size_t sizes[] =
+                                        { 1, 3, 300, 5000, 7, 256, 257 };
+                                in.read(chunk, std::streamsize(sizes[i++ % 7]));
+                                got.append(chunk, size_t(in.gcount()));
+                                if ((i == 4) && in.unget()
+                                             && (in.get() != got.back())) {
+                                        throw TestFailure("putback after large read failed in %s locale",
+                                                          name);
+                                }
+                        }
+                        if (got != text) {
+                                throw TestFailure("bad input in %s locale",
+                                                  name);
+                        }
+                }
+        });
+
+#if WR_HAVE_ICONV
+        tester.run("Charset", 1, [] {
+                wr::codecvt_charset latin1("ISO-8859-1");
+                std::string in = std::string(500, 'x')
+                                 + "caf\xc3\xa9 \xe2\x82\xac.";
+
+                for (size_t buf_size: { 2, 3, 7, 4096 }) {
+                        std::string out, back;
+                        size_t      consumed;
+
+                        auto res = convert(latin1, true, in, buf_size, out,
+                                           consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (out != std::string(500, 'x')
+                                                   + "caf\xe9 ?.")) {
+                                throw TestFailure("UTF-8 to ISO-8859-1 with %u-char buffer gave result %d",
+                                                  buf_size, int(res));
+                        }
+
+                        res = convert(latin1, false, out, buf_size, back,
+                                      consumed);
+                        if ((res != std::codecvt_base::ok)
+                                        || (back != std::string(500, 'x')
+                                                    + "caf\xc3\xa9 ?.")) {
+                                throw TestFailure("ISO-8859-1 to UTF-8 with %u-char buffer gave result %d",
+                                                  buf_size, int(res));
+                        }
+                }
+
+                try {
+                        wr::codecvt_charset bad("no-such-charset");
+                        throw TestFailure("unsupported charset accepted");
+                } catch (std::invalid_argument &) {
+                }
+        });
+
+        tester.run("Charset", 2, [] {
+                // stateless charsets are accepted, stateful ones are not
+                for (auto charset: { "UTF-16LE", "UTF-32BE", "GB18030",
+                                     "SHIFT_JIS", "EUC-JP", "KOI8-R" }) {
+                        try {
+                                wr::codecvt_charset cvt(charset);
+                                if (cvt.max_length() < 1) {
+                                        throw TestFailure("%s has max_length() %d",
+                                                          charset,
+                                                          cvt.max_length());
+                                }
+                        } catch (std::invalid_argument &e) {
+                                if (strstr(e.what(), "stateful")) {
+                                        throw TestFailure("stateless charset %s rejected",
+                                                          charset);
+                                }  // else not supported here
+                        }
+                }
+                for (auto charset: { "ISO-2022-JP", "UTF-7", "UTF-16" }) {
+                        try {
+                                wr::codecvt_charset cvt(charset);
+                                throw TestFailure("stateful charset %s accepted",
+                                                  charset);
+                        } catch (std::invalid_argument &) {
+                        }
+                }
+        });
+
+        tester.run("Transcode", 1, [] {
+                std::string text = "na\xc3\xafve \xe2\x82\xac"
+                                   + std::string(10000, 'y');
+
+                auto utf16 = wr::transcode("UTF-8", "UTF-16LE", text);
+                if ((utf16.size() != 2 * (text.size() - 3))
+                                || (utf16.compare(0, 4, "n\0a\0", 4) != 0)) {
+                        throw TestFailure("bad UTF-16LE output");
+                }
+
+                std::string out = "prefix:";
+                wr::transcode("UTF-16LE", "UTF-8", utf16, out);
+                if (out != "prefix:" + text) {
+                        throw TestFailure("UTF-16LE to UTF-8 round trip failed");
+                }
+
+                for (auto from: { "UTF-8", "ISO-8859-1" }) {
+                        try {
+                                wr::transcode(from, "ASCII", "caf\xc3\xa9",
+                                              out);
+                                throw TestFailure("unrepresentable %s input accepted",
+                                                  from);
+                        } catch (std::range_error &) {
+                        }
+                }
+                if (out != "prefix:" + text) {
+                        throw TestFailure("output modified on error");
+                }
+        });
+#endif
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -22,7 +22,15 @@
  *
  * \endparblock
  */
+#include <wrutil/Config.h>
+#include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
+#if WR_POSIX
+#       include <unistd.h>
+#else
+#       include <io.h>
+#endif
 #include <wrutil/debug.h>  // add wrdebug library dependency
 #include <wrutil/filesystem.h>
 #include <wrutil/TestManager.h>
@@ -61,6 +69,72 @@ main(
                 }
         });
 
+        tester.run("lexically_normal", 3, [] {
+                static const char *const cases[][2] = {
+                        { "",               ""          },
+                        { ".",              "."         },
+                        { "./",             "."         },
+                        { "foo/./bar/..",   "foo/"      },
+                        { "foo/.///",       "foo/"      },
+                        { "foo//bar/",      "foo/bar/"  },
+                        { "foo/..",         "."         },
+                        { "a/b/../../..",   ".."        },
+                        { "../a/../..//",   "../.."     },
+                        { "/..//a/.",       "/a/"       },
+                        { "///",            "/"         }
+                };
+
+                for (auto &c: cases) {
+                        wr::path          input(c[0]), expect(c[1]),
+                                          normal(wr::lexically_normal(input));
+                        char              buf[32];
+                        wr::u8string_view u8normal = wr::lexically_normal(
+                                                        c[0], buf);
+
+                        if (normal.native() != expect.native()) {
+                                throw TestFailure("lexically_normal(\"%s\") returned \"%s\", expected \"%s\"",
+                                                  input, normal, expect);
+                        }
+                        if (u8normal != c[1]) {
+                                throw TestFailure("lexically_normal(u8\"%s\", buf) returned \"%s\", expected \"%s\"",
+                                                  c[0], u8normal, c[1]);
+                        }
+                }
+        });
+
+        tester.run("lexically_relative", 1, [] {
+                static const char *const cases[][3] = {
+                        { "/a/d",       "/a/b/c",       "../../d"       },
+                        { "/a/b/c",     "/a/d",         "../b/c"        },
+                        { "a/b/c",      "a",            "b/c"           },
+                        { "a/b/c",      "a/b/c/x/y",    "../.."         },
+                        { "a/b/c",      "a/b/c",        "."             },
+                        { "a/b",        "c/d",          "../../a/b"     },
+                        { "a/b/",       "a/x/..",       "b/"            },
+                        { "a//b",       "a/./c",        "../b"          },
+                        { "a",          "a/b/..",       "."             },
+                        { "a",          "../../b",      ""              },
+                        { "/a",         "b",            ""              },
+                        { "a",          "/b",           ""              }
+                };
+
+                for (auto &c: cases) {
+                        wr::path p(c[0]), base(c[1]), expect(c[2]),
+                                 relative(wr::lexically_relative(p, base)),
+                                 proximate(wr::lexically_proximate(p, base));
+
+                        if (relative.native() != expect.native()) {
+                                throw TestFailure("lexically_relative(\"%s\", \"%s\") returned \"%s\", expected \"%s\"",
+                                                  p, base, relative, expect);
+                        }
+                        if (proximate.native() != (expect.empty() ? p : expect)
+                                                                .native()) {
+                                throw TestFailure("lexically_proximate(\"%s\", \"%s\") returned \"%s\"",
+                                                  p, base, proximate);
+                        }
+                }
+        });
+
         tester.run("weakly_canonical", 1, [] {
                 wr::path input  = wr::current_path().root_name()
                                   / wr::u8path(u8"/does/not/exist"),
@@ -72,6 +146,101 @@ main(
                 }
         });
 
+        tester.run("weakly_canonical", 2, [] {
+                wr::path root = wr::temp_directory_path()
+                                / wr::unique_path("wrutil-canon-%%%%-%%%%");
+
+                wr::create_directories(root / "a" / "b");
+                wr::create_symlink("a/b", root / "link");
+                wr::create_symlink("nowhere", root / "dangling");
+
+                wr::path base = wr::canonical(root);
+                wr::canonical_cache cache;
+
+                static const char *const cases[][2] = {
+                        { "link/../x",          "a/x"           },
+                        { "link/./c/..",        "a/b/"          },
+                        { "a/link/..",          "a/"            },
+                        { "dangling/y",         "dangling/y"    },
+                        { "dangling/../a",      "a"             }
+                };
+
+                // uncached, then filling the cache, then using it
+                for (int pass = 0; pass < 3; ++pass) {
+                        for (auto &c: cases) {
+                                wr::path input = root / c[0],
+                                         expect = base / c[1],
+                                         result = (pass == 0)
+                                               ? wr::weakly_canonical(input)
+                                               : wr::weakly_canonical(input,
+                                                                      cache);
+
+                                if (result != expect) {
+                                        wr::fs_error_code ec;
+                                        wr::remove_all(root, ec);
+                                        throw TestFailure("weakly_canonical(%s) returned \"%s\", expected \"%s\"",
+                                                          input, result,
+                                                          expect);
+                                }
+                        }
+                }
+
+                wr::remove_all(root);
+        });
+
+        tester.run("unique_path", 1, [] {
+                wr::path pattern("ab-%%%%-%%%%%%%%-cd.x"),
+                         p1 = wr::unique_path(pattern),
+                         p2 = wr::unique_path(pattern);
+                auto     &n = p1.native();
+
+                if (n.size() != pattern.native().size()) {
+                        throw TestFailure("unique_path(%s) returned \"%s\"",
+                                          pattern, p1);
+                }
+                for (size_t i = 0; i < n.size(); ++i) {
+                        auto c = pattern.native()[i];
+                        if ((c == '%') ? !isxdigit(int(n[i])) : (n[i] != c)) {
+                                throw TestFailure("unique_path(%s) returned \"%s\"",
+                                                  pattern, p1);
+                        }
+                }
+                if (p1 == p2) {
+                        throw TestFailure("unique_path(%s) returned \"%s\" twice",
+                                          pattern, p1);
+                }
+        });
+
+        tester.run("create_unique_file", 1, [] {
+                wr::path pattern = wr::temp_directory_path()
+                                   / "wrutil-file-%%%%-%%%%",
+                         p1, p2;
+                int      fd1 = wr::create_unique_file(pattern, p1),
+                         fd2 = wr::create_unique_file(pattern, p2);
+                bool     ok = (fd1 >= 0) && (fd2 >= 0) && (p1 != p2)
+                              && wr::is_regular_file(p1)
+                              && wr::is_regular_file(p2);
+
+                // a name without '%' that is taken cannot be retried
+                wr::fs_error_code ec;
+                wr::path          p3;
+                int               fd3 = wr::create_unique_file(p1, p3, ec);
+
+                close(fd1);
+                close(fd2);
+                wr::remove(p1);
+                wr::remove(p2);
+
+                if (!ok) {
+                        throw TestFailure("create_unique_file(%s) failed to create two distinct files",
+                                          pattern);
+                }
+                if ((fd3 != -1) || (ec.value() != EEXIST)) {
+                        throw TestFailure("create_unique_file(%s) of existing file returned %d, error \"%s\"",
+                                          p1, fd3, ec.message());
+                }
+        });
+
         tester.run("path_has_prefix", 1, [] {
                 wr::path p1("one/two/three"), p2("one/two");
                 if (!wr::path_has_prefix(p1, p2)) {
@@ -88,5 +257,69 @@ main(
                 }
         });
 
+        tester.run("path_has_prefix", 3, [] {
+                static const struct { const char *p, *prefix; bool expect; }
+                cases[] = {
+                        { "one/two",            "one/two/",     true    },
+                        { "one//two/three",     "one/two",      true    },
+                        { "./one/./two",        "one/two/.",    true    },
+                        { "one/two",            "",             true    },
+                        { "/one",               "",             true    },
+                        { "one",                ".",            true    },
+                        { "/one",               ".",            false   },
+                        { "one",                "/",            false   },
+                        { "/one/two",           "/one",         true    },
+                        { "one/twothree",       "one/two",      false   },
+                        { "one/two",            "one/two/x",    false   }
+                };
+
+                for (auto &c: cases) {
+                        if (wr::path_has_prefix(c.p, c.prefix) != c.expect) {
+                                throw TestFailure("path_has_prefix(\"%s\", \"%s\") returned %s",
+                                                  c.p, c.prefix,
+                                                  c.expect ? "false" : "true");
+                        }
+                }
+        });
+
+        tester.run("path_sort_key", 1, [] {
+                // in sort key order, each directory followed by its contents
+                static const char *const sorted[] = {
+                        "",
+                        "a",
+                        "a/b",
+                        "a//b/c",
+                        "a/b-c",
+                        "a-b",
+                        "ab",
+                        "/",
+                        "/a",
+                        "/a/b"
+                };
+                static const size_t n = sizeof(sorted) / sizeof(sorted[0]);
+
+                for (size_t i = 0; i < n; ++i) {
+                        auto key_i = wr::path_sort_key(sorted[i]);
+
+                        for (size_t j = 0; j < n; ++j) {
+                                auto key_j = wr::path_sort_key(sorted[j]);
+                                int  cmp = wr::path_compare(sorted[i],
+                                                            sorted[j]);
+
+                                if (((i < j) && !((key_i < key_j) && (cmp < 0)))
+                                                || ((i == j) && (cmp != 0))
+                                                || ((i > j) && !((key_i > key_j) && (cmp > 0)))) {
+                                        throw TestFailure("\"%s\" and \"%s\" are out of order",
+                                                          sorted[i], sorted[j]);
+                                }
+                                if ((key_j.compare(0, key_i.size(), key_i) == 0)
+                                                != wr::path_has_prefix(sorted[j], sorted[i])) {
+                                        throw TestFailure("sort key of \"%s\" does not agree with path_has_prefix(\"%s\", \"%s\")",
+                                                          sorted[i], sorted[j], sorted[i]);
+                                }
+                        }
+                }
+        });
+
         return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
 }
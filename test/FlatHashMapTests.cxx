@@ -0,0 +1,403 @@
+/**
+ * \file FlatHashMapTests.cxx
+ *
+ * \brief Unit tests for wr::flat_hash_map and wr::flat_hash_set
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/flat_hash_map.h>
+#include <wrutil/flat_hash_set.h>
+#include <wrutil/TestManager.h>
+
+
+using wr::TestFailure;
+
+
+template <typename Map, typename Ref>
+static void
+checkSame(
+        const Map &map,
+        const Ref &ref
+)
+{
+        if (map.size() != ref.size()) {
+                throw TestFailure("size() returned %u, expected %u",
+                                  map.size(), ref.size());
+        }
+
+        size_t n = 0;
+
+        for (const auto &value: map) {
+                auto i = ref.find(value.first);
+                if (i == ref.end()) {
+                        throw TestFailure("unexpected key %s",
+                                          value.first);
+                } else if (value.second != i->second) {
+                        throw TestFailure("key %s has value %d, expected %d",
+                                          value.first, value.second,
+                                          i->second);
+                }
+                ++n;
+        }
+
+        if (n != ref.size()) {
+                throw TestFailure("iteration visited %u elements, expected %u",
+                                  n, ref.size());
+        }
+}
+
+//--------------------------------------
+
+/*
+ * Value whose copy constructor throws once `copies_left` reaches zero and
+ * whose move constructor may throw, so the table must copy it
+ */
+struct Fragile
+{
+        static int copies_left;
+
+        explicit Fragile(int v) : value(v) {}
+
+        Fragile(const Fragile &other) :
+                value(other.value)
+        {
+                if (copies_left >= 0 && !copies_left--) {
+                        throw std::runtime_error("copy failed");
+                }
+        }
+
+        Fragile(Fragile &&other) noexcept(false) :
+                value(other.value) { other.value = -1; }
+
+        int value;
+};
+
+int Fragile::copies_left = -1;
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("FlatHashMap", argc, argv);
+
+        tester.run("Basic", 1, [] {
+                wr::flat_hash_map<std::string, int> map;
+
+                if (!map.empty() || (map.begin() != map.end())
+                                 || (map.find("x") != map.end())) {
+                        throw TestFailure("new map is not empty");
+                }
+
+                auto r = map.try_emplace("one", 1);
+                if (!r.second || (r.first->first != "one")
+                              || (r.first->second != 1)) {
+                        throw TestFailure("try_emplace() failed");
+                }
+                r = map.try_emplace("one", 2);
+                if (r.second || (r.first->second != 1)) {
+                        throw TestFailure("try_emplace() replaced value");
+                }
+
+                map["two"] = 2;
+                map.insert({ "three", 3 });
+                map.emplace("four", 4);
+                map.insert_or_assign("one", 11);
+
+                if ((map.size() != 4) || (map.at("one") != 11)
+                                      || (map["two"] != 2)
+                                      || (map.count("three") != 1)
+                                      || !map.contains("four")
+                                      || map.contains("five")) {
+                        throw TestFailure("unexpected map contents");
+                }
+
+                try {
+                        map.at("five");
+                        throw TestFailure("at() did not throw for missing key");
+                } catch (std::out_of_range &) {
+                }
+
+                if ((map.erase("two") != 1) || (map.erase("two") != 0)
+                                            || (map.size() != 3)) {
+                        throw TestFailure("erase() by key failed");
+                }
+
+                map.clear();
+                if (!map.empty() || (map.begin() != map.end())) {
+                        throw TestFailure("clear() left elements");
+                }
+        });
+
+        tester.run("Basic", 2, [] {
+                // keys are const, as in std::unordered_map
+                using map_type = wr::flat_hash_map<std::string, int>;
+                using pair_type = std::pair<const std::string, int>;
+
+                static_assert(std::is_same<map_type::value_type,
+                                           pair_type>::value,
+                              "value_type has a mutable key");
+                static_assert(std::is_same<decltype(*map_type().begin()),
+                                           pair_type &>::value,
+                              "iterator exposes a mutable key");
+
+                map_type map;
+                for (int i = 0; i < 100; ++i) {
+                        const pair_type value(std::to_string(i), i);
+                        map.insert(value);
+                }
+                for (auto &value: map) {
+                        value.second *= 2;
+                }
+
+                map_type copy(map);  // copies from the exposed pairs
+                for (int i = 0; i < 100; ++i) {
+                        auto j = copy.find(std::to_string(i));
+                        if ((j == copy.end()) || (j->second != i * 2)) {
+                                throw TestFailure("key %d missing or wrong after copy",
+                                                  i);
+                        }
+                }
+        });
+
+        tester.run("Heterogeneous", 1, [] {
+                wr::flat_hash_map<std::string, int> map;
+                map["alpha"] = 1;
+                map["beta"] = 2;
+
+                wr::string_view    sv("beta");
+                const char        *cs = "alpha";
+
+                if ((map.find(sv) == map.end()) || (map.find(sv)->second != 2)
+                                                || (map.at(cs) != 1)
+                                                || !map.contains(sv)) {
+                        throw TestFailure("lookup by string_view failed");
+                }
+
+                auto r = map.try_emplace(wr::string_view("gamma"), 3);
+                if (!r.second || (r.first->first != "gamma")) {
+                        throw TestFailure("try_emplace() with string_view"
+                                          " failed");
+                }
+
+                if (map.erase(sv) != 1) {
+                        throw TestFailure("erase() by string_view failed");
+                }
+
+                wr::flat_hash_map<wr::string_view, int> view_map;
+                std::string key = "delta";
+                view_map[key] = 4;
+                if ((view_map.count(std::string("delta")) != 1)
+                                || (view_map.at("delta") != 4)) {
+                        throw TestFailure("lookup by std::string failed");
+                }
+
+                wr::flat_hash_map<wr::u8string_view, int> u8_map;
+                u8_map[wr::u8string_view(u8"été")] = 5;
+                if (u8_map.at(wr::u8string_view(u8"été")) != 5) {
+                        throw TestFailure("lookup by u8string_view failed");
+                }
+        });
+
+        tester.run("Churn", 1, [] {
+                // random insertions and erasures with a small key space
+                // leave many deleted slots, exercising in-place rehashing
+                std::mt19937                          rng(12345);
+                std::uniform_int_distribution<int>    dist(0, 2999);
+                wr::flat_hash_map<std::string, int>   map;
+                std::unordered_map<std::string, int>  ref;
+
+                for (int i = 0; i < 100000; ++i) {
+                        int         k = dist(rng);
+                        std::string key = "key" + std::to_string(k);
+
+                        switch (rng() % 3) {
+                        case 0:
+                                map.erase(key);
+                                ref.erase(key);
+                                break;
+                        default:
+                                map[key] = i;
+                                ref[key] = i;
+                                break;
+                        }
+
+                        if ((i % 9973) == 0) {
+                                checkSame(map, ref);
+                        }
+                }
+
+                checkSame(map, ref);
+
+                for (auto i = map.begin(); i != map.end(); ) {
+                        if (i->second & 1) {
+                                ref.erase(i->first);
+                                i = map.erase(i);
+                        } else {
+                                ++i;
+                        }
+                }
+
+                checkSame(map, ref);
+        });
+
+        tester.run("Rehash", 1, [] {
+                wr::flat_hash_map<int, int> map;
+                map.reserve(1000);
+
+                auto buckets = map.bucket_count();
+
+                for (int i = 0; i < 1000; ++i) {
+                        map[i] = -i;
+                }
+                if (map.bucket_count() != buckets) {
+                        throw TestFailure("table grew after reserve()");
+                }
+                if (map.load_factor() > map.max_load_factor()) {
+                        throw TestFailure("load factor %f exceeds maximum",
+                                          map.load_factor());
+                }
+
+                // integer keys with regular low bits
+                for (int i = 0; i < 1000; ++i) {
+                        map[i << 16] = i;
+                }
+
+                auto copy = map;
+                map.rehash(0);
+                if ((copy != map) || (map.size() != 2000 - 1)) {
+                        throw TestFailure("rehash() lost elements");
+                }
+
+                auto moved = std::move(copy);
+                if (!copy.empty() || (moved != map)) {
+                        throw TestFailure("move construction failed");
+                }
+
+                copy = moved;
+                moved.clear();
+                moved.rehash(0);
+                if (moved.bucket_count() != 0) {
+                        throw TestFailure("rehash(0) of empty map kept %u"
+                                          " buckets", moved.bucket_count());
+                }
+                swap(copy, moved);
+                if ((moved != map) || !copy.empty()) {
+                        throw TestFailure("swap() failed");
+                }
+        });
+
+        tester.run("MoveOnly", 1, [] {
+                wr::flat_hash_map<int, std::unique_ptr<int>> map;
+
+                for (int i = 0; i < 100; ++i) {
+                        map.try_emplace(i, new int(i));
+                }
+                for (int i = 0; i < 100; ++i) {
+                        if (*map.at(i) != i) {
+                                throw TestFailure("element %d has value %d",
+                                                  i, *map.at(i));
+                        }
+                }
+        });
+
+        tester.run("MoveOnly", 2, [] {
+                // a copy failing part way through a rehash changes nothing
+                wr::flat_hash_map<int, Fragile> map;
+
+                for (int i = 0; i < 1000; ++i) {
+                        map.try_emplace(i, i);
+                }
+
+                size_t capacity = map.bucket_count();
+                bool   threw = false;
+
+                Fragile::copies_left = 500;
+                try {
+                        map.rehash(capacity * 2);
+                } catch (std::runtime_error &) {
+                        threw = true;
+                }
+                Fragile::copies_left = -1;
+
+                if (!threw) {
+                        throw TestFailure("rehash() did not throw");
+                } else if (map.bucket_count() != capacity) {
+                        throw TestFailure("bucket_count() returned %u, expected %u",
+                                          map.bucket_count(), capacity);
+                } else if (map.size() != 1000) {
+                        throw TestFailure("size() returned %u, expected 1000",
+                                          map.size());
+                }
+                for (int i = 0; i < 1000; ++i) {
+                        auto j = map.find(i);
+                        if (j == map.end()) {
+                                throw TestFailure("key %d missing", i);
+                        } else if (j->second.value != i) {
+                                throw TestFailure("key %d has value %d",
+                                                  i, j->second.value);
+                        }
+                }
+
+                map.rehash(capacity * 2);  // and succeeds once copies do
+                if (map.size() != 1000 || map.at(999).value != 999) {
+                        throw TestFailure("rehash() lost elements");
+                }
+        });
+
+        tester.run("Set", 1, [] {
+                wr::flat_hash_set<std::string> set { "a", "b", "c" };
+
+                if (!set.insert("d").second || set.insert("a").second
+                                            || (set.size() != 4)) {
+                        throw TestFailure("insert() failed");
+                }
+                if ((set.count(wr::string_view("b")) != 1)
+                                || (set.find("c") == set.end())
+                                || (set.find("e") != set.end())) {
+                        throw TestFailure("lookup failed");
+                }
+                if ((set.erase("b") != 1) || set.contains("b")) {
+                        throw TestFailure("erase() failed");
+                }
+
+                size_t n = 0;
+                for (auto &s: set) {
+                        n += s.size();
+                }
+                if (n != 3) {
+                        throw TestFailure("iteration visited %u chars,"
+                                          " expected 3", n);
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/**
+ * \file HexTests.cxx
+ *
+ * \brief Unit tests for hexadecimal encoding functions
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <string>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/hex.h>
+#include <wrutil/TestManager.h>
+
+
+using wr::TestFailure;
+
+
+static std::string
+allBytes(
+        size_t size
+)
+{
+        std::string bytes;
+        for (size_t i = 0; i < size; ++i) {
+                bytes += static_cast<char>(i * 151 + 7);
+        }
+        return bytes;
+}
+
+//--------------------------------------
+
+static std::string
+slowHex(
+        const std::string &bytes,
+        const char        *digits
+)
+{
+        std::string hex;
+        for (unsigned char b: bytes) {
+                hex += digits[b >> 4];
+                hex += digits[b & 15];
+        }
+        return hex;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("Hex", argc, argv);
+
+        tester.run("encode", 1, [] {
+                // lengths either side of the 16-byte vector width
+                for (size_t size = 0; size <= 70; ++size) {
+                        auto bytes = allBytes(size);
+
+                        if (wr::hex_encode(bytes) != slowHex(bytes, "0123456789abcdef")) {
+                                throw TestFailure("lower case encoding of %u bytes is wrong",
+                                                  size);
+                        }
+                        if (wr::hex_encode(bytes, true) != slowHex(bytes, "0123456789ABCDEF")) {
+                                throw TestFailure("upper case encoding of %u bytes is wrong",
+                                                  size);
+                        }
+                }
+        });
+
+        tester.run("decode", 1, [] {
+                for (size_t size = 0; size <= 70; ++size) {
+                        auto bytes = allBytes(size);
+
+                        for (bool upper: { false, true }) {
+                                std::string result(size, '\0');
+
+                                if (!wr::hex_decode(wr::hex_encode(bytes, upper),
+                                                    &result[0])
+                                    || (result != bytes)) {
+                                        throw TestFailure("decoding of %u bytes does not reverse encoding",
+                                                          size);
+                                }
+                        }
+                }
+        });
+
+        tester.run("decode", 2, [] {
+                auto hex = wr::hex_encode(allBytes(40));
+                char buf[40];
+
+                if (wr::hex_decode(wr::string_view(hex.data(), 7), buf)) {
+                        throw TestFailure("decoding of odd number of digits succeeded");
+                }
+
+                // bad character in vector part and in scalar tail
+                for (size_t pos: { size_t(5), size_t(31), size_t(77) }) {
+                        for (char bad: { 'g', 'G', '/', ':', '@', '`', ' ', '\x80' }) {
+                                auto corrupt = hex;
+                                corrupt[pos] = bad;
+                                if (wr::hex_decode(corrupt, buf)) {
+                                        throw TestFailure("decoding with '%c' at position %u succeeded",
+                                                          bad, pos);
+                                }
+                        }
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,350 @@
+/**
+ * \file SHA256Tests.cxx
+ *
+ * \brief Unit tests for `wr::SHA256` class
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/SHA256.h>
+#include <wrutil/TestManager.h>
+#include "../src/SHA256_private.h"  // block functions, via wrutil_static
+
+
+using wr::TestFailure;
+
+
+static void
+checkHash(
+        const std::string &input,
+        const char        *expect
+)
+{
+        wr::SHA256  hasher;
+        std::string result = wr::SHA256::toString(hasher.append(input).hash());
+
+        if (result != expect) {
+                throw TestFailure("hash of %u-byte input returned \"%s\", expected \"%s\"",
+                                  input.size(), result, expect);
+        }
+}
+
+//--------------------------------------
+
+static const wr::SHA256::Hash INITIAL_HASH = {{
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+}};
+
+static const struct
+{
+        std::string input;
+        const char *expect;
+} BLOCK_VECTORS[] = {
+        { "abc",
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { std::string(1000000, 'a'),
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" }
+};
+
+/*
+ * Returns `input` with SHA-256 padding appended, a whole number of blocks
+ */
+static std::string
+padMessage(
+        const std::string &input
+)
+{
+        std::string padded = input + '\x80';
+        uint64_t    bits = uint64_t(input.size()) * 8;
+
+        padded.append((120 - padded.size() % 64) % 64, '\0');
+        for (int shift = 56; shift >= 0; shift -= 8) {
+                padded += char(uint8_t(bits >> shift));
+        }
+        return padded;
+}
+
+//--------------------------------------
+
+static void
+checkBlockFn(
+        const char        *name,
+        wr::SHA256BlockFn  fn
+)
+{
+        for (auto &v: BLOCK_VECTORS) {
+                std::string      padded = padMessage(v.input);
+                auto             data = reinterpret_cast<const uint8_t *>(
+                                                        padded.data());
+                size_t           blocks = padded.size() / 64;
+                wr::SHA256::Hash whole = INITIAL_HASH, split = INITIAL_HASH;
+
+                fn(whole, data, blocks);
+                fn(split, data, 1);  // and in two calls, the second unaligned
+                if (blocks > 1) {
+                        padded.insert(0, 1, '\0');
+                        fn(split, reinterpret_cast<const uint8_t *>(
+                                        padded.data()) + 65, blocks - 1);
+                }
+
+                for (auto &h: { whole, split }) {
+                        auto result = wr::SHA256::toString(h);
+                        if (result != v.expect) {
+                                throw TestFailure("%s hash of %u-byte input returned \"%s\", expected \"%s\"",
+                                                  name, v.input.size(),
+                                                  result, v.expect);
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+template <size_t N> static void
+checkLanesFn(
+        const char           *name,
+        wr::SHA256LanesFn<N>  fn
+)
+{
+        for (auto &v: BLOCK_VECTORS) {
+                std::string padded = padMessage(v.input);
+                uint32_t    state[8][N];
+
+                for (size_t i = 0; i < 8; ++i) {
+                        for (size_t lane = 0; lane < N; ++lane) {
+                                state[i][lane] = INITIAL_HASH[i];
+                        }
+                }
+                for (size_t offset = 0; offset < padded.size();
+                                        offset += 64) {
+                        const uint8_t *blocks[N];
+                        for (size_t lane = 0; lane < N; ++lane) {
+                                blocks[lane] = reinterpret_cast<
+                                        const uint8_t *>(padded.data())
+                                                + offset;
+                        }
+                        fn(state, blocks);
+                }
+
+                for (size_t lane = 0; lane < N; ++lane) {
+                        wr::SHA256::Hash h;
+                        for (size_t i = 0; i < 8; ++i) {
+                                h[i] = state[i][lane];
+                        }
+                        auto result = wr::SHA256::toString(h);
+                        if (result != v.expect) {
+                                throw TestFailure("%s lane %u hash of %u-byte input returned \"%s\", expected \"%s\"",
+                                                  name, lane, v.input.size(),
+                                                  result, v.expect);
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("SHA256", argc, argv);
+
+        tester.run("hash", 1, [] {
+                checkHash("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        });
+
+        tester.run("hash", 2, [] {
+                checkHash("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        });
+
+        tester.run("hash", 3, [] {
+                checkHash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        });
+
+        tester.run("hash", 4, [] {
+                checkHash(std::string(1000000, 'a'),
+                          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        });
+
+        tester.run("blocks", 1, [] {
+                // each block function compiled in that this CPU supports
+                checkBlockFn("scalar", &wr::sha256BlocksScalar);
+#if WR_HAVE_X86_SHA_INTRINSICS
+                if (wr::haveX86ShaExtensions()) {
+                        checkBlockFn("SHA-NI", &wr::sha256BlocksX86Sha);
+                }
+                if (wr::haveX86Ssse3()) {
+                        checkBlockFn("SSSE3", &wr::sha256BlocksSsse3);
+                }
+                if (wr::haveX86Avx2()) {
+                        checkLanesFn<8>("AVX2", &wr::sha256Lanes8Avx2);
+                }
+                if (wr::haveX86Avx512()) {
+                        checkLanesFn<16>("AVX-512",
+                                         &wr::sha256Lanes16Avx512);
+                }
+#endif
+#if WR_HAVE_ARM_SHA2_INTRINSICS
+                if (wr::haveArmSha2()) {
+                        checkBlockFn("ARMv8 SHA-2", &wr::sha256BlocksArmSha2);
+                }
+#endif
+        });
+
+        tester.run("toHash", 1, [] {
+                static const char *const DIGESTS[] = {
+                        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+                        "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD"
+                };
+
+                wr::SHA256 hasher;
+                auto       expect = hasher.append("abc").hash();
+
+                for (auto digest: DIGESTS) {
+                        if (wr::SHA256::toHash(digest) != expect) {
+                                throw TestFailure("toHash(\"%s\") did not return the hash of \"abc\"",
+                                                  digest);
+                        }
+                }
+        });
+
+        tester.run("toHash", 2, [] {
+                // short input: missing digits are zero
+                wr::SHA256::Hash expect = {{ 0xabcdef12, 0x30000000 }};
+
+                if (wr::SHA256::toHash("abcdef123") != expect) {
+                        throw TestFailure("toHash(\"abcdef123\") returned \"%s\"",
+                                          wr::SHA256::toString(
+                                                wr::SHA256::toHash("abcdef123")));
+                }
+        });
+
+        tester.run("append", 1, [] {
+                // split input at every position around block boundaries
+                std::string input;
+                for (int i = 0; i < 300; ++i) {
+                        input += static_cast<char>(i * 7 + 3);
+                }
+
+                wr::SHA256 whole;
+                auto expect = whole.append(input).hash();
+
+                for (size_t i = 0; i <= input.size(); ++i) {
+                        wr::SHA256 split;
+                        split.append(input.data(), i);
+                        split.append(input.data() + i, input.size() - i);
+
+                        if (split.chash() != expect) {
+                                throw TestFailure("hash of input split at offset %u differs from hash of whole input",
+                                                  i);
+                        }
+                }
+        });
+
+        tester.run("hashMany", 1, [] {
+                // messages of assorted lengths, more than one batch's worth
+                std::vector<std::string>     inputs;
+                std::vector<wr::string_view> messages;
+
+                for (size_t i = 0; i < 203; ++i) {
+                        inputs.emplace_back((i * 37) % 400,
+                                            static_cast<char>('a' + i % 26));
+                }
+                for (const auto &input: inputs) {
+                        messages.emplace_back(input);
+                }
+
+                std::vector<wr::SHA256::Hash> hashes(messages.size());
+
+                for (size_t count: { size_t(1), size_t(5), size_t(12),
+                                     messages.size() }) {
+                        wr::SHA256::hashMany(messages.data(), hashes.data(),
+                                             count);
+
+                        for (size_t i = 0; i < count; ++i) {
+                                wr::SHA256 hasher;
+                                if (hashes[i] != hasher.append(inputs[i]).hash()) {
+                                        throw TestFailure("hashMany() result %u of %u differs from hash of %u-byte message",
+                                                          i, count, inputs[i].size());
+                                }
+                        }
+                }
+        });
+
+        tester.run("sha256_file", 1, [] {
+                auto file = wr::temp_directory_path()
+                                / wr::unique_path("wrutil-sha256-%%%%-%%%%");
+                {
+                        std::ofstream out(file.c_str(), std::ios::binary);
+                        out << std::string(1000000, 'a');
+                }
+
+                wr::fs_error_code ec, read_ec;
+                auto              h = wr::sha256_file(file, ec),
+                                  h_read = wr::sha256_file_read(file,
+                                                                read_ec);
+                wr::remove(file);
+
+                if (ec || read_ec) {
+                        throw TestFailure("sha256_file() failed: %s",
+                                          (ec ? ec : read_ec).message());
+                }
+
+                auto result = wr::SHA256::toString(h);
+                if (result != "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") {
+                        throw TestFailure("sha256_file() returned \"%s\"",
+                                          result);
+                }
+                if (h_read != h) {
+                        throw TestFailure("sha256_file_read() returned \"%s\"",
+                                          wr::SHA256::toString(h_read));
+                }
+        });
+
+        tester.run("sha256_file", 2, [] {
+                auto file = wr::temp_directory_path()
+                                / wr::unique_path("wrutil-sha256-%%%%-%%%%");
+                wr::fs_error_code ec;
+
+                wr::sha256_file(file, ec);
+                if (!ec) {
+                        throw TestFailure("sha256_file() did not fail for nonexistent file");
+                }
+
+                try {
+                        wr::sha256_file(file);
+                } catch (const wr::filesystem_error &) {
+                        return;
+                }
+                throw TestFailure("sha256_file() did not throw for nonexistent file");
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+/**
+ * \file ScanTreeTests.cxx
+ *
+ * \brief Unit tests for wr::scan_tree()
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/scan_tree.h>
+#include <wrutil/TestManager.h>
+
+
+using wr::TestFailure;
+
+
+static void
+writeFile(
+        const wr::path    &p,
+        const std::string &contents
+)
+{
+        std::ofstream out(p.c_str(), std::ios::binary | std::ios::trunc);
+        out << contents;
+}
+
+//--------------------------------------
+
+class TempTree
+{
+public:
+        TempTree() :
+                root_(wr::temp_directory_path()
+                        / wr::unique_path("wrutil-scan-%%%%-%%%%"))
+        {
+                wr::create_directories(root_ / "sub" / "empty");
+                wr::create_directories(root_ / "skip" / "deeper");
+                writeFile(root_ / "a.txt", "alpha");
+                writeFile(root_ / "sub" / "c.txt", "charlie");
+                writeFile(root_ / "skip" / "deeper" / "d.txt", "delta");
+                wr::create_symlink("sub", root_ / "link");
+                for (int i = 0; i < 100; ++i) {
+                        writeFile(root_ / "sub" / ("f" + std::to_string(i)),
+                                  std::string(size_t(i), 'x'));
+                }
+        }
+
+        ~TempTree() { wr::fs_error_code ec; wr::remove_all(root_, ec); }
+
+        const wr::path &root() const { return root_; }
+
+private:
+        wr::path root_;
+};
+
+//--------------------------------------
+
+struct Found
+{
+        wr::file_type type;
+        unsigned      depth;
+        uint64_t      size;
+};
+
+/*
+ * Scans `root`, not descending into directories named "skip", and
+ * returns what was found keyed by path relative to `root`
+ */
+static std::map<std::string, Found>
+scan(
+        const wr::path   &root,
+        unsigned          threads,
+        bool              want_stat
+)
+{
+        std::map<std::string, Found> found;
+        std::mutex                   mutex;
+        std::string                  prefix = root.native();
+        wr::scan_options             options;
+
+        options.threads = threads;
+        options.want_stat = want_stat;
+
+        wr::scan_tree(root, options, [&](const wr::scan_entry &entry) {
+                std::string rel = entry.dir.to_string();
+                rel = (rel.size() > prefix.size())
+                        ? rel.substr(prefix.size() + 1) + "/" : "";
+                rel += entry.name.to_string();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                found[rel] = Found { entry.type, entry.depth, entry.size };
+                return entry.name != "skip";
+        });
+
+        return found;
+}
+
+//--------------------------------------
+
+/*
+ * Returns the number of open file descriptors where the system can list
+ * them, otherwise zero
+ */
+static size_t
+countOpenFiles()
+{
+        size_t            count = 0;
+        wr::fs_error_code ec;
+
+        for (wr::directory_iterator i("/proc/self/fd", ec), end;
+                                    !ec && (i != end); i.increment(ec)) {
+                ++count;
+        }
+        return count;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("ScanTree", argc, argv);
+
+        tester.run("scan_tree", 1, [] {
+                TempTree tree;
+
+                for (unsigned threads: { 1, 2, 8 }) {
+                        auto found = scan(tree.root(), threads, false);
+
+                        if (found.size() != 106) {
+                                throw TestFailure("scan with %u threads found %u entries, expected 106",
+                                                  threads, found.size());
+                        }
+                        if ((found["sub/empty"].type != wr::file_type::directory)
+                                        || (found["sub/empty"].depth != 2)
+                                        || (found["a.txt"].type != wr::file_type::regular)
+                                        || (found["a.txt"].depth != 1)
+                                        || (found["link"].type != wr::file_type::symlink)
+                                        || (found["skip"].type != wr::file_type::directory)) {
+                                throw TestFailure("scan with %u threads reported wrong types or depths",
+                                                  threads);
+                        }
+                        if (found.count("skip/deeper") || found.count("link/c.txt")) {
+                                throw TestFailure("scan with %u threads descended where it should not",
+                                                  threads);
+                        }
+                }
+        });
+
+        tester.run("scan_tree", 2, [] {
+                TempTree tree;
+                auto     found = scan(tree.root(), 2, true);
+
+                for (int i = 0; i < 100; ++i) {
+                        auto &entry = found["sub/f" + std::to_string(i)];
+                        if ((entry.type != wr::file_type::regular)
+                                        || (entry.size != uint64_t(i))) {
+                                throw TestFailure("sub/f%d has size %u, expected %d",
+                                                  i, entry.size, i);
+                        }
+                }
+        });
+
+        tester.run("scan_tree", 3, [] {
+                auto              root = wr::temp_directory_path()
+                                           / wr::unique_path("wrutil-scan-%%%%-%%%%");
+                wr::fs_error_code ec;
+
+                wr::scan_tree(root, wr::scan_options(),
+                              [](const wr::scan_entry &) { return true; },
+                              ec);
+                if (!ec) {
+                        throw TestFailure("scan of nonexistent tree did not fail");
+                }
+        });
+
+        tester.run("scan_tree", 4, [] {
+                // an exception thrown by the callback ends the scan
+                TempTree         tree;
+                wr::scan_options options;
+                bool             caught = false;
+
+                options.threads = 4;
+                try {
+                        wr::scan_tree(tree.root(), options,
+                                      [](const wr::scan_entry &entry) {
+                                if (entry.name == "c.txt") {
+                                        throw std::runtime_error("stop");
+                                }
+                                return true;
+                        });
+                } catch (std::runtime_error &) {
+                        caught = true;
+                }
+                if (!caught) {
+                        throw TestFailure("exception thrown by callback was not propagated");
+                }
+        });
+
+        tester.run("scan_tree", 5, [] {
+                /* a filesystem_error thrown by the callback reaches the
+                   caller unchanged, even through the error code overload,
+                   and leaves no directory open */
+                TempTree          tree;
+                wr::scan_options  options;
+                wr::fs_error_code ec;
+                wr::path          marker("thrown-by-callback");
+                size_t            fds = countOpenFiles();
+
+                options.threads = 2;
+                for (int i = 0; i < 20; ++i) {
+                        bool caught = false;
+                        try {
+                                wr::scan_tree(tree.root(), options,
+                                              [&](const wr::scan_entry &) {
+                                        throw wr::filesystem_error("stop",
+                                                marker, wr::fs_error_code());
+                                        return true;
+                                }, ec);
+                        } catch (wr::filesystem_error &e) {
+                                caught = (e.path1() == marker);
+                        }
+                        if (!caught) {
+                                throw TestFailure("filesystem_error thrown by callback was not propagated unchanged");
+                        }
+                }
+                if (countOpenFiles() != fds) {
+                        throw TestFailure("%u files open after scans, expected %u",
+                                          countOpenFiles(), fds);
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
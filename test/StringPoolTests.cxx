@@ -0,0 +1,193 @@
+/**
+ * \file StringPoolTests.cxx
+ *
+ * \brief Unit tests for wr::string_pool and wr::concurrent_string_pool
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/string_pool.h>
+#include <wrutil/TestManager.h>
+
+
+using wr::TestFailure;
+
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("StringPool", argc, argv);
+
+        tester.run("Intern", 1, [] {
+                wr::string_pool pool;
+                std::string     a = "alpha", a2 = "alpha";
+
+                auto s1 = pool.intern(a), s2 = pool.intern(a2),
+                     s3 = pool.intern("beta");
+
+                if ((s1 != "alpha") || (s3 != "beta")) {
+                        throw TestFailure("interned strings differ from"
+                                          " originals");
+                }
+                if ((s1.data() != s2.data()) || (s1.data() == a.data())) {
+                        throw TestFailure("equal strings not interned to"
+                                          " same copy");
+                }
+                if (strcmp(s3.data(), "beta") != 0) {
+                        throw TestFailure("interned string not"
+                                          " null-terminated");
+                }
+                if (pool.size() != 2) {
+                        throw TestFailure("size() returned %u, expected 2",
+                                          pool.size());
+                }
+
+                auto empty = pool.intern("");
+                if (!empty.data() || !empty.empty()) {
+                        throw TestFailure("bad interned empty string");
+                }
+
+                auto u8 = pool.intern(wr::u8string_view(u8"naïve"));
+                if ((u8 != wr::u8string_view(u8"naïve"))
+                                || (pool.find(u8"naïve").data()
+                                    != u8.char_data())) {
+                        throw TestFailure("bad interned u8string_view");
+                }
+
+                if (pool.find("gamma").data()) {
+                        throw TestFailure("find() found missing string");
+                }
+                if (pool.size() != 4) {
+                        throw TestFailure("find() modified pool");
+                }
+        });
+
+        tester.run("IDs", 1, [] {
+                wr::string_pool          pool;
+                std::vector<std::string> strings;
+
+                // include strings larger than the packing threshold
+                for (int i = 0; i < 20000; ++i) {
+                        strings.push_back("id" + std::to_string(i));
+                        if ((i % 1000) == 0) {
+                                strings.back().append(size_t(i) * 10, 'x');
+                        }
+                }
+
+                for (size_t i = 0; i < strings.size(); ++i) {
+                        if (pool.id(strings[i]) != i) {
+                                throw TestFailure("ID of string %u is %u",
+                                                  i, pool.id(strings[i]));
+                        }
+                }
+                for (size_t i = 0; i < strings.size(); ++i) {
+                        if ((pool.str(wr::string_pool::id_type(i))
+                                                        != strings[i])
+                                        || (pool.find_id(strings[i]) != i)) {
+                                throw TestFailure("ID %u maps to wrong"
+                                                  " string", i);
+                        }
+                }
+                if (pool.find_id("missing") != wr::string_pool::npos) {
+                        throw TestFailure("find_id() found missing string");
+                }
+
+                wr::string_pool moved(std::move(pool));
+                if (!pool.empty() || (moved.size() != strings.size())
+                                  || (moved.find_id("id42") != 42)) {
+                        throw TestFailure("move construction failed");
+                }
+                pool.intern("after move");
+                if (moved.find("after move").data()) {
+                        throw TestFailure("moved-from pool shares storage");
+                }
+
+                moved.clear();
+                if (!moved.empty() || moved.arena_size()
+                                   || (moved.id("id0") != 0)) {
+                        throw TestFailure("clear() failed");
+                }
+        });
+
+        tester.run("Concurrent", 1, [] {
+                wr::concurrent_string_pool pool(8);
+
+                enum { THREADS = 4, STRINGS = 20000 };
+
+                std::vector<std::thread>                    threads;
+                std::vector<std::vector<wr::string_view>>   views(THREADS);
+                std::vector<std::vector<wr::string_pool::id_type>> ids(THREADS);
+
+                for (int t = 0; t < THREADS; ++t) {
+                        threads.emplace_back([&, t] {
+                                // every thread interns the same strings,
+                                // in a different order
+                                for (int i = 0; i < STRINGS; ++i) {
+                                        int k = (i * (2 * t + 1)) % STRINGS;
+                                        std::string s = "s" + std::to_string(k);
+                                        views[t].push_back(pool.intern(s));
+                                        ids[t].push_back(pool.id(s));
+                                }
+                        });
+                }
+                for (auto &thread: threads) {
+                        thread.join();
+                }
+
+                if (pool.size() != STRINGS) {
+                        throw TestFailure("size() returned %u, expected %u",
+                                          pool.size(), int(STRINGS));
+                }
+
+                for (int t = 0; t < THREADS; ++t) {
+                        for (int i = 0; i < STRINGS; ++i) {
+                                int k = (i * (2 * t + 1)) % STRINGS;
+                                std::string s = "s" + std::to_string(k);
+
+                                if ((views[t][i].data()
+                                                != pool.find(s).data())
+                                        || (views[t][i] != s)) {
+                                        throw TestFailure("thread %d got"
+                                                " wrong copy of %s", t, s);
+                                }
+                                if ((ids[t][i] != pool.find_id(s))
+                                        || (pool.str(ids[t][i]) != s)) {
+                                        throw TestFailure("thread %d got"
+                                                " wrong ID for %s", t, s);
+                                }
+                        }
+                }
+
+                pool.clear();
+                if (pool.size() || pool.find("s1").data()) {
+                        throw TestFailure("clear() failed");
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/**
+ * \file TreeHasherTests.cxx
+ *
+ * \brief Unit tests for `wr::TreeHasher` class
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/TestManager.h>
+#include <wrutil/TreeHasher.h>
+
+
+using wr::TestFailure;
+
+
+static void
+writeFile(
+        const wr::path    &p,
+        const std::string &contents
+)
+{
+        std::ofstream out(p.c_str(), std::ios::binary | std::ios::trunc);
+        out << contents;
+}
+
+//--------------------------------------
+
+static std::string
+dirRecord(
+        char                    type,
+        const std::string      &name,
+        const wr::SHA256::Hash &h
+)
+{
+        std::string record(1, type);
+        record += name;
+        record += '\0';
+        for (auto word: h) {
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                        record += static_cast<char>(word >> shift);
+                }
+        }
+        return record;
+}
+
+//--------------------------------------
+
+class TempTree
+{
+public:
+        TempTree() :
+                root_(wr::temp_directory_path()
+                        / wr::unique_path("wrutil-tree-%%%%-%%%%"))
+        {
+                wr::create_directories(root_ / "sub" / "empty");
+                writeFile(root_ / "b.txt", "bravo");
+                writeFile(root_ / "a.txt", "alpha");
+                writeFile(root_ / "sub" / "c.txt", "charlie");
+        }
+
+        ~TempTree() { wr::fs_error_code ec; wr::remove_all(root_, ec); }
+
+        const wr::path &root() const { return root_; }
+
+private:
+        wr::path root_;
+};
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("TreeHasher", argc, argv);
+
+        tester.run("hash", 1, [] {
+                TempTree tree;
+                auto     h = [](const std::string &s) {
+                        return wr::SHA256().append(s).hash();
+                };
+
+                auto empty = h("");
+                auto sub = h(dirRecord('f', "c.txt", h("charlie"))
+                             + dirRecord('d', "empty", empty));
+                auto expect = h(dirRecord('f', "a.txt", h("alpha"))
+                                + dirRecord('f', "b.txt", h("bravo"))
+                                + dirRecord('d', "sub", sub));
+
+                auto result = wr::TreeHasher(2).hash(tree.root());
+
+                if (result != expect) {
+                        throw TestFailure("hash of tree returned \"%s\", expected \"%s\"",
+                                          wr::SHA256::toString(result),
+                                          wr::SHA256::toString(expect));
+                }
+        });
+
+        tester.run("hash", 2, [] {
+                // result must not depend on the number of threads
+                TempTree tree;
+
+                for (int i = 0; i < 50; ++i) {
+                        writeFile(tree.root() / "sub" / ("f" + std::to_string(i)),
+                                  std::string(i * 100, 'x'));
+                }
+
+                auto expect = wr::TreeHasher(1).hash(tree.root());
+
+                for (unsigned threads: { 2, 3, 8 }) {
+                        if (wr::TreeHasher(threads).hash(tree.root()) != expect) {
+                                throw TestFailure("hash of tree with %u threads differs from hash with 1 thread",
+                                                  threads);
+                        }
+                }
+        });
+
+        tester.run("hash", 3, [] {
+                TempTree tree;
+                auto     before = wr::TreeHasher().hash(tree.root());
+
+                wr::rename(tree.root() / "a.txt", tree.root() / "z.txt");
+                if (wr::TreeHasher().hash(tree.root()) == before) {
+                        throw TestFailure("hash of tree unchanged after renaming a file");
+                }
+        });
+
+        tester.run("hash", 4, [] {
+                auto              root = wr::temp_directory_path()
+                                           / wr::unique_path("wrutil-tree-%%%%-%%%%");
+                wr::fs_error_code ec;
+
+                wr::TreeHasher().hash(root, ec);
+                if (!ec) {
+                        throw TestFailure("hash of nonexistent tree did not fail");
+                }
+        });
+
+        tester.run("cache", 1, [] {
+                TempTree tree;
+                auto     cache_file = wr::temp_directory_path()
+                                        / wr::unique_path("wrutil-tree-%%%%-%%%%.cache");
+                auto     expect = wr::TreeHasher().hash(tree.root());
+
+                wr::TreeHasher hasher;
+                hasher.setCacheFile(cache_file);
+
+                auto first = hasher.hash(tree.root()),
+                     second = hasher.hash(tree.root());
+
+                wr::fs_error_code ec;
+                bool              saved = wr::exists(cache_file, ec);
+                wr::remove(cache_file, ec);
+
+                if (!saved) {
+                        throw TestFailure("cache file was not written");
+                }
+                if ((first != expect) || (second != expect)) {
+                        throw TestFailure("hash of tree using cache differs from uncached hash");
+                }
+        });
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
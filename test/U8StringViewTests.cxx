@@ -167,5 +167,54 @@ main(
                 }
         });
 
+        tester.run("to_u16string", 1, [] {
+                // mixes of ASCII, BMP and supplementary characters that
+                // straddle the converter's block boundaries
+                static const char *const pieces[] = {
+                        "abcdefghijklmnopq", u8"\u00e9", u8"\u4e2d\u6587",
+                        u8"\U0001f600", "xyz", u8"\uffee\u0800\u07ff"
+                };
+                std::string s;
+
+                for (int i = 0; i < 200; ++i) {
+                        s += pieces[(i * 7) % 6];
+                        if (i % 5 == 0) {
+                                s += pieces[i % 6];
+                        }
+
+                        u8string_view  view(s);
+                        std::u16string expected;
+
+                        for (char32_t c: view) {
+                                if (c > 0xffff) {
+                                        c -= 0x10000;
+                                        expected += char16_t(0xd800 | (c >> 10));
+                                        expected += char16_t(0xdc00 | (c & 0x3ff));
+                                } else {
+                                        expected += char16_t(c);
+                                }
+                        }
+
+                        if (view.to_u16string() != expected) {
+                                throw TestFailure("wrong conversion of %u byte string",
+                                                  s.size());
+                        }
+                }
+        });
+
+        tester.run("to_u16string", 2, [] {
+                if (!u8string_view("").to_u16string().empty()) {
+                        throw TestFailure("empty string not converted to empty string");
+                }
+
+                // encoded surrogates and invalid bytes become U+FFFD
+                std::u16string result = u8string_view(
+                        "ab\xed\xa0\x80\xff" "cd0123456789abcdef").to_u16string();
+
+                if (result != u"ab\ufffd\ufffd" "cd0123456789abcdef") {
+                        throw TestFailure("invalid sequences not replaced");
+                }
+        });
+
         return !tester.failed() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,279 @@
+/**
+ * \file UIOStreamTests.cxx
+ *
+ * \brief Unit tests for wr::uout, wr::uerr, wr::ulog and their proxies
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2017 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <wrutil/Config.h>
+#if WR_POSIX
+#       include <fcntl.h>
+#       include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wrutil/debug.h>  // add wrdebug library dependency
+#include <wrutil/filesystem.h>
+#include <wrutil/TestManager.h>
+#include <wrutil/uiostream.h>
+
+
+using wr::TestFailure;
+
+
+#if WR_POSIX
+
+/*
+ * Sends everything written to file descriptor `fd` to a temporary file
+ * for the lifetime of the object
+ */
+class Redirect
+{
+public:
+        explicit
+        Redirect(
+                int fd
+        ) :
+                fd_  (fd),
+                path_(wr::temp_directory_path()
+                        / wr::unique_path("wrutil-uio-%%%%-%%%%"))
+        {
+                // keep earlier output out of the file
+                wr::uout.flush();
+                wr::ulog.flush();
+                std::cout.flush();
+                std::clog.flush();
+
+                saved_ = dup(fd_);
+                int file = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                                0600);
+                dup2(file, fd_);
+                close(file);
+        }
+
+        ~Redirect()
+        {
+                dup2(saved_, fd_);
+                close(saved_);
+                wr::fs_error_code ec;
+                wr::remove(path_, ec);
+        }
+
+        std::string
+        contents() const
+        {
+                std::ifstream in(path_.c_str(), std::ios::binary);
+                return std::string(std::istreambuf_iterator<char>(in),
+                                   std::istreambuf_iterator<char>());
+        }
+
+private:
+        int      fd_,
+                 saved_;
+        wr::path path_;
+};
+
+//--------------------------------------
+
+static void
+runThreads(
+        unsigned                        count,
+        const std::function<void (int)> &thread_code
+)
+{
+        std::vector<std::thread> threads;
+
+        for (unsigned i = 0; i < count; ++i) {
+                threads.emplace_back(thread_code, int(i));
+        }
+        for (auto &thread: threads) {
+                thread.join();
+        }
+}
+
+#endif // WR_POSIX
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        wr::TestManager tester("uiostream", argc, argv);
+
+#if WR_POSIX
+        tester.run("ulog", 1, [] {
+                // concurrent writes lose or corrupt no output
+                static const int THREADS = 8, LINES = 20000;
+                std::string      output;
+
+                {
+                        Redirect redirect(2);
+                        runThreads(THREADS, [](int t) {
+                                std::string line(size_t(10 + t), 'a' + t);
+                                for (int i = 0; i < LINES; ++i) {
+                                        wr::ulog << line << '\n';
+                                }
+                        });
+                        wr::ulog.flush();
+                        output = redirect.contents();
+                }
+
+                size_t expect_size = 0;
+                for (int t = 0; t < THREADS; ++t) {
+                        expect_size += size_t(LINES) * size_t(11 + t);
+                }
+                auto lines = std::count(output.begin(), output.end(), '\n');
+
+                if ((lines != THREADS * LINES)
+                                || (output.size() != expect_size)) {
+                        throw TestFailure("output has %d lines and %u bytes, expected %d and %u",
+                                          lines, output.size(),
+                                          THREADS * LINES, expect_size);
+                }
+        });
+
+        tester.run("set_ubuffering", 1, [] {
+                Redirect    redirect(1);
+                std::string stage[4];
+
+                wr::set_ubuffering(wr::uout, wr::ubuffering::full);
+                wr::uout << "one\n";
+                stage[0] = redirect.contents();
+
+                wr::set_ubuffering(wr::uout, wr::ubuffering::line);
+                wr::uout << "two\n" << "three";
+                stage[1] = redirect.contents();
+
+                wr::set_ubuffering(wr::uout, wr::ubuffering::unbuffered);
+                wr::uout << "\nfour";
+                stage[2] = redirect.contents();
+
+                wr::set_ubuffering(wr::uout, wr::ubuffering::full);
+                wr::uout << "\nfive\n";
+                stage[3] = redirect.contents();
+                wr::uout.flush();
+
+                if ((stage[0] != "") || (stage[1] != "one\ntwo\n")
+                                     || (stage[2] != "one\ntwo\nthree\nfour")
+                                     || (stage[3] != stage[2])
+                                     || (redirect.contents()
+                                          != "one\ntwo\nthree\nfour\nfive\n")) {
+                        throw TestFailure("output appeared as \"%s\", \"%s\", \"%s\", \"%s\"",
+                                          stage[0], stage[1], stage[2],
+                                          stage[3]);
+                }
+        });
+
+        tester.run("ulog_local", 1, [] {
+                // lines written in pieces by concurrent threads stay whole
+                static const int THREADS = 8, LINES = 20000;
+                std::string      output;
+
+                {
+                        Redirect redirect(2);
+                        runThreads(THREADS, [](int t) {
+                                std::string pad(size_t(t + 1), char('a' + t));
+                                for (int i = 0; i < LINES; ++i) {
+                                        wr::ulog_local() << t << ' ' << i
+                                                         << ' ' << pad
+                                                         << '\n';
+                                }
+                        });
+                        wr::ulog.flush();
+                        output = redirect.contents();
+                }
+
+                std::vector<int>   next(THREADS, 0);
+                std::istringstream lines(output);
+                std::string        line;
+
+                while (std::getline(lines, line)) {
+                        std::istringstream fields(line);
+                        int                t = -1, i = -1;
+                        std::string        pad, rest;
+
+                        fields >> t >> i >> pad;
+                        if ((t < 0) || (t >= THREADS) || (i != next[t])
+                                        || (pad != std::string(size_t(t + 1),
+                                                               char('a' + t)))
+                                        || (fields >> rest)) {
+                                throw TestFailure("bad line \"%s\"", line);
+                        }
+                        ++next[t];
+                }
+                for (int t = 0; t < THREADS; ++t) {
+                        if (next[t] != LINES) {
+                                throw TestFailure("thread %d wrote %d lines, expected %d",
+                                                  t, next[t], LINES);
+                        }
+                }
+        });
+
+        tester.run("uout_local", 1, [] {
+                /* output pending when a thread exits is written then, and
+                   a line longer than the proxy holds back arrives whole */
+                std::string long_line(200000, 'x'), output;
+
+                {
+                        Redirect redirect(1);
+                        runThreads(1, [](int) {
+                                wr::uout_local() << "no newline";
+                        });
+                        wr::uout.flush();
+                        output = redirect.contents();
+                }
+                if (output != "no newline") {
+                        throw TestFailure("thread exit left \"%s\"", output);
+                }
+
+                {
+                        Redirect redirect(1);
+                        runThreads(1, [&](int) {
+                                for (size_t i = 0; i < long_line.size();
+                                                   i += 1000) {
+                                        wr::uout_local()
+                                                << long_line.substr(i, 1000);
+                                }
+                                wr::uout_local() << '\n';
+                        });
+                        wr::uout.flush();
+                        output = redirect.contents();
+                }
+                if (output != long_line + '\n') {
+                        throw TestFailure("%u-char line came out as %u chars",
+                                          long_line.size() + 1,
+                                          output.size());
+                }
+        });
+#endif
+
+        return tester.failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}